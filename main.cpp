@@ -2,13 +2,25 @@
 #define DOCTEST_CONFIG_DISABLE
 #include "utilities/error_codes.h"
 #include "utilities/ArgumentParser.h"
+#include "utilities/parallel.h"
+#include "utilities/tracing.h"
+#include "utilities/logging.h"
 #ifdef USE_QT5
 #include "qtgui/UiApplication.h"
+#include "qtgui/BatchApplication.h"
 #endif
 
 int main(int argc, char* argv[])
 {
   one_bit::ArgumentParser parser;
   if (! parser.parseArgs(argc, argv)) return errors::PARSE_FAILED;
-  return gui_mode::run_as_window(argc, argv, parser);
+  if (parser.has_worker_threads() && parser.get_worker_threads() >= 0) parallel::set_worker_count(parser.get_worker_threads());
+  if (parser.has_trace_file()) tracing::set_enabled(true);
+  const int result{ one_bit::UiMode::NONE == parser.get_use_gui() ? batch_mode::run_headless(argc, argv, parser) : gui_mode::run_as_window(argc, argv, parser) };
+  if (parser.has_trace_file() && !tracing::write_file(parser.get_trace_file()))
+  {
+    STIXELATOR_LOG(ERR, "Could not write trace to " << parser.get_trace_file());
+    return errors::NONE == result ? errors::WRITE_ERROR : result;
+  }
+  return result;
 }
\ No newline at end of file
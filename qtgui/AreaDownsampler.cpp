@@ -0,0 +1,133 @@
+#include "AreaDownsampler.h"
+#include "parallel.h"
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+
+namespace
+{
+  // source pixels covered by one result pixel along one axis
+  struct Footprint
+  {
+    int first;
+    int count;
+    double firstWeight;
+    double lastWeight;
+    double totalWeight;
+
+    double weight(int offset) const
+    {
+      if (offset == 0) return firstWeight;
+      if (offset == count - 1) return lastWeight;
+      return 1.;
+    }
+  };
+
+  std::vector<Footprint> footprints(int in_sourceOffset, int in_sourceLength, int in_targetLength);
+  QRgb toRgb(const double* in_sums, double in_area);
+}
+
+namespace downsampling
+{
+  QImage area_average(const QImage& in_source, const QSize& in_size)
+  {
+    return area_average(in_source, in_source.rect(), in_size);
+  }
+
+  QImage area_average(const QImage& in_source, const QRect& in_region, const QSize& in_size)
+  {
+    return area_average(in_source, in_region, in_size, []() { return true; });
+  }
+
+  QImage area_average(const QImage& in_source, const QRect& in_region, const QSize& in_size, const std::function<bool()>& in_rowDone)
+  {
+    const QRect region{ in_region.intersected(in_source.rect()) };
+    if (in_source.isNull() || region.isEmpty() || in_size.isEmpty())
+    {
+      return QImage{};
+    }
+    const bool directlyReadable{ in_source.format() == QImage::Format_RGB32 || in_source.format() == QImage::Format_ARGB32 };
+    const QImage source{ directlyReadable ? in_source : in_source.convertToFormat(QImage::Format_ARGB32) };
+
+    const auto columns{ footprints(region.x(), region.width(), in_size.width()) };
+    const auto rows{ footprints(region.y(), region.height(), in_size.height()) };
+
+    QImage result(in_size, QImage::Format_RGB32);
+    // get the pointers up front, scanLine() on the shared image is not safe from worker threads
+    uchar* resultBits{ result.bits() };
+    const qsizetype resultStride{ result.bytesPerLine() };
+    const uchar* sourceBits{ source.constBits() };
+    const qsizetype sourceStride{ source.bytesPerLine() };
+    const int targetWidth{ in_size.width() };
+    std::atomic<bool> aborted{ false };
+
+    parallel::for_each_band(in_size.height(), [&](unsigned in_begin, unsigned in_end) {
+      std::vector<double> sums(3 * targetWidth);
+      for (unsigned y = in_begin; y < in_end; ++y)
+      {
+        std::fill(sums.begin(), sums.end(), 0.);
+        const Footprint& row{ rows[y] };
+        for (int rowOffset = 0; rowOffset < row.count; ++rowOffset)
+        {
+          const double rowWeight{ row.weight(rowOffset) };
+          const QRgb* sourceLine{ (const QRgb*)(sourceBits + (row.first + rowOffset) * sourceStride) };
+          for (int x = 0; x < targetWidth; ++x)
+          {
+            const Footprint& column{ columns[x] };
+            double red{ 0. }, green{ 0. }, blue{ 0. };
+            for (int columnOffset = 0; columnOffset < column.count; ++columnOffset)
+            {
+              const double weight{ column.weight(columnOffset) };
+              const QRgb pixel{ sourceLine[column.first + columnOffset] };
+              red += weight * qRed(pixel);
+              green += weight * qGreen(pixel);
+              blue += weight * qBlue(pixel);
+            }
+            sums[3 * x] += rowWeight * red;
+            sums[3 * x + 1] += rowWeight * green;
+            sums[3 * x + 2] += rowWeight * blue;
+          }
+        }
+        QRgb* resultLine{ (QRgb*)(resultBits + y * resultStride) };
+        for (int x = 0; x < targetWidth; ++x)
+        {
+          resultLine[x] = toRgb(&sums[3 * x], columns[x].totalWeight * row.totalWeight);
+        }
+        if (aborted || !in_rowDone())
+        {
+          aborted = true;
+          return;
+        }
+      }
+    });
+    return aborted ? QImage{} : result;
+  }
+}
+
+namespace
+{
+  std::vector<Footprint> footprints(int in_sourceOffset, int in_sourceLength, int in_targetLength)
+  {
+    const double scale{ 1. * in_sourceLength / in_targetLength };
+    std::vector<Footprint> result;
+    result.reserve(in_targetLength);
+    for (int target = 0; target < in_targetLength; ++target)
+    {
+      const double begin{ target * scale };
+      const double end{ std::min((target + 1) * scale, 1. * in_sourceLength) };
+      const int first{ std::min((int)std::floor(begin), in_sourceLength - 1) };
+      const int last{ std::max(first, std::min((int)std::ceil(end), in_sourceLength) - 1) };
+      const double firstWeight{ std::min(end, first + 1.) - begin };
+      const double lastWeight{ (first == last) ? firstWeight : end - last };
+      result.push_back(Footprint{ in_sourceOffset + first, last - first + 1, firstWeight, lastWeight, end - begin });
+    }
+    return result;
+  }
+
+  QRgb toRgb(const double* in_sums, double in_area)
+  {
+    auto channel = [in_area](double sum) { return std::clamp((int)std::lround(sum / in_area), 0, 255); };
+    return qRgb(channel(in_sums[0]), channel(in_sums[1]), channel(in_sums[2]));
+  }
+}
\ No newline at end of file
@@ -0,0 +1,16 @@
+#pragma once
+#include <QImage>
+#include <QRect>
+#include <QSize>
+#include <functional>
+
+namespace downsampling
+{
+  // every pixel of the RGB32 result is the exact area weighted mean of the source pixels its cell covers,
+  // including partial coverage at fractional cell borders. Row bands of the result are computed in parallel.
+  QImage area_average(const QImage& in_source, const QSize& in_size);
+  QImage area_average(const QImage& in_source, const QRect& in_region, const QSize& in_size);
+  // in_rowDone gets called after every finished result row, from any worker thread. Once it returns false
+  // the remaining rows are skipped and the result is a null image.
+  QImage area_average(const QImage& in_source, const QRect& in_region, const QSize& in_size, const std::function<bool()>& in_rowDone);
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include "BatchApplication.h"
+#include "QtPixelator.h"
+#include <QCoreApplication>
+#include <QImage>
+#include <QUrl>
+#include "cropping.h"
+#include "error_codes.h"
+#include "logging.h"
+#include "tracing.h"
+
+namespace batch_mode
+{
+  int run_headless(int argc, char* argv[], const one_bit::ArgumentParser& in_params)
+  {
+    // a core application is enough for image I/O plugins, no need for a GUI or QML engine
+    QCoreApplication batchApp(argc, argv);
+
+    if (!in_params.has_input_file())
+    {
+      STIXELATOR_LOG(ERR, "No input file given, use -infile=<path>");
+      return errors::WRONG_INPUT_FILE;
+    }
+    if (!in_params.has_output_file())
+    {
+      STIXELATOR_LOG(ERR, "No output file given, use -outfile=<path>");
+      return errors::WRONG_OUTPUT_FILE;
+    }
+    if (!(in_params.has_width() && in_params.has_height() && in_params.has_gauge_stitches() && in_params.has_gauge_rows()))
+    {
+      STIXELATOR_LOG(ERR, "Result size requires -width, -height, -gauge-st and -gauge-rw");
+      return errors::INVALID_IMAGE_SIZES;
+    }
+
+    QImage image;
+    {
+      tracing::Span span{ "decode" };
+      if (!image.load(QString::fromStdString(in_params.get_input_file())))
+      {
+        STIXELATOR_LOG(ERR, "Could not load " << in_params.get_input_file());
+        return errors::WRONG_INPUT_FILE;
+      }
+      span.setBytes(image.sizeInBytes());
+    }
+
+    QtPixelator pixelator;
+    auto result = pixelator.setStitchSizes(in_params.get_width(), in_params.get_height(), in_params.get_gauge_rows(), in_params.get_gauge_stitches());
+    if (errors::NONE != result) return result;
+
+    // same defaults as the GUI's initial color list
+    result = pixelator.setStitchColors({ QColorConstants::Svg::black, QColorConstants::Svg::white });
+    if (errors::NONE != result) return result;
+
+    if (in_params.has_dither_mode())
+    {
+      result = pixelator.setDitherMode((int)in_params.get_dither_mode());
+      if (errors::NONE != result) return result;
+    }
+
+    // the ROI follows the result's aspect ratio, just like the GUI selection does
+    const auto anchor{ in_params.has_crop_region() ? in_params.get_crop_region() : one_bit::CropRegion::TOP_LEFT };
+    const double aspectRatio{ 1. * in_params.get_height() / in_params.get_width() };
+    const auto region{ cropping::crop_to_aspect_ratio(image.width(), image.height(), aspectRatio, anchor) };
+    STIXELATOR_LOG(DEBUG, "Cropping to " << region.x << "/" << region.y << " (" << region.width << "x" << region.height << ")");
+
+    result = pixelator.setInputRegion(image, QRect(region.x, region.y, region.width, region.height));
+    if (errors::NONE != result) return result;
+
+    if (in_params.has_memory_budget() && in_params.get_memory_budget() > 0)
+    {
+      // given in MiB, charts above it get written in strips on commit
+      result = pixelator.setMemoryBudget((qulonglong)in_params.get_memory_budget() << 20);
+      if (errors::NONE != result) return result;
+      STIXELATOR_LOG(DEBUG, "Result needs " << (double)pixelator.estimatedResultBytes() / (1 << 20) << " MiB, budget is " << in_params.get_memory_budget() << " MiB");
+    }
+
+    result = pixelator.setStoragePath(QUrl::fromLocalFile(QString::fromStdString(in_params.get_output_file())));
+    if (errors::NONE != result) return result;
+
+    result = pixelator.runSynchronously();
+    if (errors::NONE != result) return result;
+
+    return pixelator.commit();
+  }
+}
\ No newline at end of file
@@ -0,0 +1,6 @@
+#pragma once
+#include "ArgumentParser.h"
+namespace batch_mode
+{
+  int run_headless(int argc, char* argv[], const one_bit::ArgumentParser& in_params);
+}
\ No newline at end of file
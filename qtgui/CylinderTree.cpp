@@ -0,0 +1,104 @@
+#include "CylinderTree.h"
+#include <algorithm>
+#include <numeric>
+#include <limits>
+
+namespace
+{
+  // slack for pruning, so rounding in distance() never hides a point at exactly the same distance
+  constexpr double tieTolerance{ 1e-9 };
+
+  double coordinate(const color_space::HsvPoint& in_point, unsigned char in_axis);
+}
+
+namespace color_space
+{
+  CylinderTree::CylinderTree()
+    : points{}
+    , order{}
+    , axes{}
+  {}
+
+  CylinderTree::CylinderTree(const std::vector<HsvPoint>& in_points)
+    : points{ in_points }
+    , order(in_points.size())
+    , axes(in_points.size(), 0)
+  {
+    std::iota(order.begin(), order.end(), 0);
+    build(0, (int)order.size());
+  }
+
+  int CylinderTree::size() const
+  {
+    return (int)points.size();
+  }
+
+  int CylinderTree::nearest(const HsvPoint& in_point) const
+  {
+    double bestDistance{ std::numeric_limits<double>::max() };
+    int bestIndex{ -1 };
+    search(0, (int)order.size(), in_point, bestDistance, bestIndex);
+    return bestIndex;
+  }
+
+  void CylinderTree::build(int in_begin, int in_end)
+  {
+    if (in_end - in_begin <= 1) return;
+    // split along the axis with the largest spread
+    unsigned char axis{ 0 };
+    double widestSpread{ -1. };
+    for (unsigned char candidate = 0; candidate < 3; ++candidate)
+    {
+      const auto [lowest, highest] = std::minmax_element(order.begin() + in_begin, order.begin() + in_end, [this, candidate](int first, int second) {
+        return coordinate(points[first], candidate) < coordinate(points[second], candidate);
+      });
+      const double spread{ coordinate(points[*highest], candidate) - coordinate(points[*lowest], candidate) };
+      if (spread > widestSpread)
+      {
+        widestSpread = spread;
+        axis = candidate;
+      }
+    }
+    const int median{ in_begin + (in_end - in_begin) / 2 };
+    std::nth_element(order.begin() + in_begin, order.begin() + median, order.begin() + in_end, [this, axis](int first, int second) {
+      return coordinate(points[first], axis) < coordinate(points[second], axis);
+    });
+    axes[median] = axis;
+    build(in_begin, median);
+    build(median + 1, in_end);
+  }
+
+  void CylinderTree::search(int in_begin, int in_end, const HsvPoint& in_point, double& io_distance, int& io_index) const
+  {
+    if (in_begin >= in_end) return;
+    const int median{ in_begin + (in_end - in_begin) / 2 };
+    const int index{ order[median] };
+    const double currDistance{ distance(in_point, points[index]) };
+    if (currDistance < io_distance || (currDistance == io_distance && index < io_index))
+    {
+      io_distance = currDistance;
+      io_index = index;
+    }
+    const double offset{ coordinate(in_point, axes[median]) - coordinate(points[index], axes[median]) };
+    const bool lowerFirst{ offset < 0. };
+    search(lowerFirst ? in_begin : median + 1, lowerFirst ? median : in_end, in_point, io_distance, io_index);
+    // points on the far side are at least |offset| away, equal coordinates may lie on either side
+    if (std::abs(offset) <= io_distance + tieTolerance)
+    {
+      search(lowerFirst ? median + 1 : in_begin, lowerFirst ? in_end : median, in_point, io_distance, io_index);
+    }
+  }
+}
+
+namespace
+{
+  double coordinate(const color_space::HsvPoint& in_point, unsigned char in_axis)
+  {
+    switch (in_axis)
+    {
+    case 0: return in_point.rc;
+    case 1: return in_point.pl;
+    default: return in_point.v;
+    }
+  }
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#pragma once
+#include "HslCylinder.h"
+#include <vector>
+
+namespace color_space
+{
+  // k-d tree over points of the HSL cylinder. Nearest neighbour queries visit O(log n) points on average and
+  // return the same entry as a linear scan with distance(): the lowest index among the closest points.
+  class CylinderTree
+  {
+  public:
+    CylinderTree();
+    explicit CylinderTree(const std::vector<HsvPoint>& in_points);
+
+    int size() const;
+    // index of the point closest to in_point, -1 for an empty tree
+    int nearest(const HsvPoint& in_point) const;
+
+  private:
+    void build(int in_begin, int in_end);
+    void search(int in_begin, int in_end, const HsvPoint& in_point, double& io_distance, int& io_index) const;
+
+    std::vector<HsvPoint> points;
+    // the tree is implicit: the median of every range [begin, end) of order splits it along axes[median]
+    std::vector<int> order;
+    std::vector<unsigned char> axes;
+  };
+}
\ No newline at end of file
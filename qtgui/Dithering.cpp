@@ -0,0 +1,182 @@
+#include "Dithering.h"
+#include "parallel.h"
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  struct Tap
+  {
+    int dx;
+    int dy;
+    float weight;
+  };
+
+  struct DiffusionKernel
+  {
+    std::vector<Tap> taps;
+    // columns the row above has to be ahead: the farthest tap to the right within a row, plus the column the row
+    // above still writes into from below left, plus one for the pixel itself
+    int lag;
+  };
+
+  DiffusionKernel diffusionKernel(one_bit::DitherMode in_mode);
+  QRgb clampedRgb(float in_red, float in_green, float in_blue);
+
+  one_bit::StitchChart nearest(const QImage& in_averages, PaletteLookup& in_palette, const std::function<bool()>& in_rowDone);
+  one_bit::StitchChart ordered(const QImage& in_averages, PaletteLookup& in_palette, const std::function<bool()>& in_rowDone);
+  one_bit::StitchChart diffused(const DiffusionKernel& in_kernel, const QImage& in_averages, PaletteLookup& in_palette, const std::function<bool()>& in_rowDone);
+}
+
+namespace dithering
+{
+  one_bit::StitchChart dither(one_bit::DitherMode in_mode, const QImage& in_averages, PaletteLookup& in_palette, const std::function<bool()>& in_rowDone)
+  {
+    // without colors there is no error to spread, every stitch keeps index 0
+    if (in_palette.size() == 0 || in_mode == one_bit::DitherMode::NONE) return nearest(in_averages, in_palette, in_rowDone);
+    if (in_mode == one_bit::DitherMode::BAYER) return ordered(in_averages, in_palette, in_rowDone);
+    return diffused(diffusionKernel(in_mode), in_averages, in_palette, in_rowDone);
+  }
+}
+
+namespace
+{
+  DiffusionKernel diffusionKernel(one_bit::DitherMode in_mode)
+  {
+    if (in_mode == one_bit::DitherMode::ATKINSON)
+    {
+      return DiffusionKernel{ { { 1, 0, 1.f / 8 }, { 2, 0, 1.f / 8 }, { -1, 1, 1.f / 8 }, { 0, 1, 1.f / 8 }, { 1, 1, 1.f / 8 }, { 0, 2, 1.f / 8 } }, 4 };
+    }
+    return DiffusionKernel{ { { 1, 0, 7.f / 16 }, { -1, 1, 3.f / 16 }, { 0, 1, 5.f / 16 }, { 1, 1, 1.f / 16 } }, 3 };
+  }
+
+  QRgb clampedRgb(float in_red, float in_green, float in_blue)
+  {
+    auto channel = [](float value) { return std::clamp((int)std::lround(value), 0, 255); };
+    return qRgb(channel(in_red), channel(in_green), channel(in_blue));
+  }
+
+  one_bit::StitchChart nearest(const QImage& in_averages, PaletteLookup& in_palette, const std::function<bool()>& in_rowDone)
+  {
+    const unsigned width{ (unsigned)in_averages.width() };
+    const unsigned height{ (unsigned)in_averages.height() };
+    one_bit::StitchChart chart(width, height, (unsigned)in_palette.size());
+    const uchar* averageBits{ in_averages.constBits() };
+    const qsizetype averageStride{ in_averages.bytesPerLine() };
+    std::atomic<bool> aborted{ false };
+    // chart rows are word aligned, so bands can pack their rows without sharing any words
+    parallel::for_each_band(height, [&](unsigned in_begin, unsigned in_end) {
+      std::vector<int32_t> indices(width);
+      for (unsigned y = in_begin; y < in_end && !aborted; ++y)
+      {
+        in_palette.mapScanline((const QRgb*)(averageBits + y * averageStride), width, indices.data());
+        chart.setRow(y, indices.data());
+        if (!in_rowDone()) aborted = true;
+      }
+    });
+    return aborted ? one_bit::StitchChart{} : chart;
+  }
+
+  one_bit::StitchChart ordered(const QImage& in_averages, PaletteLookup& in_palette, const std::function<bool()>& in_rowDone)
+  {
+    static constexpr int bayer[8][8]{
+      {  0, 32,  8, 40,  2, 34, 10, 42 },
+      { 48, 16, 56, 24, 50, 18, 58, 26 },
+      { 12, 44,  4, 36, 14, 46,  6, 38 },
+      { 60, 28, 52, 20, 62, 30, 54, 22 },
+      {  3, 35, 11, 43,  1, 33,  9, 41 },
+      { 51, 19, 59, 27, 49, 17, 57, 25 },
+      { 15, 47,  7, 39, 13, 45,  5, 37 },
+      { 63, 31, 55, 23, 61, 29, 53, 21 },
+    };
+    const unsigned width{ (unsigned)in_averages.width() };
+    const unsigned height{ (unsigned)in_averages.height() };
+    one_bit::StitchChart chart(width, height, (unsigned)in_palette.size());
+    const uchar* averageBits{ in_averages.constBits() };
+    const qsizetype averageStride{ in_averages.bytesPerLine() };
+    // offsets span about one step between palette colors, so two colors can mix into any shade between them
+    const float spread{ 255.f / std::max(1, in_palette.size() - 1) };
+    std::atomic<bool> aborted{ false };
+    parallel::for_each_band(height, [&](unsigned in_begin, unsigned in_end) {
+      std::vector<int32_t> indices(width);
+      for (unsigned y = in_begin; y < in_end && !aborted; ++y)
+      {
+        const QRgb* line{ (const QRgb*)(averageBits + y * averageStride) };
+        for (unsigned x = 0; x < width; ++x)
+        {
+          const float offset{ ((bayer[y % 8][x % 8] + .5f) / 64.f - .5f) * spread };
+          indices[x] = in_palette.nearestIndex(clampedRgb(qRed(line[x]) + offset, qGreen(line[x]) + offset, qBlue(line[x]) + offset));
+        }
+        chart.setRow(y, indices.data());
+        if (!in_rowDone()) aborted = true;
+      }
+    });
+    return aborted ? one_bit::StitchChart{} : chart;
+  }
+
+  one_bit::StitchChart diffused(const DiffusionKernel& in_kernel, const QImage& in_averages, PaletteLookup& in_palette, const std::function<bool()>& in_rowDone)
+  {
+    const int width{ in_averages.width() };
+    const int height{ in_averages.height() };
+    one_bit::StitchChart chart(width, height, (unsigned)in_palette.size());
+    const uchar* averageBits{ in_averages.constBits() };
+    const qsizetype averageStride{ in_averages.bytesPerLine() };
+    // accumulated error per pixel and channel, and the number of finished columns per row
+    std::vector<float> errors(3 * (size_t)width * height, 0.f);
+    std::vector<std::atomic<int>> finishedColumns(height);
+    for (auto& columns : finishedColumns)
+    {
+      columns.store(0, std::memory_order_relaxed);
+    }
+    std::atomic<unsigned> nextRow{ 0 };
+    std::atomic<bool> aborted{ false };
+
+    // one band per worker, each keeps claiming the next unclaimed row. Every claimed row is being worked on,
+    // so waiting for the row above always ends.
+    parallel::for_each_band(parallel::worker_count(), [&](unsigned, unsigned) {
+      std::vector<int32_t> indices(width);
+      for (int y = (int)nextRow++; y < height && !aborted; y = (int)nextRow++)
+      {
+        const QRgb* line{ (const QRgb*)(averageBits + y * averageStride) };
+        for (int x = 0; x < width; ++x)
+        {
+          if (y > 0)
+          {
+            const int required{ std::min(width, x + in_kernel.lag) };
+            while (finishedColumns[y - 1].load(std::memory_order_acquire) < required)
+            {
+              if (aborted) return;
+              std::this_thread::yield();
+            }
+          }
+          float* error{ &errors[3 * ((size_t)y * width + x)] };
+          const float red{ std::clamp(qRed(line[x]) + error[0], 0.f, 255.f) };
+          const float green{ std::clamp(qGreen(line[x]) + error[1], 0.f, 255.f) };
+          const float blue{ std::clamp(qBlue(line[x]) + error[2], 0.f, 255.f) };
+          indices[x] = in_palette.nearestIndex(clampedRgb(red, green, blue));
+          const QRgb chosen{ in_palette.color(indices[x]) };
+          const float redError{ red - qRed(chosen) };
+          const float greenError{ green - qGreen(chosen) };
+          const float blueError{ blue - qBlue(chosen) };
+          for (const auto& tap : in_kernel.taps)
+          {
+            const int targetX{ x + tap.dx };
+            const int targetY{ y + tap.dy };
+            if (targetX < 0 || targetX >= width || targetY >= height) continue;
+            float* target{ &errors[3 * ((size_t)targetY * width + targetX)] };
+            target[0] += tap.weight * redError;
+            target[1] += tap.weight * greenError;
+            target[2] += tap.weight * blueError;
+          }
+          finishedColumns[y].store(x + 1, std::memory_order_release);
+        }
+        chart.setRow(y, indices.data());
+        if (!in_rowDone()) aborted = true;
+      }
+    });
+    return aborted ? one_bit::StitchChart{} : chart;
+  }
+}
\ No newline at end of file
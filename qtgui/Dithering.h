@@ -0,0 +1,17 @@
+#pragma once
+#include <QImage>
+#include <functional>
+#include "PaletteLookup.h"
+#include "StitchChart.h"
+#include "setting_enums.h"
+
+namespace dithering
+{
+  // maps every pixel of in_averages to a palette index of the resulting chart. NONE picks the closest entry,
+  // BAYER offsets each pixel by an 8x8 threshold matrix first, FLOYD_STEINBERG and ATKINSON pass the
+  // quantization error on to the neighbours not processed yet.
+  // Error diffusion runs as a wavefront: workers claim rows top to bottom and each row trails the one above by
+  // a few stitches, so every pixel sees exactly the error a serial scan would give it.
+  // in_rowDone gets called after each finished row, once it returns false the result is an empty chart.
+  one_bit::StitchChart dither(one_bit::DitherMode in_mode, const QImage& in_averages, PaletteLookup& in_palette, const std::function<bool()>& in_rowDone);
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+#include <QColor>
+#include <cmath>
+
+namespace color_space
+{
+  inline const double pi{ std::atan(1) * 4 };
+
+  // position of a color in the HSL cylinder: hue and saturation span the plane, lightness the height
+  struct HsvPoint
+  {
+    const double rc;
+    const double pl;
+    const double v;
+
+    static HsvPoint fromColor(const QColor& in_color)
+    {
+      int hue, sat, val;
+      in_color.getHsl(&hue, &sat, &val);
+      return HsvPoint(hue, sat, val);
+    }
+
+    // point at the given coordinates, e.g. the mean of several colors
+    static HsvPoint fromCoordinates(double in_rc, double in_pl, double in_v)
+    {
+      return HsvPoint(in_rc, in_pl, in_v);
+    }
+
+    HsvPoint(int hue, int sat, int val)
+      : rc{ 127. + std::cos(pi * hue / 180.) * sat / 2 }
+      , pl{ 127. + std::sin(pi * hue / 180.) * sat / 2 }
+      , v{ 1. * val }
+    {
+    }
+
+  private:
+    HsvPoint(double in_rc, double in_pl, double in_v)
+      : rc{ in_rc }
+      , pl{ in_pl }
+      , v{ in_v }
+    {
+    }
+  };
+
+  inline double distance(const HsvPoint& p1, const HsvPoint& p2)
+  {
+    return std::sqrt(std::pow(p1.rc - p2.rc, 2) + std::pow(p1.pl - p2.pl, 2) + std::pow(p1.v - p2.v, 2));
+  }
+}
\ No newline at end of file
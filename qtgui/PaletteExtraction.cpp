@@ -0,0 +1,301 @@
+#include "PaletteExtraction.h"
+#include "HslCylinder.h"
+#include "CylinderTree.h"
+#include "parallel.h"
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <atomic>
+#include <limits>
+
+namespace
+{
+  // pixels looked at per image, more hardly change the proposal but cost time on large sources.
+  // Also keeps the 32 bit channel sums of a bin from overflowing.
+  constexpr unsigned long long sampleBudget{ 1ull << 20 };
+  // histogram bins keep the upper 5 bits of each channel
+  constexpr unsigned binBits{ 5 };
+  constexpr unsigned binCount{ 1u << (3 * binBits) };
+  constexpr int refinementRounds{ 8 };
+
+  struct Bin
+  {
+    uint32_t count;
+    uint32_t red;
+    uint32_t green;
+    uint32_t blue;
+  };
+
+  // distinct colors of the histogram with the number of samples they stand for
+  struct Samples
+  {
+    std::vector<QRgb> colors;
+    std::vector<color_space::HsvPoint> points;
+    std::vector<double> weights;
+  };
+
+  // range [begin, end) of the sample order, split along the axis holding most of its squared error
+  struct Box
+  {
+    int begin;
+    int end;
+    double error;
+    unsigned char axis;
+  };
+
+  struct Cluster
+  {
+    double rc;
+    double pl;
+    double v;
+    double weight;
+  };
+
+  std::vector<Bin> histogram(const QImage& in_image, const QRect& in_region);
+  Samples samples(const std::vector<Bin>& in_bins);
+  double coordinate(const color_space::HsvPoint& in_point, unsigned char in_axis);
+  Box box(const Samples& in_samples, const std::vector<int>& in_order, int in_begin, int in_end);
+  Cluster mean(const Samples& in_samples, const std::vector<int>& in_order, int in_begin, int in_end);
+  std::vector<Cluster> medianCut(const Samples& in_samples, unsigned in_count);
+  std::vector<Cluster> refine(const Samples& in_samples, std::vector<Cluster> in_clusters);
+  std::vector<std::pair<QRgb, double>> representatives(const Samples& in_samples, const std::vector<Cluster>& in_clusters);
+}
+
+namespace palette_extraction
+{
+  std::vector<QRgb> propose_palette(const QImage& in_image, unsigned in_colorCount)
+  {
+    return propose_palette(in_image, in_image.rect(), in_colorCount);
+  }
+
+  std::vector<QRgb> propose_palette(const QImage& in_image, const QRect& in_region, unsigned in_colorCount)
+  {
+    const QRect region{ in_region.intersected(in_image.rect()) };
+    if (region.isEmpty() || in_colorCount == 0) return {};
+    const Samples distinct{ samples(histogram(in_image, region)) };
+    auto proposals{ representatives(distinct, refine(distinct, medianCut(distinct, in_colorCount))) };
+    std::stable_sort(proposals.begin(), proposals.end(), [](const auto& first, const auto& second) { return first.second > second.second; });
+
+    std::vector<QRgb> result;
+    for (const auto& [color, weight] : proposals)
+    {
+      if (weight > 0.) result.push_back(color);
+    }
+    return result;
+  }
+}
+
+namespace
+{
+  std::vector<Bin> histogram(const QImage& in_image, const QRect& in_region)
+  {
+    const int width{ in_region.width() };
+    const int height{ in_region.height() };
+    const double pixels{ 1. * width * height };
+    const int step{ std::max(1, (int)std::ceil(std::sqrt(pixels / sampleBudget))) };
+    const int sampledRows{ (height + step - 1) / step };
+    const bool directlyReadable{ in_image.format() == QImage::Format_RGB32 || in_image.format() == QImage::Format_ARGB32 };
+    // get the pointers up front, scanLine() on the shared image is not safe from worker threads
+    const uchar* imageBits{ in_image.constBits() };
+    const qsizetype imageStride{ in_image.bytesPerLine() };
+
+    std::vector<Bin> merged(binCount, Bin{ 0, 0, 0, 0 });
+    std::mutex mergeMutex;
+    // one histogram per worker rather than per band keeps the merging cheap
+    const unsigned workers{ parallel::worker_count() };
+    parallel::for_each_band(workers, [&](unsigned in_begin, unsigned in_end) {
+      std::vector<Bin> bins(binCount, Bin{ 0, 0, 0, 0 });
+      const int firstRow{ (int)(1ull * in_begin * sampledRows / workers) };
+      const int lastRow{ (int)(1ull * in_end * sampledRows / workers) };
+      for (int row = firstRow; row < lastRow; ++row)
+      {
+        const int y{ in_region.top() + row * step };
+        const QRgb* line{ (const QRgb*)(imageBits + y * imageStride) };
+        for (int x = in_region.left(); x < in_region.left() + width; x += step)
+        {
+          const QRgb pixel{ directlyReadable ? line[x] : in_image.pixel(x, y) };
+          const unsigned index{ ((unsigned)qRed(pixel) >> (8 - binBits) << (2 * binBits)) | ((unsigned)qGreen(pixel) >> (8 - binBits) << binBits) | ((unsigned)qBlue(pixel) >> (8 - binBits)) };
+          Bin& bin{ bins[index] };
+          ++bin.count;
+          bin.red += qRed(pixel);
+          bin.green += qGreen(pixel);
+          bin.blue += qBlue(pixel);
+        }
+      }
+      std::lock_guard<std::mutex> lock{ mergeMutex };
+      for (unsigned index = 0; index < binCount; ++index)
+      {
+        merged[index].count += bins[index].count;
+        merged[index].red += bins[index].red;
+        merged[index].green += bins[index].green;
+        merged[index].blue += bins[index].blue;
+      }
+    });
+    return merged;
+  }
+
+  Samples samples(const std::vector<Bin>& in_bins)
+  {
+    Samples result;
+    for (const auto& bin : in_bins)
+    {
+      if (bin.count == 0) continue;
+      // the bin's mean color rather than its center, so flat areas keep their exact color
+      const QRgb color{ qRgb((bin.red + bin.count / 2) / bin.count, (bin.green + bin.count / 2) / bin.count, (bin.blue + bin.count / 2) / bin.count) };
+      result.colors.push_back(color);
+      result.points.push_back(color_space::HsvPoint::fromColor(QColor(color)));
+      result.weights.push_back(bin.count);
+    }
+    return result;
+  }
+
+  double coordinate(const color_space::HsvPoint& in_point, unsigned char in_axis)
+  {
+    return (in_axis == 0) ? in_point.rc : (in_axis == 1) ? in_point.pl : in_point.v;
+  }
+
+  Box box(const Samples& in_samples, const std::vector<int>& in_order, int in_begin, int in_end)
+  {
+    const Cluster center{ mean(in_samples, in_order, in_begin, in_end) };
+    double errors[3]{ 0., 0., 0. };
+    for (int position = in_begin; position < in_end; ++position)
+    {
+      const auto& point{ in_samples.points[in_order[position]] };
+      const double weight{ in_samples.weights[in_order[position]] };
+      errors[0] += weight * std::pow(point.rc - center.rc, 2);
+      errors[1] += weight * std::pow(point.pl - center.pl, 2);
+      errors[2] += weight * std::pow(point.v - center.v, 2);
+    }
+    const unsigned char axis{ (unsigned char)(std::max_element(errors, errors + 3) - errors) };
+    return Box{ in_begin, in_end, errors[0] + errors[1] + errors[2], axis };
+  }
+
+  Cluster mean(const Samples& in_samples, const std::vector<int>& in_order, int in_begin, int in_end)
+  {
+    Cluster result{ 0., 0., 0., 0. };
+    for (int position = in_begin; position < in_end; ++position)
+    {
+      const auto& point{ in_samples.points[in_order[position]] };
+      const double weight{ in_samples.weights[in_order[position]] };
+      result.rc += weight * point.rc;
+      result.pl += weight * point.pl;
+      result.v += weight * point.v;
+      result.weight += weight;
+    }
+    if (result.weight > 0.)
+    {
+      result.rc /= result.weight;
+      result.pl /= result.weight;
+      result.v /= result.weight;
+    }
+    return result;
+  }
+
+  std::vector<Cluster> medianCut(const Samples& in_samples, unsigned in_count)
+  {
+    std::vector<int> order(in_samples.points.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::vector<Box> boxes;
+    if (!order.empty()) boxes.push_back(box(in_samples, order, 0, (int)order.size()));
+    while (boxes.size() < in_count)
+    {
+      // always split the box with the largest error, boxes of a single color have none
+      auto widest{ std::max_element(boxes.begin(), boxes.end(), [](const Box& first, const Box& second) { return first.error < second.error; }) };
+      if (widest == boxes.end() || widest->error <= 0.) break;
+      const Box split{ *widest };
+      std::sort(order.begin() + split.begin, order.begin() + split.end, [&](int first, int second) {
+        return coordinate(in_samples.points[first], split.axis) < coordinate(in_samples.points[second], split.axis);
+      });
+      // weighted median, both halves keep at least one sample
+      double total{ 0. };
+      for (int position = split.begin; position < split.end; ++position) total += in_samples.weights[order[position]];
+      double below{ 0. };
+      int median{ split.begin + 1 };
+      while (median < split.end - 1 && below + in_samples.weights[order[median - 1]] < total / 2)
+      {
+        below += in_samples.weights[order[median - 1]];
+        ++median;
+      }
+      *widest = box(in_samples, order, split.begin, median);
+      boxes.push_back(box(in_samples, order, median, split.end));
+    }
+
+    std::vector<Cluster> result;
+    for (const auto& cut : boxes)
+    {
+      result.push_back(mean(in_samples, order, cut.begin, cut.end));
+    }
+    return result;
+  }
+
+  std::vector<Cluster> refine(const Samples& in_samples, std::vector<Cluster> in_clusters)
+  {
+    const unsigned count{ (unsigned)in_samples.points.size() };
+    std::vector<int> assignments(count, -1);
+    for (int round = 0; round < refinementRounds && !in_clusters.empty(); ++round)
+    {
+      std::vector<color_space::HsvPoint> centers;
+      for (const auto& cluster : in_clusters)
+      {
+        centers.push_back(color_space::HsvPoint::fromCoordinates(cluster.rc, cluster.pl, cluster.v));
+      }
+      const color_space::CylinderTree tree{ centers };
+      std::atomic<bool> changed{ false };
+      parallel::for_each_band(count, [&](unsigned in_begin, unsigned in_end) {
+        for (unsigned sample = in_begin; sample < in_end; ++sample)
+        {
+          const int closest{ tree.nearest(in_samples.points[sample]) };
+          if (closest != assignments[sample]) changed = true;
+          assignments[sample] = closest;
+        }
+      });
+      if (!changed) break;
+
+      std::vector<Cluster> sums(in_clusters.size(), Cluster{ 0., 0., 0., 0. });
+      for (unsigned sample = 0; sample < count; ++sample)
+      {
+        const auto& point{ in_samples.points[sample] };
+        const double weight{ in_samples.weights[sample] };
+        Cluster& sum{ sums[assignments[sample]] };
+        sum.rc += weight * point.rc;
+        sum.pl += weight * point.pl;
+        sum.v += weight * point.v;
+        sum.weight += weight;
+      }
+      for (size_t index = 0; index < in_clusters.size(); ++index)
+      {
+        // a cluster that lost all its samples stays where it was
+        if (sums[index].weight <= 0.) continue;
+        in_clusters[index] = Cluster{ sums[index].rc / sums[index].weight, sums[index].pl / sums[index].weight, sums[index].v / sums[index].weight, sums[index].weight };
+      }
+    }
+    return in_clusters;
+  }
+
+  std::vector<std::pair<QRgb, double>> representatives(const Samples& in_samples, const std::vector<Cluster>& in_clusters)
+  {
+    std::vector<color_space::HsvPoint> centers;
+    for (const auto& cluster : in_clusters)
+    {
+      centers.push_back(color_space::HsvPoint::fromCoordinates(cluster.rc, cluster.pl, cluster.v));
+    }
+    const color_space::CylinderTree tree{ centers };
+    // the sample closest to the center stands for the cluster, so the proposal only holds colors of the image
+    std::vector<std::pair<QRgb, double>> result(in_clusters.size(), { 0u, 0. });
+    std::vector<double> closestDistances(in_clusters.size(), std::numeric_limits<double>::max());
+    for (size_t sample = 0; sample < in_samples.points.size(); ++sample)
+    {
+      const int cluster{ tree.nearest(in_samples.points[sample]) };
+      const double currDistance{ color_space::distance(in_samples.points[sample], centers[cluster]) };
+      if (currDistance < closestDistances[cluster])
+      {
+        closestDistances[cluster] = currDistance;
+        result[cluster].first = in_samples.colors[sample];
+      }
+      result[cluster].second += in_samples.weights[sample];
+    }
+    return result;
+  }
+}
\ No newline at end of file
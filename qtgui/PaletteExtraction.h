@@ -0,0 +1,15 @@
+#pragma once
+#include <QImage>
+#include <QRect>
+#include <vector>
+
+namespace palette_extraction
+{
+  // proposes up to in_colorCount colors for in_image, the most common ones first. Works on a histogram of an
+  // evenly spaced subsample of the image: median cut in the HSL cylinder picks the initial colors, a few
+  // k-means rounds with the distance of colorDistance() refine them. Every cluster is represented by the image
+  // color closest to its center. Images with fewer distinct colors than requested yield fewer proposals.
+  std::vector<QRgb> propose_palette(const QImage& in_image, unsigned in_colorCount);
+  // same for the pixels inside in_region only, sampled straight from in_image without copying them
+  std::vector<QRgb> propose_palette(const QImage& in_image, const QRect& in_region, unsigned in_colorCount);
+}
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include "PaletteLookup.h"
+#include <algorithm>
+
+PaletteLookup::PaletteLookup()
+  : paletteColors{}
+  , palettePoints{}
+  , cylinderPalette{}
+  , paletteTree{}
+  , cells{}
+{}
+
+PaletteLookup::PaletteLookup(const std::vector<QColor>& in_palette)
+  : paletteColors{}
+  , palettePoints{}
+  , cylinderPalette{}
+  , paletteTree{}
+  , cells{ std::make_unique<std::atomic<Cell*>[]>(cellsPerChannel * cellsPerChannel * cellsPerChannel) }
+{
+  for (unsigned cell = 0; cell < cellsPerChannel * cellsPerChannel * cellsPerChannel; ++cell)
+  {
+    cells[cell].store(nullptr, std::memory_order_relaxed);
+  }
+  paletteColors.reserve(in_palette.size());
+  palettePoints.reserve(in_palette.size());
+  for (const auto& color : in_palette)
+  {
+    paletteColors.push_back(color.rgb());
+    palettePoints.push_back(color_space::HsvPoint::fromColor(color));
+    cylinderPalette.rc.push_back((float)palettePoints.back().rc);
+    cylinderPalette.pl.push_back((float)palettePoints.back().pl);
+    cylinderPalette.v.push_back((float)palettePoints.back().v);
+  }
+  paletteTree = color_space::CylinderTree(palettePoints);
+}
+
+PaletteLookup& PaletteLookup::operator=(PaletteLookup&& in_other)
+{
+  std::swap(paletteColors, in_other.paletteColors);
+  std::swap(palettePoints, in_other.palettePoints);
+  std::swap(cylinderPalette, in_other.cylinderPalette);
+  std::swap(paletteTree, in_other.paletteTree);
+  std::swap(cells, in_other.cells);
+  return *this;
+}
+
+PaletteLookup::~PaletteLookup()
+{
+  if (!cells) return;
+  for (unsigned cell = 0; cell < cellsPerChannel * cellsPerChannel * cellsPerChannel; ++cell)
+  {
+    delete cells[cell].load(std::memory_order_relaxed);
+  }
+}
+
+int PaletteLookup::size() const
+{
+  return (int)paletteColors.size();
+}
+
+QRgb PaletteLookup::color(int in_index) const
+{
+  return paletteColors[in_index];
+}
+
+int PaletteLookup::nearestIndex(QRgb in_color)
+{
+  if (paletteColors.empty())
+  {
+    return NO_COLOR;
+  }
+  const unsigned red{ (unsigned)qRed(in_color) };
+  const unsigned green{ (unsigned)qGreen(in_color) };
+  const unsigned blue{ (unsigned)qBlue(in_color) };
+  const unsigned entryMask{ (1u << cellBits) - 1 };
+  const unsigned cellIndex{ ((red >> cellBits) * cellsPerChannel + (green >> cellBits)) * cellsPerChannel + (blue >> cellBits) };
+  const unsigned entryIndex{ (((red & entryMask) << cellBits) + (green & entryMask)) << cellBits | (blue & entryMask) };
+
+  Cell* cell{ cells[cellIndex].load(std::memory_order_acquire) };
+  if (!cell)
+  {
+    auto newCell{ std::make_unique<Cell>() };
+    for (auto& entry : newCell->entries)
+    {
+      entry.store(unresolved, std::memory_order_relaxed);
+    }
+    // another thread may have been faster, then its cell is used and ours discarded
+    if (cells[cellIndex].compare_exchange_strong(cell, newCell.get(), std::memory_order_acq_rel, std::memory_order_acquire))
+    {
+      cell = newCell.release();
+    }
+  }
+  auto& entry{ cell->entries[entryIndex] };
+  uint16_t index{ entry.load(std::memory_order_relaxed) };
+  if (index == unresolved)
+  {
+    index = (uint16_t)searchNearest(in_color);
+    entry.store(index, std::memory_order_relaxed);
+  }
+  return index;
+}
+
+void PaletteLookup::mapScanline(const QRgb* in_line, int in_count, int32_t* out_indices)
+{
+  mapScanline(scanline_kernels::best_instruction_set(), in_line, in_count, out_indices);
+}
+
+void PaletteLookup::mapScanline(scanline_kernels::InstructionSet in_set, const QRgb* in_line, int in_count, int32_t* out_indices)
+{
+  if (paletteColors.empty())
+  {
+    std::fill(out_indices, out_indices + in_count, NO_COLOR);
+    return;
+  }
+  if (size() > kernelPaletteLimit)
+  {
+    for (int x = 0; x < in_count; ++x)
+    {
+      out_indices[x] = nearestIndex(in_line[x]);
+    }
+    return;
+  }
+  std::vector<float> margins(in_count);
+  scanline_kernels::nearest_entries(in_set, cylinderPalette, in_line, in_count, out_indices, margins.data());
+  for (int x = 0; x < in_count; ++x)
+  {
+    if (margins[x] < 2 * scanline_kernels::conversionTolerance)
+    {
+      out_indices[x] = nearestIndex(in_line[x]);
+    }
+  }
+}
+
+int PaletteLookup::searchNearest(QRgb in_color) const
+{
+  // same metric and tie breaking as a linear scan with colorDistance: the first closest entry wins
+  return paletteTree.nearest(color_space::HsvPoint::fromColor(QColor(in_color)));
+}
\ No newline at end of file
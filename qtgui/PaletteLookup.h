@@ -0,0 +1,60 @@
+#pragma once
+#include <QColor>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include "HslCylinder.h"
+#include "CylinderTree.h"
+#include "ScanlineKernels.h"
+
+// Maps colors to the closest entry of a stitch color palette.
+// The palette's cylinder coordinates are computed once, results are memoized in a
+// 16x16x16 grid of RGB cells that get filled on first use, so every stitch color
+// is computed exactly once per palette. Lookups may run concurrently from several threads.
+// Whole scanlines go through the vectorized kernels first, only close calls fall back
+// to the exact double precision search. That search runs on a k-d tree, and large palettes
+// skip the kernels, whose cost grows with the palette size, and go through the memo directly.
+class PaletteLookup
+{
+public:
+  static constexpr int NO_COLOR = -1;
+  // the memo stores 16 bit indices with one value reserved
+  static constexpr int MAX_SIZE = 0xffff;
+
+  PaletteLookup();
+  explicit PaletteLookup(const std::vector<QColor>& in_palette);
+  PaletteLookup(PaletteLookup&& in_other) = default;
+  PaletteLookup& operator=(PaletteLookup&& in_other);
+  ~PaletteLookup();
+
+  int size() const;
+  QRgb color(int in_index) const;
+  // palette index closest to in_color, NO_COLOR for an empty palette. Alpha is ignored.
+  int nearestIndex(QRgb in_color);
+  // palette indices for in_count pixels, same results as nearestIndex for each of them
+  void mapScanline(const QRgb* in_line, int in_count, int32_t* out_indices);
+  void mapScanline(scanline_kernels::InstructionSet in_set, const QRgb* in_line, int in_count, int32_t* out_indices);
+
+private:
+  int searchNearest(QRgb in_color) const;
+
+  static constexpr unsigned cellBits{ 4 };
+  static constexpr unsigned cellsPerChannel{ 1u << (8 - cellBits) };
+  static constexpr unsigned entriesPerCell{ 1u << (3 * cellBits) };
+  static constexpr uint16_t unresolved{ 0xffff };
+  static constexpr int kernelPaletteLimit{ 16 };
+
+  struct Cell
+  {
+    std::atomic<uint16_t> entries[entriesPerCell];
+  };
+
+  std::vector<QRgb> paletteColors;
+  std::vector<color_space::HsvPoint> palettePoints;
+  scanline_kernels::CylinderPalette cylinderPalette;
+  color_space::CylinderTree paletteTree;
+  // cells get installed once by whichever thread needs them first, entries are plain relaxed atomics
+  // since every thread resolving an entry writes the same value
+  std::unique_ptr<std::atomic<Cell*>[]> cells;
+};
\ No newline at end of file
@@ -0,0 +1,505 @@
+// End-to-end regression harness: runs the headless pipeline (decode, crop, pixelate, export) over generated images
+// and compares each result with its golden checksum and its timings with a stored baseline report.
+// Timings are only compared with a baseline recorded on the same host, worker count and build type, otherwise they are reported.
+// It is configured through environment variables:
+//   STIXELATOR_REGRESSION_RECORD=1        rewrites the golden checksums and the baseline from this run
+//   STIXELATOR_REGRESSION_BASELINE=<path> baseline report to compare with, regression/baseline.json by default
+//   STIXELATOR_REGRESSION_REPORT=<path>   where to write this run's report, pipeline_regression.json by default
+//   STIXELATOR_REGRESSION_THRESHOLD=<%>   allowed slowdown and memory growth over the baseline, 15 by default
+//   STIXELATOR_REGRESSION_REPETITIONS=<n> runs per case, the fastest one counts, 3 by default
+#include <doctest.h>
+#include "QtPixelator.h"
+#include "cropping.h"
+#include "error_codes.h"
+#include "parallel.h"
+#include <QBuffer>
+#include <QByteArray>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QDir>
+#include <QFileInfo>
+#include <QStringList>
+#include <QSysInfo>
+#include <QUrl>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifdef Q_OS_WIN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#ifndef STIXELATOR_REGRESSION_DIR
+#define STIXELATOR_REGRESSION_DIR "regression"
+#endif
+
+namespace
+{
+  enum class Pattern
+  {
+    GRADIENT,
+    CHECKER,
+    NOISE,
+    PORTRAIT,
+  };
+
+  // one pipeline run: a generated source image, the result size and gauge in cm and stitches, and the palette settings
+  struct RegressionCase
+  {
+    const char* name;
+    Pattern pattern;
+    int imageWidth;
+    int imageHeight;
+    int width;
+    int height;
+    int rowsPerGauge;
+    int stitchesPerGauge;
+    unsigned colorCount;
+    one_bit::DitherMode ditherMode;
+    bool gridEnabled;
+    one_bit::CropRegion anchor;
+  };
+
+  struct Measurement
+  {
+    std::string name;
+    std::string checksum;
+    std::string golden;
+    unsigned long long stitches;
+    double wallMilliseconds;
+    double stitchesPerSecond;
+    long long peakRssKilobytes;
+  };
+
+  // a report read back, its timings are only comparable with runs of the same configuration
+  struct Report
+  {
+    std::string configuration;
+    std::vector<Measurement> measurements;
+  };
+
+  const std::vector<RegressionCase>& regression_cases();
+  QImage generate(Pattern in_pattern, int in_width, int in_height);
+  std::vector<QColor> palette(unsigned in_colorCount);
+  std::string checksum(const QImage& in_image, const one_bit::StitchChart& in_chart);
+  // runs in_case in_repetitions times with a fresh pixelator each, so no cached stage skews the timings
+  Measurement measure(const RegressionCase& in_case, unsigned in_repetitions, const QString& in_outputDir);
+  void reset_peak_rss();
+  long long peak_rss_kilobytes();
+
+  std::string setting(const char* in_name, const std::string& in_default);
+  std::map<std::string, std::string> read_golden(const QString& in_path);
+  bool write_golden(const QString& in_path, const std::vector<Measurement>& in_measurements);
+  std::string report_line(const Measurement& in_measurement);
+  // host, worker count and build type of this run, everything timings depend on besides the code
+  std::string configuration();
+  std::string report(const std::vector<Measurement>& in_measurements, unsigned in_repetitions);
+  Report read_report(const QString& in_path);
+  std::optional<std::string> json_string(const std::string& in_line, const std::string& in_field);
+  std::optional<double> json_number(const std::string& in_line, const std::string& in_field);
+}
+
+TEST_CASE("test regression reports read back")
+{
+  const Measurement written{ "gradient-2", "00ff00ff00ff00ff", "match", 2640, 12.5, 211200., 40960 };
+  std::istringstream lines{ report({ written, written }, 3) };
+  std::vector<Measurement> parsed;
+  for (std::string line; std::getline(lines, line); )
+  {
+    const auto name{ json_string(line, "case") };
+    if (!name) continue;
+    parsed.push_back(Measurement{ *name, *json_string(line, "checksum"), *json_string(line, "golden"),
+      (unsigned long long)*json_number(line, "stitches"), *json_number(line, "wall_ms"), *json_number(line, "stitches_per_second"),
+      (long long)*json_number(line, "peak_rss_kb") });
+  }
+  REQUIRE_EQ(parsed.size(), 2u);
+  CHECK_EQ(parsed[1].name, written.name);
+  CHECK_EQ(parsed[1].checksum, written.checksum);
+  CHECK_EQ(parsed[1].stitches, written.stitches);
+  CHECK_EQ(parsed[1].wallMilliseconds, doctest::Approx(written.wallMilliseconds));
+  CHECK_EQ(parsed[1].stitchesPerSecond, doctest::Approx(written.stitchesPerSecond));
+  CHECK_EQ(parsed[1].peakRssKilobytes, written.peakRssKilobytes);
+  CHECK_FALSE(json_number(report_line(written), "missing"));
+  CHECK_EQ(json_string(report({ written }, 3), "configuration"), configuration());
+}
+
+TEST_CASE("test regression checksums only depend on the pixels and indices")
+{
+  QImage image(5, 3, QImage::Format_RGB32);
+  image.fill(QColorConstants::Svg::navy);
+  one_bit::StitchChart chart(5, 3, 2);
+  const std::string reference{ checksum(image, chart) };
+  CHECK_EQ(reference.size(), 16u);
+  // a deep copy has a different stride and cache key, but the same contents
+  CHECK_EQ(checksum(image.copy(), chart), reference);
+  chart.setIndex(4, 2, 1);
+  CHECK_NE(checksum(image, chart), reference);
+  image.setPixel(0, 0, qRgb(0, 0, 0));
+  CHECK_NE(checksum(image, one_bit::StitchChart(5, 3, 2)), reference);
+}
+
+TEST_CASE("test pipeline regression against golden checksums and baseline")
+{
+  const QString directory{ QStringLiteral(STIXELATOR_REGRESSION_DIR) };
+  const bool recording{ setting("STIXELATOR_REGRESSION_RECORD", "0") != "0" };
+  const unsigned repetitions{ (unsigned)std::max(1, std::stoi(setting("STIXELATOR_REGRESSION_REPETITIONS", "3"))) };
+  const double threshold{ std::stod(setting("STIXELATOR_REGRESSION_THRESHOLD", "15")) / 100. };
+  const QString reportPath{ QString::fromStdString(setting("STIXELATOR_REGRESSION_REPORT", "pipeline_regression.json")) };
+  const QString baselinePath{ QString::fromStdString(setting("STIXELATOR_REGRESSION_BASELINE", (directory + "/baseline.json").toStdString())) };
+  const QString goldenPath{ directory + "/golden_checksums.txt" };
+
+  // read the baseline before anything gets written, the report may replace it
+  const Report baseline{ recording ? Report{} : read_report(baselinePath) };
+  const auto golden{ read_golden(goldenPath) };
+  QTemporaryDir outputDir;
+  REQUIRE(outputDir.isValid());
+
+  std::vector<Measurement> measurements;
+  for (const auto& regressionCase : regression_cases())
+  {
+    Measurement measurement{ measure(regressionCase, repetitions, outputDir.path()) };
+    const auto expected{ golden.find(measurement.name) };
+    measurement.golden = (expected == golden.end()) ? "missing" : (expected->second == measurement.checksum ? "match" : "mismatch");
+    MESSAGE(measurement.name << ": " << measurement.wallMilliseconds << " ms, " << measurement.stitchesPerSecond << " st/s, " << measurement.peakRssKilobytes << " kB");
+    measurements.push_back(measurement);
+  }
+
+  const std::string written{ report(measurements, repetitions) };
+  QFile reportFile{ reportPath };
+  REQUIRE(reportFile.open(QIODevice::WriteOnly | QIODevice::Truncate));
+  REQUIRE_EQ(reportFile.write(written.data(), (qint64)written.size()), (qint64)written.size());
+  reportFile.close();
+
+  if (recording)
+  {
+    CHECK(write_golden(goldenPath, measurements));
+    QFile::remove(baselinePath);
+    CHECK(QFile::copy(reportPath, baselinePath));
+    MESSAGE("recorded golden checksums to " << goldenPath.toStdString() << " and the baseline to " << baselinePath.toStdString());
+    return;
+  }
+
+  for (const auto& measurement : measurements)
+  {
+    const std::string caseName{ measurement.name };
+    CAPTURE(caseName);
+    if (measurement.golden == "missing")
+    {
+      FAIL_CHECK("no golden checksum for " << caseName << ", record one with STIXELATOR_REGRESSION_RECORD=1");
+      continue;
+    }
+    CHECK_EQ(measurement.checksum, golden.at(caseName));
+  }
+
+  if (baseline.measurements.empty())
+  {
+    MESSAGE("no baseline at " << baselinePath.toStdString() << ", timings are only reported");
+    return;
+  }
+  if (baseline.configuration != configuration())
+  {
+    MESSAGE("the baseline comes from " << baseline.configuration << ", not " << configuration() << ", timings are only reported");
+    return;
+  }
+  for (const auto& measurement : measurements)
+  {
+    const auto reference{ std::find_if(baseline.measurements.begin(), baseline.measurements.end(), [&](const Measurement& in_entry) { return in_entry.name == measurement.name; }) };
+    if (reference == baseline.measurements.end()) continue;
+    const std::string caseName{ measurement.name };
+    CAPTURE(caseName);
+    CHECK_LE(measurement.wallMilliseconds, reference->wallMilliseconds * (1. + threshold));
+    CHECK_GE(measurement.stitchesPerSecond, reference->stitchesPerSecond / (1. + threshold));
+    // peak memory is only comparable if the platform could reset it between cases
+    if (measurement.peakRssKilobytes > 0 && reference->peakRssKilobytes > 0)
+    {
+      CHECK_LE(measurement.peakRssKilobytes, (long long)(reference->peakRssKilobytes * (1. + threshold)));
+    }
+  }
+}
+
+namespace
+{
+  const std::vector<RegressionCase>& regression_cases()
+  {
+    using one_bit::DitherMode;
+    using one_bit::CropRegion;
+    // co-prime and equal gauges, all dither modes, palettes from two up to 256 colors
+    static const std::vector<RegressionCase> cases{
+      { "gradient-2-none", Pattern::GRADIENT, 640, 480, 20, 20, 30, 22, 2, DitherMode::NONE, false, CropRegion::TOP_LEFT },
+      { "checker-4-floyd-steinberg", Pattern::CHECKER, 800, 600, 30, 20, 24, 18, 4, DitherMode::FLOYD_STEINBERG, false, CropRegion::CENTER },
+      { "noise-16-atkinson", Pattern::NOISE, 1024, 768, 40, 30, 32, 24, 16, DitherMode::ATKINSON, false, CropRegion::TOP_LEFT },
+      { "portrait-8-bayer-grid", Pattern::PORTRAIT, 600, 900, 25, 40, 26, 20, 8, DitherMode::BAYER, true, CropRegion::TOP },
+      { "gradient-64-floyd-steinberg-grid", Pattern::GRADIENT, 1200, 400, 30, 30, 21, 20, 64, DitherMode::FLOYD_STEINBERG, true, CropRegion::CENTER },
+      { "noise-256-none-large", Pattern::NOISE, 2000, 1500, 60, 45, 40, 40, 256, DitherMode::NONE, false, CropRegion::BOTTOM_RIGHT },
+    };
+    return cases;
+  }
+
+  QImage generate(Pattern in_pattern, int in_width, int in_height)
+  {
+    QImage result(in_width, in_height, QImage::Format_RGB32);
+    // a fixed linear congruential generator, so the noise is the same on every platform
+    uint32_t state{ 12345u };
+    for (int y = 0; y < in_height; ++y)
+    {
+      QRgb* line{ (QRgb*)result.scanLine(y) };
+      for (int x = 0; x < in_width; ++x)
+      {
+        switch (in_pattern)
+        {
+        case Pattern::GRADIENT:
+          line[x] = qRgb(x * 255 / in_width, y * 255 / in_height, (x + y) * 255 / (in_width + in_height));
+          break;
+        case Pattern::CHECKER:
+          line[x] = ((x / 37 + y / 29) % 2) ? qRgb(230, 40, 60) : qRgb(20, 60, (x * 255) / in_width);
+          break;
+        case Pattern::NOISE:
+          state = state * 1664525u + 1013904223u;
+          line[x] = qRgb((state >> 24) & 0xff, (state >> 16) & 0xff, (state >> 8) & 0xff);
+          break;
+        case Pattern::PORTRAIT:
+        {
+          // a bright disc on a darker vertical gradient, roughly what a photo of a face looks like
+          const int dx{ x - in_width / 2 };
+          const int dy{ y - in_height / 3 };
+          const bool inside{ 9 * dx * dx + 4 * dy * dy < in_width * in_width };
+          line[x] = inside ? qRgb(225, 180 - dy / 8, 150) : qRgb(40, 50 + y * 100 / in_height, 90);
+          break;
+        }
+        }
+      }
+    }
+    return result;
+  }
+
+  std::vector<QColor> palette(unsigned in_colorCount)
+  {
+    // the blue channel alone keeps up to 256 colors distinct
+    std::vector<QColor> result;
+    for (unsigned color = 0; color < in_colorCount; ++color)
+    {
+      result.push_back(QColor(qRgb((color * 37) % 256, (color * 91) % 256, (color * 255) / std::max(1u, in_colorCount - 1))));
+    }
+    return result;
+  }
+
+  std::string checksum(const QImage& in_image, const one_bit::StitchChart& in_chart)
+  {
+    // FNV-1a over the visible pixels and the unpacked indices, so neither padding nor packing changes it
+    uint64_t hash{ 14695981039346656037ull };
+    auto add = [&hash](const void* in_bytes, size_t in_count) {
+      const unsigned char* bytes{ (const unsigned char*)in_bytes };
+      for (size_t byte = 0; byte < in_count; ++byte)
+      {
+        hash = (hash ^ bytes[byte]) * 1099511628211ull;
+      }
+    };
+    const QImage pixels{ in_image.convertToFormat(QImage::Format_RGB32) };
+    const int size[2]{ pixels.width(), pixels.height() };
+    add(size, sizeof(size));
+    for (int y = 0; y < pixels.height(); ++y)
+    {
+      add(pixels.constScanLine(y), (size_t)pixels.width() * sizeof(QRgb));
+    }
+    std::vector<int32_t> indices(in_chart.stitchCount());
+    for (unsigned row = 0; row < in_chart.rowCount(); ++row)
+    {
+      in_chart.unpackRow(row, indices.data());
+      add(indices.data(), indices.size() * sizeof(int32_t));
+    }
+    std::ostringstream formatted;
+    formatted << std::hex;
+    formatted.width(16);
+    formatted.fill('0');
+    formatted << hash;
+    return formatted.str();
+  }
+
+  Measurement measure(const RegressionCase& in_case, unsigned in_repetitions, const QString& in_outputDir)
+  {
+    // the corpus is encoded once, decoding it is part of every run like in batch mode
+    QByteArray encoded;
+    QBuffer buffer{ &encoded };
+    buffer.open(QIODevice::WriteOnly);
+    REQUIRE(generate(in_case.pattern, in_case.imageWidth, in_case.imageHeight).save(&buffer, "PNG"));
+    const QString outputPath{ in_outputDir + "/" + in_case.name + ".png" };
+
+    reset_peak_rss();
+    Measurement result{ in_case.name, "", "", 0, std::numeric_limits<double>::max(), 0., 0 };
+    for (unsigned repetition = 0; repetition < in_repetitions; ++repetition)
+    {
+      const auto begin{ std::chrono::steady_clock::now() };
+      const QImage image{ QImage::fromData(encoded, "PNG") };
+      REQUIRE_FALSE(image.isNull());
+      QtPixelator pixelator;
+      REQUIRE_EQ(pixelator.setStitchSizes(in_case.width, in_case.height, in_case.rowsPerGauge, in_case.stitchesPerGauge), errors::NONE);
+      REQUIRE_EQ(pixelator.setStitchColors(palette(in_case.colorCount)), errors::NONE);
+      REQUIRE_EQ(pixelator.setDitherMode((int)in_case.ditherMode), errors::NONE);
+      REQUIRE_EQ(pixelator.setHelperSettings(in_case.gridEnabled, QColorConstants::Svg::red, QColorConstants::Svg::darkgray, 10), errors::NONE);
+      const auto region{ cropping::crop_to_aspect_ratio(image.width(), image.height(), 1. * in_case.height / in_case.width, in_case.anchor) };
+      REQUIRE_EQ(pixelator.setInputRegion(image, QRect(region.x, region.y, region.width, region.height)), errors::NONE);
+      REQUIRE_EQ(pixelator.setStoragePath(QUrl::fromLocalFile(outputPath)), errors::NONE);
+      REQUIRE_EQ(pixelator.runSynchronously(), errors::NONE);
+      REQUIRE_EQ(pixelator.commit(), errors::NONE);
+      const std::chrono::duration<double, std::milli> elapsed{ std::chrono::steady_clock::now() - begin };
+
+      const one_bit::StitchChart chart{ pixelator.stitchChart() };
+      const std::string sum{ checksum(pixelator.resultImage(), chart) };
+      // every repetition has to come up with the same result
+      if (repetition > 0) CHECK_EQ(sum, result.checksum);
+      result.checksum = sum;
+      result.stitches = (unsigned long long)chart.stitchCount() * chart.rowCount();
+      result.wallMilliseconds = std::min(result.wallMilliseconds, elapsed.count());
+    }
+    result.stitchesPerSecond = result.stitches / (result.wallMilliseconds / 1000.);
+    result.peakRssKilobytes = peak_rss_kilobytes();
+    return result;
+  }
+
+  void reset_peak_rss()
+  {
+#ifdef Q_OS_LINUX
+    // since Linux 4.0, writing 5 resets the peak resident set size of the process to its current size
+    QFile clearRefs{ "/proc/self/clear_refs" };
+    if (clearRefs.open(QIODevice::WriteOnly)) clearRefs.write("5");
+#endif
+  }
+
+  long long peak_rss_kilobytes()
+  {
+#ifdef Q_OS_WIN
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return (long long)(counters.PeakWorkingSetSize / 1024);
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef Q_OS_MACOS
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+  }
+
+  std::string setting(const char* in_name, const std::string& in_default)
+  {
+    return qEnvironmentVariableIsSet(in_name) ? qEnvironmentVariable(in_name).toStdString() : in_default;
+  }
+
+  std::map<std::string, std::string> read_golden(const QString& in_path)
+  {
+    // one "<case> <checksum>" pair per line, lines starting with # are comments
+    std::map<std::string, std::string> result;
+    QFile file{ in_path };
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) return result;
+    QTextStream stream{ &file };
+    while (!stream.atEnd())
+    {
+      const QString line{ stream.readLine().trimmed() };
+      if (line.isEmpty() || line.startsWith('#')) continue;
+      const QStringList fields{ line.split(' ', Qt::SkipEmptyParts) };
+      if (fields.size() == 2) result[fields[0].toStdString()] = fields[1].toStdString();
+    }
+    return result;
+  }
+
+  bool write_golden(const QString& in_path, const std::vector<Measurement>& in_measurements)
+  {
+    QDir{}.mkpath(QFileInfo{ in_path }.absolutePath());
+    QFile file{ in_path };
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) return false;
+    QTextStream stream{ &file };
+    stream << "# golden checksums of the pipeline regression cases, rewritten by test_pipeline_regression with STIXELATOR_REGRESSION_RECORD=1\n";
+    for (const auto& measurement : in_measurements)
+    {
+      stream << QString::fromStdString(measurement.name) << ' ' << QString::fromStdString(measurement.checksum) << '\n';
+    }
+    return stream.status() == QTextStream::Ok;
+  }
+
+  std::string report_line(const Measurement& in_measurement)
+  {
+    std::ostringstream line;
+    line.precision(std::numeric_limits<double>::max_digits10);
+    line << "{ \"case\": \"" << in_measurement.name << "\", \"checksum\": \"" << in_measurement.checksum << "\", \"golden\": \"" << in_measurement.golden
+      << "\", \"stitches\": " << in_measurement.stitches << ", \"wall_ms\": " << in_measurement.wallMilliseconds
+      << ", \"stitches_per_second\": " << in_measurement.stitchesPerSecond << ", \"peak_rss_kb\": " << in_measurement.peakRssKilobytes << " }";
+    return line.str();
+  }
+
+  std::string configuration()
+  {
+#ifdef NDEBUG
+    const char* build{ "release" };
+#else
+    const char* build{ "debug" };
+#endif
+    return QSysInfo::machineHostName().toStdString() + ", " + std::to_string(parallel::worker_count()) + " workers, " + build;
+  }
+
+  std::string report(const std::vector<Measurement>& in_measurements, unsigned in_repetitions)
+  {
+    // one case per line, which is all read_report needs to parse it again
+    std::ostringstream result;
+    result << "{\n  \"configuration\": \"" << configuration() << "\",\n  \"workers\": " << parallel::worker_count()
+      << ",\n  \"repetitions\": " << in_repetitions << ",\n  \"cases\": [\n";
+    for (size_t measurement = 0; measurement < in_measurements.size(); ++measurement)
+    {
+      result << "    " << report_line(in_measurements[measurement]) << (measurement + 1 < in_measurements.size() ? ",\n" : "\n");
+    }
+    result << "  ]\n}\n";
+    return result.str();
+  }
+
+  Report read_report(const QString& in_path)
+  {
+    Report result;
+    QFile file{ in_path };
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) return result;
+    while (!file.atEnd())
+    {
+      const std::string line{ file.readLine().toStdString() };
+      const auto tag{ json_string(line, "configuration") };
+      if (tag) result.configuration = *tag;
+      const auto name{ json_string(line, "case") };
+      const auto wall{ json_number(line, "wall_ms") };
+      const auto rate{ json_number(line, "stitches_per_second") };
+      if (!name || !wall || !rate) continue;
+      result.measurements.push_back(Measurement{ *name, json_string(line, "checksum").value_or(""), json_string(line, "golden").value_or(""),
+        (unsigned long long)json_number(line, "stitches").value_or(0.), *wall, *rate, (long long)json_number(line, "peak_rss_kb").value_or(0.) });
+    }
+    return result;
+  }
+
+  std::optional<std::string> json_string(const std::string& in_line, const std::string& in_field)
+  {
+    const std::string key{ "\"" + in_field + "\": \"" };
+    const size_t begin{ in_line.find(key) };
+    if (begin == std::string::npos) return std::nullopt;
+    const size_t end{ in_line.find('"', begin + key.size()) };
+    if (end == std::string::npos) return std::nullopt;
+    return in_line.substr(begin + key.size(), end - begin - key.size());
+  }
+
+  std::optional<double> json_number(const std::string& in_line, const std::string& in_field)
+  {
+    const std::string key{ "\"" + in_field + "\": " };
+    const size_t begin{ in_line.find(key) };
+    if (begin == std::string::npos) return std::nullopt;
+    std::istringstream value{ in_line.substr(begin + key.size()) };
+    double result{ 0. };
+    if (!(value >> result)) return std::nullopt;
+    return result;
+  }
+}
\ No newline at end of file
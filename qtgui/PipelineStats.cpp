@@ -0,0 +1,140 @@
+#include "PipelineStats.h"
+#include <algorithm>
+#include <numeric>
+
+namespace
+{
+  const char* stageName(PipelineSample::Stage in_stage);
+  double millisecondsSince(std::chrono::steady_clock::time_point in_begin);
+}
+
+void PipelineSample::record(Stage in_stage, std::chrono::steady_clock::time_point in_begin, qint64 in_bytes)
+{
+  milliseconds[in_stage] = millisecondsSince(in_begin);
+  bytes[in_stage] = in_bytes;
+}
+
+PipelineStats::PipelineStats(QObject* in_parent)
+: QObject(in_parent)
+, lastMilliseconds{}
+, peakBytes{}
+, throughput{ 0. }
+, hits{ 0 }
+, misses{ 0 }
+, triggered{ 0 }
+, coalesced{ 0 }
+{}
+
+void PipelineStats::reset()
+{
+  lastMilliseconds.fill(0.);
+  peakBytes.fill(0);
+  throughput = 0.;
+  hits = 0;
+  misses = 0;
+  triggered = 0;
+  coalesced = 0;
+  changed();
+}
+
+void PipelineStats::runTriggered()
+{
+  ++triggered;
+  changed();
+}
+
+void PipelineStats::runCoalesced()
+{
+  ++coalesced;
+  changed();
+}
+
+void PipelineStats::runFinished(const PipelineSample& in_sample)
+{
+  // settings checks and commits happen outside of jobs, they keep their own last values
+  for (int stage = PipelineSample::DOWNSAMPLE; stage <= PipelineSample::DRAW_HELPERS; ++stage)
+  {
+    lastMilliseconds[stage] = in_sample.milliseconds[stage];
+    peakBytes[stage] = std::max(peakBytes[stage], in_sample.bytes[stage]);
+  }
+  const double total{ std::accumulate(in_sample.milliseconds.begin() + PipelineSample::DOWNSAMPLE, in_sample.milliseconds.begin() + PipelineSample::COMMIT, 0.) };
+  // a run served from the caches completely has no meaningful rate, the last one stays
+  if (total > 0.) throughput = 1000. * in_sample.stitches / total;
+  hits += (int)in_sample.cacheHits;
+  misses += (int)in_sample.cacheMisses;
+  changed();
+}
+
+void PipelineStats::stageFinished(PipelineSample::Stage in_stage, std::chrono::steady_clock::time_point in_begin, qint64 in_bytes)
+{
+  lastMilliseconds[in_stage] = millisecondsSince(in_begin);
+  peakBytes[in_stage] = std::max(peakBytes[in_stage], in_bytes);
+  changed();
+}
+
+QVariantMap PipelineStats::stageMilliseconds() const
+{
+  QVariantMap result;
+  for (int stage = 0; stage < PipelineSample::STAGE_COUNT; ++stage)
+  {
+    result.insert(stageName((PipelineSample::Stage)stage), lastMilliseconds[stage]);
+  }
+  return result;
+}
+
+QVariantMap PipelineStats::peakStageBytes() const
+{
+  QVariantMap result;
+  for (int stage = 0; stage < PipelineSample::STAGE_COUNT; ++stage)
+  {
+    result.insert(stageName((PipelineSample::Stage)stage), peakBytes[stage]);
+  }
+  return result;
+}
+
+double PipelineStats::stitchesPerSecond() const
+{
+  return throughput;
+}
+
+int PipelineStats::cacheHits() const
+{
+  return hits;
+}
+
+int PipelineStats::cacheMisses() const
+{
+  return misses;
+}
+
+int PipelineStats::runsTriggered() const
+{
+  return triggered;
+}
+
+int PipelineStats::runsCoalesced() const
+{
+  return coalesced;
+}
+
+namespace
+{
+  const char* stageName(PipelineSample::Stage in_stage)
+  {
+    switch (in_stage)
+    {
+    case PipelineSample::CHECK_SETTINGS: return "checkSettings";
+    case PipelineSample::DOWNSAMPLE: return "downsample";
+    case PipelineSample::PIXELATE: return "pixelate";
+    case PipelineSample::SCALE_PIXELS: return "scalePixels";
+    case PipelineSample::DRAW_HELPERS: return "drawHelpers";
+    case PipelineSample::COMMIT: return "commit";
+    default: return "";
+    }
+  }
+
+  double millisecondsSince(std::chrono::steady_clock::time_point in_begin)
+  {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - in_begin).count();
+  }
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+#include <QObject>
+#include <QVariantMap>
+#include <array>
+#include <chrono>
+
+// measurements of one pipeline run, collected by whichever thread runs it and handed over once it's done
+struct PipelineSample
+{
+  enum Stage
+  {
+    CHECK_SETTINGS = 0,
+    DOWNSAMPLE,
+    PIXELATE,
+    SCALE_PIXELS,
+    DRAW_HELPERS,
+    COMMIT,
+    STAGE_COUNT,
+  };
+
+  // a stage that got skipped keeps 0, e.g. because its result was cached
+  void record(Stage in_stage, std::chrono::steady_clock::time_point in_begin, qint64 in_bytes);
+
+  std::array<double, STAGE_COUNT> milliseconds{};
+  std::array<qint64, STAGE_COUNT> bytes{};
+  unsigned cacheHits{ 0 };
+  unsigned cacheMisses{ 0 };
+  unsigned stitches{ 0 };
+};
+
+// Live numbers about the pixelation pipeline for an in-app panel. Updates happen on the GUI thread, once per
+// finished run, so reading them never waits for the worker.
+class PipelineStats : public QObject
+{
+  Q_OBJECT
+  // stage name to duration of the last published run
+  Q_PROPERTY(QVariantMap stageMilliseconds READ stageMilliseconds NOTIFY changed)
+  // stage name to the largest image a single run of that stage has allocated
+  Q_PROPERTY(QVariantMap peakStageBytes READ peakStageBytes NOTIFY changed)
+  Q_PROPERTY(double stitchesPerSecond READ stitchesPerSecond NOTIFY changed)
+  Q_PROPERTY(int cacheHits READ cacheHits NOTIFY changed)
+  Q_PROPERTY(int cacheMisses READ cacheMisses NOTIFY changed)
+  Q_PROPERTY(int runsTriggered READ runsTriggered NOTIFY changed)
+  // runs that got replaced or cancelled by a newer one before publishing a result
+  Q_PROPERTY(int runsCoalesced READ runsCoalesced NOTIFY changed)
+public:
+  explicit PipelineStats(QObject* in_parent = nullptr);
+  Q_INVOKABLE void reset();
+
+  void runTriggered();
+  void runCoalesced();
+  void runFinished(const PipelineSample& in_sample);
+  // stages that run on the GUI thread outside of a job
+  void stageFinished(PipelineSample::Stage in_stage, std::chrono::steady_clock::time_point in_begin, qint64 in_bytes);
+
+  QVariantMap stageMilliseconds() const;
+  QVariantMap peakStageBytes() const;
+  double stitchesPerSecond() const;
+  int cacheHits() const;
+  int cacheMisses() const;
+  int runsTriggered() const;
+  int runsCoalesced() const;
+
+signals:
+  void changed();
+
+private:
+  std::array<double, PipelineSample::STAGE_COUNT> lastMilliseconds;
+  std::array<qint64, PipelineSample::STAGE_COUNT> peakBytes;
+  double throughput;
+  int hits;
+  int misses;
+  int triggered;
+  int coalesced;
+};
\ No newline at end of file
@@ -1,12 +1,23 @@
 #include "QtPixelator.h"
 #include "error_codes.h"
 #include "logging.h"
+#include "HslCylinder.h"
+#include "AreaDownsampler.h"
+#include "StixelRenderer.h"
+#include "Dithering.h"
+#include "PaletteExtraction.h"
+#include "StripExporter.h"
 #include "calculus.h"
+#include "parallel.h"
+#include "tracing.h"
 #include <vector>
 #include <set>
 #include <optional>
 #include <cmath>
 #include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <fstream>
 #include <QPainter>
 
 namespace
@@ -14,77 +25,155 @@ namespace
   bool hasDuplicates(const std::vector<QColor>& colors);
   bool allValid(const std::vector<QColor>& colors);
   QColor minDiff(const QColor& in_source, const std::vector<QColor>& in_list);
+  QImage bandView(uchar* in_bits, qsizetype in_bytesPerLine, int in_width, int in_firstLine, int in_lineCount);
+  void paintHelpers(QImage& io_band, unsigned in_firstLine, const QSize& in_size, const QColor& in_color, unsigned in_gridWidth, unsigned in_gridHeight);
+
+  // co-prime gauges up to 64 keep their exact stixels, the pixel count keeps clear of QImage's 2 GiB limit
+  constexpr unsigned DEFAULT_MAX_STIXEL_SIZE{ 64 };
+  constexpr unsigned long long DEFAULT_MAX_RESULT_PIXELS{ 1ull << 28 };
 }
  
 QtPixelator::QtPixelator(QObject* in_parent)
   : QObject(in_parent) 
   , imageBuffer{}
+  , imageRegion{}
   , sourcePath{}
   , storagePath{}
   , stitchWidth{0}
   , stitchHeight{0}
   , stitchCount{0}
   , rowCount{0}
+  , stixelLimits{DEFAULT_MAX_STIXEL_SIZE, DEFAULT_MAX_RESULT_PIXELS}
+  , stixelAspectError{0.}
+  , memoryBudget{0}
+  , paletteLookup{std::make_shared<PaletteLookup>()}
+  , ditherMode{one_bit::DitherMode::NONE}
+  , yarnCatalog{}
   , auxColorPri{QColorConstants::Svg::red}
   , auxColorSec{QColorConstants::Svg::darkgray}
   , helperGrid{5}
   , gridEnabled{true}
+  , cacheMutex{}
+  , averagesCache{}
+  , indexCache{}
+  , stixelCache{}
+  , pipelineStats{}
+  , generation{0}
+  , progressPercent{0}
+  , resultMutex{}
+  , publishedResult{}
+  , jobMutex{}
+  , jobAvailable{}
+  , pendingJob{}
+  , stopping{false}
+  , worker{}
 {}
 
+QtPixelator::~QtPixelator()
+{
+  {
+    std::lock_guard<std::mutex> lock{ jobMutex };
+    stopping = true;
+  }
+  // cancels the running job at its next row
+  ++generation;
+  jobAvailable.notify_all();
+  if (worker.joinable()) worker.join();
+}
+
 errors::Code QtPixelator::run(){
+  tracing::Span span{ "run" };
+  const auto checkBegin{ std::chrono::steady_clock::now() };
   auto result = checkSettings();
-  if (errors::NONE == result)
+  pipelineStats.stageFinished(PipelineSample::CHECK_SETTINGS, checkBegin, 0);
+  if (errors::NONE != result)
   {
-    QImage colorMap = pixelate();
-    if (colorMap.isNull())
-    {
-      logging::logger() << logging::Level::ERR << "Color map is NULL!" << logging::Level::OFF;
-      return errors::PIXELATION_ERROR;
-    }
-    if (!scalePixels(colorMap))
-    {
-      logging::logger() << logging::Level::ERR << "Failed to scale for pixelation" << logging::Level::OFF;
-      return errors::PAINT_ERROR;
-    }
-    drawHelpers();
+    STIXELATOR_LOG(ERR, "Failed to verify input: " << result);
+    return result;
   }
-  else
+  progressPercent = 0;
+  progressChanged(0);
+  bool replaced{ false };
   {
-    logging::logger() << logging::Level::ERR << "Failed to verify input: " << result << logging::Level::OFF;
+    std::lock_guard<std::mutex> lock{ jobMutex };
+    // a job that hasn't started yet is simply replaced, a running one notices it got superseded
+    replaced = (bool)pendingJob;
+    pendingJob = createJob();
+    if (!worker.joinable()) worker = std::thread(&QtPixelator::workLoop, this);
   }
-  pixelationCreated();
+  jobAvailable.notify_one();
+  pipelineStats.runTriggered();
+  if (replaced) pipelineStats.runCoalesced();
   return errors::NONE;
 }
 
+errors::Code QtPixelator::runSynchronously()
+{
+  tracing::Span span{ "runSynchronously" };
+  const auto checkBegin{ std::chrono::steady_clock::now() };
+  auto result = checkSettings();
+  pipelineStats.stageFinished(PipelineSample::CHECK_SETTINGS, checkBegin, 0);
+  if (errors::NONE != result)
+  {
+    STIXELATOR_LOG(ERR, "Failed to verify input: " << result);
+    return result;
+  }
+  pipelineStats.runTriggered();
+  auto job{ createJob() };
+  result = execute(*job);
+  finishJob(job->generation, result, job->sample);
+  return result;
+}
+
 errors::Code QtPixelator::commit()
 {
   if (storagePath.isEmpty())
   {
-    logging::logger() << logging::Level::ERR << "No output path set!" << logging::Level::OFF;
+    STIXELATOR_LOG(ERR, "No output path set!");
     return errors::WRONG_OUTPUT_FILE;
   }
   
-  if (resultBuffer.save(storagePath.toLocalFile()))
+  std::shared_ptr<const Result> published;
   {
-    logging::logger() << logging::Level::DEBUG << "File written" << logging::Level::OFF;
+    std::lock_guard<std::mutex> lock{ resultMutex };
+    published = publishedResult;
+  }
+  if (published && published->strips.stripRows > 0) return exportStrips(*published);
+  const QImage result{ published ? published->image : QImage{} };
+  tracing::Span span{ "commit", (unsigned long long)result.sizeInBytes() };
+  const auto commitBegin{ std::chrono::steady_clock::now() };
+  const bool saved{ result.save(storagePath.toLocalFile()) };
+  pipelineStats.stageFinished(PipelineSample::COMMIT, commitBegin, result.sizeInBytes());
+  if (saved)
+  {
+    STIXELATOR_LOG(DEBUG, "File written");
     return errors::NONE;
   }
 
-  logging::logger() << logging::Level::ERR << "Could not write result" << logging::Level::OFF;
+  STIXELATOR_LOG(ERR, "Could not write result");
   return errors::WRITE_ERROR;
 }
 
 errors::Code QtPixelator::setInputImage(const QImage& in_image)
 {
   const std::string input{ in_image.isNull() ? " to NULL" : "" };
-  logging::logger() << logging::Level::ERR << "Setting input file" << input << logging::Level::OFF;
+  STIXELATOR_LOG(ERR, "Setting input file" << input);
   imageBuffer = in_image;
+  imageRegion = in_image.rect();
   return imageBuffer.isNull() ? errors::WRONG_INPUT_FILE : errors::NONE;
 }
 
+errors::Code QtPixelator::setInputRegion(const QImage& in_image, const QRect& in_region)
+{
+  imageBuffer = in_image;
+  imageRegion = in_region.intersected(in_image.rect());
+  STIXELATOR_LOG(DEBUG, "Setting input region " << imageRegion.x() << "/" << imageRegion.y() << " (" << imageRegion.width() << "x" << imageRegion.height() << ")");
+  return imageRegion.isEmpty() ? errors::WRONG_INPUT_FILE : errors::NONE;
+}
+
 errors::Code QtPixelator::setStoragePath(const QUrl& in_url)
 {
-  logging::logger() << logging::Level::DEBUG << "Store to " << in_url.toLocalFile().toStdString() << " on completion." << logging::Level::OFF;
+  STIXELATOR_LOG(DEBUG, "Store to " << in_url.toLocalFile().toStdString() << " on completion.");
   
   storagePath = in_url;
   return storagePath.isEmpty() ? errors::WRONG_OUTPUT_FILE : errors::NONE;
@@ -94,23 +183,71 @@ errors::Code QtPixelator::setStitchSizes(const int& in_width, const int& in_heig
 {
   if (in_width <= 0 || in_height <= 0 || in_rowsPerGauge <= 0 || in_stitchesPerGauge <= 0)
   {
-    logging::logger() << logging::Level::ERR << "Bad input " << in_width << "x" << in_height << "cm with " << in_stitchesPerGauge << "st, " << in_rowsPerGauge << "r per 10x10cm" << logging::Level::OFF;
+    STIXELATOR_LOG(ERR, "Bad input " << in_width << "x" << in_height << "cm with " << in_stitchesPerGauge << "st, " << in_rowsPerGauge << "r per 10x10cm");
     return errors::INVALID_IMAGE_SIZES;
   }
-  logging::logger() << logging::Level::DEBUG << "Result will have " << in_width << "x" << in_height << "cm with " << in_stitchesPerGauge << "st, " << in_rowsPerGauge << "r per 10x10cm" << logging::Level::OFF;
-  recomputeSizes(in_width, in_height, in_rowsPerGauge, in_stitchesPerGauge);
-  logging::logger() << logging::Level::DEBUG << "Result will have " << stitchCount << "st, " << rowCount << "r, stixels will measure " << stitchWidth << "x" << stitchHeight << " each" << logging::Level::OFF;
+  STIXELATOR_LOG(DEBUG, "Result will have " << in_width << "x" << in_height << "cm with " << in_stitchesPerGauge << "st, " << in_rowsPerGauge << "r per 10x10cm");
+  if (!recomputeSizes(in_width, in_height, in_rowsPerGauge, in_stitchesPerGauge))
+  {
+    STIXELATOR_LOG(ERR, "No stixel fits " << stixelLimits.maxStixelSize << "px per side and " << (double)stixelLimits.maxPixels << "px in total");
+    return errors::INVALID_IMAGE_SIZES;
+  }
+  STIXELATOR_LOG(DEBUG, "Result will have " << stitchCount << "st, " << rowCount << "r, stixels will measure " << stitchWidth << "x" << stitchHeight << " each");
+  if (stixelAspectError != 0.)
+  {
+    STIXELATOR_LOG(WARNING, "Stixels deviate by " << 100. * stixelAspectError << "% from the stitch's aspect ratio");
+  }
 
   return errors::NONE;
 }
 
-errors::Code QtPixelator::setStitchColors(const std::vector<QColor> in_colors)
+errors::Code QtPixelator::setStixelLimits(unsigned in_maxStixelSize, qulonglong in_maxPixels)
 {
+  stixelLimits = geometry::Limits{ in_maxStixelSize, in_maxPixels };
+  return errors::NONE;
+}
+
+errors::Code QtPixelator::setMemoryBudget(qulonglong in_bytes)
+{
+  memoryBudget = in_bytes;
+  return errors::NONE;
+}
 
+errors::Code QtPixelator::setStitchColors(const std::vector<QColor> in_colors)
+{
+  if (in_colors.size() > (size_t)PaletteLookup::MAX_SIZE)
+  {
+    STIXELATOR_LOG(ERR, "Palette of " << (unsigned)in_colors.size() << " colors exceeds " << PaletteLookup::MAX_SIZE);
+    return errors::INVALID_PALETTE_SIZE;
+  }
   colors = { in_colors };
+  // running jobs keep the lookup they started with
+  paletteLookup = std::make_shared<PaletteLookup>(colors);
   if (! allValid(in_colors)) return errors::INVALID_COLOR;
   if (hasDuplicates(in_colors)) return errors::DUPLICATE_COLOR;
-  logging::logger() << logging::Level::DEBUG << "Set stitch colors" << logging::Level::OFF;
+  STIXELATOR_LOG(DEBUG, "Set stitch colors");
+  return errors::NONE;
+}
+
+errors::Code QtPixelator::setStitchPalette(const QVariantList& in_colors)
+{
+  std::vector<QColor> palette;
+  palette.reserve(in_colors.size());
+  for (const auto& color : in_colors)
+  {
+    palette.push_back(color.value<QColor>());
+  }
+  return setStitchColors(palette);
+}
+
+errors::Code QtPixelator::setDitherMode(int in_mode)
+{
+  if (in_mode < (int)one_bit::DitherMode::NONE || in_mode > (int)one_bit::DitherMode::BAYER)
+  {
+    STIXELATOR_LOG(ERR, "Unknown dither mode " << in_mode);
+    return errors::INVALID_DITHER_MODE;
+  }
+  ditherMode = (one_bit::DitherMode)in_mode;
   return errors::NONE;
 }
 
@@ -123,95 +260,417 @@ int QtPixelator::setHelperSettings(bool gridEnabled, QColor primaryColor, QColor
   return errors::NONE;
 }
 
+errors::Code QtPixelator::setYarnCatalog(const QUrl& in_url)
+{
+  std::ifstream catalogFile{ in_url.toLocalFile().toStdString() };
+  if (!catalogFile)
+  {
+    STIXELATOR_LOG(ERR, "Could not open yarn catalog " << in_url.toLocalFile().toStdString());
+    return errors::WRONG_INPUT_FILE;
+  }
+  return yarnCatalog.read(catalogFile);
+}
+
+QVariantList QtPixelator::proposePalette(int in_colorCount, bool in_snapToCatalog)
+{
+  QVariantList result;
+  if (in_colorCount <= 0 || in_colorCount > PaletteLookup::MAX_SIZE)
+  {
+    STIXELATOR_LOG(ERR, "Cannot propose a palette of " << in_colorCount << " colors");
+    return result;
+  }
+  // counts the pixels of the region, not of the whole image
+  tracing::Span span{ "proposePalette", (unsigned long long)imageRegion.width() * imageRegion.height() * imageBuffer.depth() / 8 };
+  auto proposal{ palette_extraction::propose_palette(imageBuffer, imageRegion, (unsigned)in_colorCount) };
+  if (in_snapToCatalog && yarnCatalog.size() > 0)
+  {
+    const auto yarns{ yarnCatalog.nearestDistinct(proposal) };
+    proposal.clear();
+    for (const auto& yarn : yarns)
+    {
+      // different yarns may share a color, the palette must not
+      if (yarn >= 0 && std::find(proposal.begin(), proposal.end(), yarnCatalog.color(yarn)) == proposal.end()) proposal.push_back(yarnCatalog.color(yarn));
+    }
+  }
+  for (const auto& color : proposal)
+  {
+    result.push_back(QColor(color));
+  }
+  STIXELATOR_LOG(DEBUG, "Proposed " << result.size() << " colors");
+  return result;
+}
+
+QString QtPixelator::yarnName(const QColor& in_color) const
+{
+  for (int index = 0; index < yarnCatalog.size(); ++index)
+  {
+    if (yarnCatalog.color(index) == in_color.rgb()) return QString::fromStdString(yarnCatalog.name(index));
+  }
+  return QString{};
+}
+
 QImage QtPixelator::resultImage() const
 {
-  return resultBuffer.copy();
+  std::lock_guard<std::mutex> lock{ resultMutex };
+  return publishedResult ? publishedResult->image : QImage{};
+}
+
+one_bit::StitchChart QtPixelator::stitchChart() const
+{
+  std::lock_guard<std::mutex> lock{ resultMutex };
+  return publishedResult ? publishedResult->chart : one_bit::StitchChart{};
+}
+
+int QtPixelator::progress() const
+{
+  return progressPercent;
+}
+
+double QtPixelator::aspectError() const
+{
+  return stixelAspectError;
+}
+
+qulonglong QtPixelator::estimatedResultBytes() const
+{
+  // RGB32, 4 bytes per pixel and no padding at the end of the lines
+  const auto pixels{ calculus::checked_multiply((unsigned long long)stitchCount * stitchWidth, (unsigned long long)rowCount * stitchHeight) };
+  const auto bytes{ pixels ? calculus::checked_multiply(*pixels, 4) : std::nullopt };
+  return bytes ? *bytes : std::numeric_limits<qulonglong>::max();
 }
 
-void QtPixelator::recomputeSizes(const int& in_width, const int& in_height, const int& in_rowsPerGauge, const int& in_stitchesPerGauge)
+PipelineStats* QtPixelator::stats()
+{
+  return &pipelineStats;
+}
+
+bool QtPixelator::recomputeSizes(const int& in_width, const int& in_height, const int& in_rowsPerGauge, const int& in_stitchesPerGauge)
 {
   // gauge is 10cm, so there will be a rectangle totaling a size of in_width*in_stitchesPerGauge/10 x in_height*in_rowsPerGauge/10 stixels,
-  // where each stixel will have a width and height to be computed from the IRL size of in_stitchesPerGauge/10cm x in_rowsPerGauge/10cm:
-  // the first goal, therefore, must be to figure out how to int-ify "stixel" width and height from that aspect ratio, 
-  // i.e. making them fractions of the least common multiple with the same aspect ratio as the actual stitch
-  // the total size in stixels is therefore the number of stixels (as computed from the first equation) times the correspoding stixel size.
-  stitchCount = (unsigned)(ceil((in_width / 10.) * in_stitchesPerGauge));
-  rowCount = (unsigned)(ceil((in_height / 10.) * in_rowsPerGauge));
-  unsigned stixelLcm{ calculus::least_common_multiple(in_rowsPerGauge, in_stitchesPerGauge) };
-  stitchWidth = stixelLcm / in_stitchesPerGauge;
-  stitchHeight = stixelLcm / in_rowsPerGauge;
+  // where each stixel will have a width and height to be computed from the IRL size of in_stitchesPerGauge/10cm x in_rowsPerGauge/10cm.
+  // The exact ratio is the least common multiple divided by either gauge, which gets huge for co-prime gauges,
+  // so the stixel is the closest ratio within the limits, and the sizes stay unchanged if there is none.
+  const auto sizes{ geometry::chart_geometry(in_width, in_height, in_rowsPerGauge, in_stitchesPerGauge, stixelLimits) };
+  if (!sizes)
+  {
+    return false;
+  }
+  stitchCount = sizes->stitchCount;
+  rowCount = sizes->rowCount;
+  stitchWidth = sizes->stixel.width;
+  stitchHeight = sizes->stixel.height;
+  stixelAspectError = sizes->stixel.aspectError;
+  return true;
 } 
 
-QImage QtPixelator::pixelate()
+std::unique_ptr<QtPixelator::Job> QtPixelator::createJob()
+{
+  auto job{ std::make_unique<Job>() };
+  job->generation = ++generation;
+  job->image = imageBuffer;
+  job->region = imageRegion;
+  job->stitchWidth = stitchWidth;
+  job->stitchHeight = stitchHeight;
+  job->stitchCount = stitchCount;
+  job->rowCount = rowCount;
+  job->palette = paletteLookup;
+  for (const auto& color : colors)
+  {
+    job->paletteColors.push_back(color.rgb());
+  }
+  job->ditherMode = ditherMode;
+  job->auxColorSec = auxColorSec;
+  job->auxColorPri = auxColorPri;
+  job->helperGrid = helperGrid;
+  job->gridEnabled = gridEnabled;
+  // each strip holds as many whole stitch rows as fit the budget, but at least one
+  const qulonglong resultBytes{ estimatedResultBytes() };
+  job->stripRows = (memoryBudget > 0 && resultBytes > memoryBudget) ? (unsigned)std::max(1ull, memoryBudget / (resultBytes / rowCount)) : 0;
+  if (job->stripRows > 0 && memoryBudget < resultBytes / rowCount)
+  {
+    STIXELATOR_LOG(WARNING, "Memory budget is below one stitch row of " << (double)(resultBytes / rowCount) << " bytes, strips exceed it");
+  }
+  job->totalRows = 0;
+  job->finishedRows = 0;
+  return job;
+}
+
+void QtPixelator::workLoop()
 {
-  QImage colorMap = imageBuffer.scaled(QSize(stitchCount, rowCount));
-  for (int y = 0; y < colorMap.height(); y++) {
-    QRgb* line = (QRgb*)colorMap.scanLine(y);
-    for (int x = 0; x < colorMap.width(); x++) {
-      // line[x] has an individual pixel
-      auto& colorForPixel{ line[x] };
-      auto nearestColor = minDiff(QColor(colorForPixel), colors);
-      colorForPixel = nearestColor.isValid() ? nearestColor.rgb() : Qt::black;
+  tracing::name_thread("pixelator worker");
+  std::unique_lock<std::mutex> lock{ jobMutex };
+  while (true)
+  {
+    jobAvailable.wait(lock, [this]() { return stopping || pendingJob; });
+    if (stopping) return;
+    std::unique_ptr<Job> job;
+    job.swap(pendingJob);
+    lock.unlock();
+    const auto result{ execute(*job) };
+    // logging and signals belong to the GUI thread, finishJob drops the outcome if it's outdated by then
+    QMetaObject::invokeMethod(this, [this, jobGeneration = job->generation, result, sample = job->sample]() { finishJob(jobGeneration, result, sample); }, Qt::QueuedConnection);
+    job.reset();
+    lock.lock();
+  }
+}
+
+errors::Code QtPixelator::execute(Job& in_job)
+{
+  const AveragesKey averagesKey{ in_job.image.cacheKey(), in_job.region, in_job.stitchCount, in_job.rowCount };
+  const IndexKey indexKey{ averagesKey, in_job.paletteColors, in_job.ditherMode };
+  const StixelKey stixelKey{ indexKey, in_job.stitchWidth, in_job.stitchHeight, in_job.gridEnabled, in_job.gridEnabled ? in_job.auxColorSec.rgba() : 0 };
+  // results rendered in strips get painted on commit, there is no stixel layer to look up
+  const bool strips{ in_job.stripRows > 0 };
+  QImage averages;
+  one_bit::StitchChart chart;
+  QImage stixels;
+  {
+    // the chart is published along with the result, so it is needed even when the stixel layer is cached
+    std::lock_guard<std::mutex> lock{ cacheMutex };
+    // a full size layer rendered before the budget applied mustn't outlive the switch to strips
+    if (strips) stixelCache = {};
+    else if (stixelCache.key == stixelKey) stixels = stixelCache.artifact;
+    if (indexCache.key == indexKey) chart = indexCache.artifact;
+    else if (averagesCache.key == averagesKey) averages = averagesCache.artifact;
+  }
+  const bool paint{ !strips && stixels.isNull() };
+  const bool helpers{ !strips && in_job.gridEnabled };
+  const bool quantize{ chart.isEmpty() };
+  const bool average{ quantize && averages.isNull() };
+  // every stage that runs walks each stitch row once
+  const unsigned stages{ (unsigned)average + (unsigned)quantize + (unsigned)paint + (unsigned)helpers };
+  in_job.totalRows = std::max(1u, stages * in_job.rowCount);
+  // the averages only get looked up when the indices aren't cached
+  in_job.sample.cacheHits = (unsigned)(!strips && !paint) + (unsigned)!quantize + (unsigned)(quantize && !average);
+  in_job.sample.cacheMisses = (unsigned)paint + (unsigned)quantize + (unsigned)average;
+  in_job.sample.stitches = in_job.stitchCount * in_job.rowCount;
+
+  try
+  {
+    if (average)
+    {
+      const auto begin{ std::chrono::steady_clock::now() };
+      averages = downsample(in_job);
+      if (superseded(in_job)) return errors::PIXELATION_CANCELLED;
+      if (averages.isNull()) return errors::PIXELATION_ERROR;
+      in_job.sample.record(PipelineSample::DOWNSAMPLE, begin, averages.sizeInBytes());
+      std::lock_guard<std::mutex> lock{ cacheMutex };
+      averagesCache = { averagesKey, averages };
+    }
+    if (quantize)
+    {
+      const auto begin{ std::chrono::steady_clock::now() };
+      chart = pixelate(in_job, averages);
+      if (superseded(in_job)) return errors::PIXELATION_CANCELLED;
+      in_job.sample.record(PipelineSample::PIXELATE, begin, (qint64)chart.byteSize());
+      std::lock_guard<std::mutex> lock{ cacheMutex };
+      indexCache = { indexKey, chart };
+    }
+    if (paint)
+    {
+      const auto begin{ std::chrono::steady_clock::now() };
+      stixels = scalePixels(in_job, chart);
+      if (superseded(in_job)) return errors::PIXELATION_CANCELLED;
+      if (stixels.isNull()) return errors::PAINT_ERROR;
+      in_job.sample.record(PipelineSample::SCALE_PIXELS, begin, stixels.sizeInBytes());
+      std::lock_guard<std::mutex> lock{ cacheMutex };
+      stixelCache = { stixelKey, stixels };
     }
-    logging::logger() << logging::Level::DEBUG << "x";
-  }
-  logging::logger() << logging::Level::OFF;
-  logging::logger() << logging::Level::DEBUG << "Get pixelation template of size " << colorMap.width() << "x" << colorMap.height() << logging::Level::OFF;
-  return colorMap;
-}
-
-bool QtPixelator::scalePixels(const QImage& colorMap)
-{
-  if (! ((colorMap.width() == stitchCount) && (colorMap.height() == rowCount))) return false;
-  resultBuffer = imageBuffer.scaled(QSize(stitchCount * stitchWidth, rowCount * stitchHeight));
-  QPainter qPainter(&resultBuffer);
-  for (int y = 0; y < colorMap.height(); y++) {
-    QRgb* line = (QRgb*)colorMap.scanLine(y);
-    for (int x = 0; x < colorMap.width(); x++) {
-      QColor stixelColor{ line[x] };
-      qPainter.setPen(gridEnabled ? auxColorSec : stixelColor);
-      qPainter.setBrush(stixelColor);
-      qPainter.drawRect(x * stitchWidth, y * stitchHeight, stitchWidth, stitchHeight);
-      logging::logger() << logging::Level::DEBUG << "Draw sec from " << x << "/" << y << " with dimensions " << stitchWidth << "x" << stitchHeight << logging::Level::OFF;
+    // the grid gets drawn on a detached copy, the cached stixel layer stays untouched
+    QImage result{ stixels };
+    const auto gridBegin{ std::chrono::steady_clock::now() };
+    if (helpers && !drawHelpers(in_job, result)) return errors::PIXELATION_CANCELLED;
+    if (helpers) in_job.sample.record(PipelineSample::DRAW_HELPERS, gridBegin, result.sizeInBytes());
+    const StripRendering rendering{ in_job.paletteColors, stixel_rendering::Layout{ in_job.stitchWidth, in_job.stitchHeight, in_job.gridEnabled, in_job.auxColorSec.rgb() },
+      in_job.auxColorPri, in_job.helperGrid, in_job.stripRows };
+    std::shared_ptr<const Result> published{ std::make_shared<const Result>(Result{ result, chart, rendering }) };
+    {
+      std::lock_guard<std::mutex> lock{ resultMutex };
+      if (superseded(in_job)) return errors::PIXELATION_CANCELLED;
+      publishedResult.swap(published);
     }
-    logging::logger() << logging::Level::DEBUG << "x";
+    // the previous result gets released outside the lock, readers still holding it keep it alive
   }
-  logging::logger() << logging::Level::DEBUG << logging::Level::OFF;
-  qPainter.end();
-  logging::logger() << logging::Level::DEBUG << "Pixelation complete" << logging::Level::OFF;
-  return true;
+  catch (const std::exception&)
+  {
+    return errors::PAINT_ERROR;
+  }
+  return errors::NONE;
+}
+
+bool QtPixelator::AveragesKey::operator==(const AveragesKey& in_other) const
+{
+  return image == in_other.image && region == in_other.region && stitchCount == in_other.stitchCount && rowCount == in_other.rowCount;
+}
+
+bool QtPixelator::IndexKey::operator==(const IndexKey& in_other) const
+{
+  return averages == in_other.averages && palette == in_other.palette && ditherMode == in_other.ditherMode;
+}
+
+bool QtPixelator::StixelKey::operator==(const StixelKey& in_other) const
+{
+  return indices == in_other.indices && stitchWidth == in_other.stitchWidth && stitchHeight == in_other.stitchHeight
+    && gridEnabled == in_other.gridEnabled && outlineColor == in_other.outlineColor;
 }
 
-void QtPixelator::drawHelpers()
+void QtPixelator::finishJob(unsigned in_generation, errors::Code in_result, const PipelineSample& in_sample)
 {
-  if(!gridEnabled)
+  if (in_generation != generation)
+  {
+    pipelineStats.runCoalesced();
+    return;
+  }
+  if (errors::NONE != in_result)
   {
+    STIXELATOR_LOG(ERR, "Pixelation failed: " << in_result);
+    pixelationFailed(in_result);
     return;
   }
-  QPainter qPainter(&resultBuffer);
-  qPainter.setPen(auxColorPri);
-  unsigned primaryGridWidth = helperGrid * stitchWidth;
-  unsigned primaryGridHeight = helperGrid * stitchHeight;
-  if (resultBuffer.width() < 0 || resultBuffer.height() < 0)
+  STIXELATOR_LOG(DEBUG, "Pixelation complete");
+  pipelineStats.runFinished(in_sample);
+  pixelationCreated();
+}
+
+bool QtPixelator::superseded(const Job& in_job) const
+{
+  return in_job.generation != generation;
+}
+
+bool QtPixelator::rowFinished(Job& in_job)
+{
+  if (superseded(in_job)) return false;
+  const int percent{ (int)(100ull * ++in_job.finishedRows / in_job.totalRows) };
+  // only rising values get reported, so the rows of a band finishing out of order don't make the progress jump back
+  int previous{ progressPercent };
+  while (previous < percent && !progressPercent.compare_exchange_weak(previous, percent)) {}
+  if (previous < percent) progressChanged(percent);
+  return true;
+}
+
+QImage QtPixelator::downsample(Job& in_job)
+{
+  // counts the source pixels that get read
+  tracing::Span span{ "downsample", (unsigned long long)in_job.region.width() * in_job.region.height() * in_job.image.depth() / 8 };
+  return downsampling::area_average(in_job.image, in_job.region, QSize(in_job.stitchCount, in_job.rowCount), [&]() { return rowFinished(in_job); });
+}
+
+one_bit::StitchChart QtPixelator::pixelate(Job& in_job, const QImage& in_averages)
+{
+  tracing::Span span{ "pixelate", (unsigned long long)in_averages.sizeInBytes() };
+  return dithering::dither(in_job.ditherMode, in_averages, *in_job.palette, [&]() { return rowFinished(in_job); });
+}
+
+QImage QtPixelator::scalePixels(Job& in_job, const one_bit::StitchChart& in_chart)
+{
+  if (in_chart.stitchCount() != in_job.stitchCount || in_chart.rowCount() != in_job.rowCount) return QImage{};
+  tracing::Span span{ "scalePixels" };
+  // every pixel gets written by a stixel, so there is no need to scale the source first
+  QImage result(QSize(in_job.stitchCount * in_job.stitchWidth, in_job.rowCount * in_job.stitchHeight), QImage::Format_RGB32);
+  if (result.isNull()) return result;
+  span.setBytes(result.sizeInBytes());
+  uchar* resultBits{ result.bits() };
+  const qsizetype resultStride{ result.bytesPerLine() };
+  const stixel_rendering::Layout layout{ in_job.stitchWidth, in_job.stitchHeight, in_job.gridEnabled, in_job.auxColorSec.rgb() };
+  parallel::for_each_band(in_job.rowCount, [&](unsigned in_begin, unsigned in_end) {
+    for (unsigned y = in_begin; y < in_end; y++) {
+      stixel_rendering::render_row(in_chart, y, in_job.paletteColors, layout, resultBits + (qsizetype)y * in_job.stitchHeight * resultStride, resultStride);
+      if (!rowFinished(in_job)) return;
+    }
+  });
+  return result;
+}
+
+bool QtPixelator::drawHelpers(Job& in_job, QImage& io_result)
+{
+  if(!in_job.gridEnabled)
+  {
+    return true;
+  }
+  // includes detaching the result from the cached stixel layer
+  tracing::Span span{ "drawHelpers", (unsigned long long)io_result.sizeInBytes() };
+  const unsigned stitchHeight{ in_job.stitchHeight };
+  unsigned primaryGridWidth = in_job.helperGrid * in_job.stitchWidth;
+  unsigned primaryGridHeight = in_job.helperGrid * stitchHeight;
+  if (io_result.width() < 0 || io_result.height() < 0)
   {
     throw std::runtime_error("trying to draw helper lines on picture with negative dimensions!");
   }
-  for (unsigned x = 0; x < (unsigned)resultBuffer.width(); x += primaryGridWidth)
+  uchar* resultBits{ io_result.bits() };
+  const qsizetype resultStride{ io_result.bytesPerLine() };
+  const int width{ io_result.width() };
+  const int height{ io_result.height() };
+  parallel::for_each_band(in_job.rowCount, [&](unsigned in_begin, unsigned in_end) {
+    const unsigned firstLine{ in_begin * stitchHeight };
+    QImage band{ bandView(resultBits, resultStride, width, firstLine, (in_end - in_begin) * stitchHeight) };
+    paintHelpers(band, firstLine, QSize(width, height), in_job.auxColorPri, primaryGridWidth, primaryGridHeight);
+    for (unsigned row = in_begin; row < in_end; ++row)
+    {
+      if (!rowFinished(in_job)) return;
+    }
+  });
+  return !superseded(in_job);
+}
+
+errors::Code QtPixelator::exportStrips(const Result& in_result)
+{
+  const QString path{ storagePath.toLocalFile() };
+  if (!StripExporter::supports(path))
+  {
+    STIXELATOR_LOG(ERR, "Results above the memory budget can only be written as PNG, not to " << path.toStdString());
+    return errors::WRONG_OUTPUT_FILE;
+  }
+  const StripRendering& rendering{ in_result.strips };
+  const one_bit::StitchChart& chart{ in_result.chart };
+  const unsigned stitchHeight{ rendering.layout.stitchHeight };
+  const QSize size(chart.stitchCount() * rendering.layout.stitchWidth, chart.rowCount() * stitchHeight);
+  tracing::Span span{ "exportStrips", (unsigned long long)size.width() * size.height() * 4 };
+  const auto commitBegin{ std::chrono::steady_clock::now() };
+  StripExporter exporter;
+  if (!exporter.open(path, size))
   {
-    for (unsigned y = 0; y < (unsigned)resultBuffer.height(); y += primaryGridHeight)
+    STIXELATOR_LOG(ERR, "Could not write result");
+    return errors::WRITE_ERROR;
+  }
+  // one strip buffer gets reused for the whole chart, so the memory needed doesn't grow with the chart
+  QImage strip(size.width(), rendering.stripRows * stitchHeight, QImage::Format_RGB32);
+  if (strip.isNull()) return errors::PAINT_ERROR;
+  uchar* stripBits{ strip.bits() };
+  const qsizetype stripStride{ strip.bytesPerLine() };
+  for (unsigned firstRow = 0; firstRow < chart.rowCount(); firstRow += rendering.stripRows)
+  {
+    const unsigned stripRowCount{ std::min(rendering.stripRows, chart.rowCount() - firstRow) };
+    parallel::for_each_band(stripRowCount, [&](unsigned in_begin, unsigned in_end) {
+      for (unsigned row = in_begin; row < in_end; ++row)
+      {
+        stixel_rendering::render_row(chart, firstRow + row, rendering.palette, rendering.layout, stripBits + (qsizetype)row * stitchHeight * stripStride, stripStride);
+      }
+      if (!rendering.layout.gridEnabled) return;
+      QImage band{ bandView(stripBits, stripStride, size.width(), in_begin * stitchHeight, (in_end - in_begin) * stitchHeight) };
+      paintHelpers(band, (firstRow + in_begin) * stitchHeight, size, rendering.helperColor, rendering.helperGrid * rendering.layout.stitchWidth, rendering.helperGrid * stitchHeight);
+    });
+    if (!exporter.write(bandView(stripBits, stripStride, size.width(), 0, stripRowCount * stitchHeight)))
     {
-      qPainter.drawRect(x, y, primaryGridWidth, primaryGridHeight);
-      logging::logger() << logging::Level::DEBUG << "Draw pri from " << x << "/" << y << " with dimensions " << primaryGridWidth << "x" << primaryGridHeight << logging::Level::OFF;
+      STIXELATOR_LOG(ERR, "Could not write result");
+      return errors::WRITE_ERROR;
     }
   }
-  qPainter.drawLine(0, resultBuffer.height() - 1, resultBuffer.width() - 1, resultBuffer.height() - 1);
-  qPainter.drawLine(resultBuffer.width() - 1, 0, resultBuffer.width() - 1, resultBuffer.height() - 1);
-  qPainter.end();
+  const bool saved{ exporter.finish() };
+  pipelineStats.stageFinished(PipelineSample::COMMIT, commitBegin, strip.sizeInBytes());
+  if (saved)
+  {
+    STIXELATOR_LOG(DEBUG, "File written in strips of " << rendering.stripRows << " rows");
+    return errors::NONE;
+  }
+
+  STIXELATOR_LOG(ERR, "Could not write result");
+  return errors::WRITE_ERROR;
 }
 
 errors::Code QtPixelator::checkSettings()
 {
-  if (imageBuffer.isNull())
+  tracing::Span span{ "checkSettings" };
+  if (imageBuffer.isNull() || imageRegion.isEmpty())
   {
     return errors::WRONG_INPUT_FILE;
   }
@@ -239,35 +698,9 @@ namespace
   {
     return std::any_of(colors.begin(), colors.end(), [](const QColor& color) {return color.isValid(); });
   }
-  static const double pi{ std::atan(1) * 4 };
-
-  struct HsvPoint
-  {
-    const double rc;
-    const double pl;
-    const double v;
-
-    static HsvPoint fromColor(const QColor& in_color)
-    {
-      int hue, sat, val;
-      in_color.getHsl(&hue, &sat, &val);
-      return HsvPoint(hue, sat, val);
-    }
-
-    HsvPoint(int hue, int sat, int val)
-      : rc{ 127. + std::cos(pi * hue / 180.) * sat / 2 }
-      , pl{ 127. + std::sin(pi * hue / 180.) * sat / 2 }
-      , v{ 1. * val }
-    { 
-    }
-  };
-
   double colorDistance(const QColor& one, const QColor& other)
   {
-    HsvPoint p1 = HsvPoint::fromColor(one);
-    HsvPoint p2 = HsvPoint::fromColor(other);
-
-    return std::sqrt(std::pow(p1.rc - p2.rc, 2) + std::pow(p1.pl - p2.pl, 2) + std::pow(p1.v - p2.v, 2));
+    return color_space::distance(color_space::HsvPoint::fromColor(one), color_space::HsvPoint::fromColor(other));
   }
 
   QColor minDiff(const QColor& in_source, const std::vector<QColor>& in_list)
@@ -285,6 +718,35 @@ namespace
     }
     return returnValue;
   }
+
+  QImage bandView(uchar* in_bits, qsizetype in_bytesPerLine, int in_width, int in_firstLine, int in_lineCount)
+  {
+    // shares the pixels of the full image, painting on it writes straight into the lines of that band
+    return QImage(in_bits + in_firstLine * in_bytesPerLine, in_width, in_lineCount, in_bytesPerLine, QImage::Format_RGB32);
+  }
+
+  void paintHelpers(QImage& io_band, unsigned in_firstLine, const QSize& in_size, const QColor& in_color, unsigned in_gridWidth, unsigned in_gridHeight)
+  {
+    // all helper lines share one color, so bands may draw the same grid rectangle clipped to their slice
+    const unsigned endLine{ in_firstLine + (unsigned)io_band.height() };
+    const int width{ in_size.width() };
+    const int height{ in_size.height() };
+    QPainter qPainter(&io_band);
+    qPainter.translate(0, -(int)in_firstLine);
+    qPainter.setPen(in_color);
+    for (unsigned y = 0; y < (unsigned)height; y += in_gridHeight)
+    {
+      // a rectangle outline covers y up to and including y + in_gridHeight
+      if (y + in_gridHeight < in_firstLine || y >= endLine) continue;
+      for (unsigned x = 0; x < (unsigned)width; x += in_gridWidth)
+      {
+        qPainter.drawRect(x, y, in_gridWidth, in_gridHeight);
+      }
+    }
+    qPainter.drawLine(0, height - 1, width - 1, height - 1);
+    qPainter.drawLine(width - 1, 0, width - 1, height - 1);
+    qPainter.end();
+  }
 }
 #ifdef DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest.h>
@@ -391,4 +853,855 @@ TEST_CASE("test minimum difference finder")
     CHECK_EQ(targetColor, out_color);
   }
 }
+
+TEST_CASE("test palette lookup matches minimum difference finder")
+{
+  const std::vector<QColor> palette{ QColorConstants::Svg::red, QColorConstants::Svg::blue, QColorConstants::Svg::green, QColorConstants::Svg::white, QColorConstants::Svg::yellow, QColorConstants::Svg::magenta, QColorConstants::Svg::black };
+  PaletteLookup lookup{ palette };
+  CHECK_EQ(lookup.size(), (int)palette.size());
+
+  // walk a lattice through the RGB cube, crossing cell borders, and hit every entry twice to exercise the memo
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    for (int red = 0; red < 256; red += 15)
+    {
+      for (int green = 0; green < 256; green += 17)
+      {
+        for (int blue = 0; blue < 256; blue += 13)
+        {
+          const QRgb source{ qRgb(red, green, blue) };
+          const int index{ lookup.nearestIndex(source) };
+          REQUIRE(index != PaletteLookup::NO_COLOR);
+          CHECK_EQ(QColor(lookup.color(index)), minDiff(QColor(source), palette));
+        }
+      }
+    }
+  }
+
+  // alpha does not take part in the mapping
+  CHECK_EQ(lookup.nearestIndex(qRgba(250, 10, 10, 0)), lookup.nearestIndex(qRgb(250, 10, 10)));
+}
+
+TEST_CASE("test palette lookup without colors")
+{
+  PaletteLookup lookup{};
+  CHECK_EQ(lookup.size(), 0);
+  CHECK_EQ(lookup.nearestIndex(qRgb(1, 2, 3)), PaletteLookup::NO_COLOR);
+}
+
+TEST_CASE("test scanline mapping matches minimum difference finder")
+{
+  const std::vector<QColor> palette{ QColorConstants::Svg::red, QColorConstants::Svg::blue, QColorConstants::Svg::green, QColorConstants::Svg::white, QColorConstants::Svg::yellow, QColorConstants::Svg::magenta, QColorConstants::Svg::black, QColorConstants::Svg::orange };
+  std::vector<QRgb> line;
+  for (int red = 0; red < 256; red += 5)
+  {
+    for (int green = 0; green < 256; green += 7)
+    {
+      for (int blue = 0; blue < 256; blue += 3)
+      {
+        line.push_back(qRgb(red, green, blue));
+      }
+    }
+  }
+  // odd length so every kernel also runs its scalar tail
+  line.push_back(qRgb(17, 99, 201));
+
+  for (auto instructionSet : { scanline_kernels::InstructionSet::SCALAR, scanline_kernels::InstructionSet::SSE42, scanline_kernels::InstructionSet::AVX2 })
+  {
+    if (!scanline_kernels::is_supported(instructionSet)) continue;
+    PaletteLookup lookup{ palette };
+    std::vector<int32_t> indices(line.size());
+    lookup.mapScanline(instructionSet, line.data(), (int)line.size(), indices.data());
+    for (size_t x = 0; x < line.size(); ++x)
+    {
+      REQUIRE(indices[x] != PaletteLookup::NO_COLOR);
+      CHECK_EQ(QColor(lookup.color(indices[x])), minDiff(QColor(line[x]), palette));
+    }
+  }
+
+  PaletteLookup empty{};
+  std::vector<int32_t> indices(3, 0);
+  empty.mapScanline(line.data(), 3, indices.data());
+  CHECK_EQ(indices[0], PaletteLookup::NO_COLOR);
+  CHECK_EQ(indices[2], PaletteLookup::NO_COLOR);
+}
+
+TEST_CASE("test large palettes match minimum difference finder")
+{
+  std::vector<QColor> palette;
+  for (int entry = 0; entry < 256; ++entry)
+  {
+    palette.push_back(QColor(qRgb((entry * 37) % 256, (entry * 91) % 256, (entry * 53) % 256)));
+  }
+  // duplicates resolve to the first entry, like the linear scan does
+  palette.push_back(palette[17]);
+  PaletteLookup lookup{ palette };
+  std::vector<QRgb> line;
+  for (int red = 0; red < 256; red += 9)
+  {
+    for (int green = 0; green < 256; green += 11)
+    {
+      for (int blue = 0; blue < 256; blue += 7)
+      {
+        line.push_back(qRgb(red, green, blue));
+      }
+    }
+  }
+  std::vector<int32_t> indices(line.size());
+  lookup.mapScanline(line.data(), (int)line.size(), indices.data());
+  for (size_t x = 0; x < line.size(); ++x)
+  {
+    REQUIRE(indices[x] != PaletteLookup::NO_COLOR);
+    CHECK_NE(indices[x], 256);
+    CHECK_EQ(QColor(lookup.color(indices[x])), minDiff(QColor(line[x]), palette));
+  }
+}
+
+TEST_CASE("test palettes from variant lists")
+{
+  QtPixelator pixelator;
+  QVariantList colors;
+  for (int entry = 0; entry < 200; ++entry)
+  {
+    colors.append(QColor(qRgb(entry, 255 - entry, (entry * 7) % 256)));
+  }
+  CHECK_EQ(pixelator.setStitchPalette(colors), errors::NONE);
+  colors.append(colors.front());
+  CHECK_EQ(pixelator.setStitchPalette(colors), errors::DUPLICATE_COLOR);
+
+  std::vector<QColor> tooMany(PaletteLookup::MAX_SIZE + 1, QColorConstants::Svg::red);
+  CHECK_EQ(pixelator.setStitchColors(tooMany), errors::INVALID_PALETTE_SIZE);
+}
+
+TEST_CASE("test area average downsampling")
+{
+  // 4x2 source with one color per 2x2 block
+  QImage source(4, 2, QImage::Format_RGB32);
+  source.fill(qRgb(0, 0, 0));
+  for (int y = 0; y < 2; ++y)
+  {
+    source.setPixel(2, y, qRgb(200, 100, 40));
+    source.setPixel(3, y, qRgb(100, 50, 20));
+  }
+  QImage result = downsampling::area_average(source, QSize(2, 1));
+  REQUIRE_EQ(result.size(), QSize(2, 1));
+  CHECK_EQ(result.pixel(0, 0), qRgb(0, 0, 0));
+  CHECK_EQ(result.pixel(1, 0), qRgb(150, 75, 30));
+
+  // fractional cells: 3 pixels into 2 stitches weigh the middle pixel half for each
+  QImage row(3, 1, QImage::Format_RGB32);
+  row.setPixel(0, 0, qRgb(0, 0, 0));
+  row.setPixel(1, 0, qRgb(90, 90, 90));
+  row.setPixel(2, 0, qRgb(180, 180, 180));
+  result = downsampling::area_average(row, QSize(2, 1));
+  CHECK_EQ(result.pixel(0, 0), qRgb(30, 30, 30));
+  CHECK_EQ(result.pixel(1, 0), qRgb(150, 150, 150));
+
+  // enlarging repeats pixels
+  result = downsampling::area_average(row, QSize(6, 2));
+  CHECK_EQ(result.pixel(0, 1), qRgb(0, 0, 0));
+  CHECK_EQ(result.pixel(3, 0), qRgb(90, 90, 90));
+  CHECK_EQ(result.pixel(5, 1), qRgb(180, 180, 180));
+
+  // regions only sample inside their bounds
+  result = downsampling::area_average(source, QRect(2, 0, 2, 2), QSize(1, 1));
+  CHECK_EQ(result.pixel(0, 0), qRgb(150, 75, 30));
+
+  CHECK(downsampling::area_average(QImage{}, QSize(2, 2)).isNull());
+  CHECK(downsampling::area_average(source, QSize(0, 2)).isNull());
+}
+
+TEST_CASE("test parallel pipeline matches serial run")
+{
+  QImage source(97, 61, QImage::Format_RGB32);
+  for (int y = 0; y < source.height(); ++y)
+  {
+    for (int x = 0; x < source.width(); ++x)
+    {
+      source.setPixel(x, y, qRgb((x * 255) / 96, (y * 255) / 60, ((x + y) * 7) % 256));
+    }
+  }
+  auto render = [&source](unsigned in_workers) {
+    parallel::set_worker_count(in_workers);
+    QtPixelator pixelator;
+    pixelator.setInputImage(source);
+    pixelator.setStitchSizes(10, 10, 23, 17);
+    pixelator.setStitchColors({ QColorConstants::Svg::red, QColorConstants::Svg::blue, QColorConstants::Svg::white, QColorConstants::Svg::black });
+    pixelator.setHelperSettings(true, QColorConstants::Svg::red, QColorConstants::Svg::darkgray, 5);
+    REQUIRE_EQ(pixelator.runSynchronously(), errors::NONE);
+    return pixelator.resultImage();
+  };
+  const QImage serial{ render(1) };
+  for (unsigned workers : { 2u, 3u, 16u })
+  {
+    CHECK(render(workers) == serial);
+  }
+  parallel::set_worker_count(0);
+}
+
+TEST_CASE("test input regions match cropped copies")
+{
+  QImage source(240, 180, QImage::Format_RGB32);
+  for (int y = 0; y < source.height(); ++y)
+  {
+    for (int x = 0; x < source.width(); ++x)
+    {
+      source.setPixel(x, y, qRgb((x * 7) % 256, (y * 3) % 256, (x * y) % 256));
+    }
+  }
+  auto render = [](auto in_setInput) {
+    QtPixelator pixelator;
+    REQUIRE_EQ(in_setInput(pixelator), errors::NONE);
+    pixelator.setStitchSizes(10, 10, 23, 17);
+    pixelator.setStitchColors({ QColorConstants::Svg::red, QColorConstants::Svg::blue, QColorConstants::Svg::white, QColorConstants::Svg::black });
+    REQUIRE_EQ(pixelator.runSynchronously(), errors::NONE);
+    return pixelator.resultImage();
+  };
+  const QRect region{ 37, 21, 150, 133 };
+  const QImage cropped{ render([&](QtPixelator& pixelator) { return pixelator.setInputImage(source.copy(region)); }) };
+  const QImage shared{ render([&](QtPixelator& pixelator) { return pixelator.setInputRegion(source, region); }) };
+  CHECK(shared == cropped);
+  // the region never reaches outside the image
+  const QImage clamped{ render([&](QtPixelator& pixelator) { return pixelator.setInputRegion(source, QRect(37, 21, 500, 500)); }) };
+  CHECK(clamped == render([&](QtPixelator& pixelator) { return pixelator.setInputImage(source.copy(37, 21, 203, 159)); }));
+
+  QtPixelator outside;
+  CHECK_EQ(outside.setInputRegion(source, QRect(300, 300, 10, 10)), errors::WRONG_INPUT_FILE);
+}
+
+TEST_CASE("test results are shared with readers instead of copied")
+{
+  QImage source(120, 90, QImage::Format_RGB32);
+  source.fill(QColorConstants::Svg::navy);
+  QtPixelator pixelator;
+  pixelator.setInputImage(source);
+  pixelator.setStitchSizes(10, 10, 23, 17);
+  pixelator.setStitchColors({ QColorConstants::Svg::navy, QColorConstants::Svg::white });
+  REQUIRE_EQ(pixelator.runSynchronously(), errors::NONE);
+  const QImage first{ pixelator.resultImage() };
+  const QImage expected{ first.copy() };
+  CHECK_EQ(pixelator.resultImage().constBits(), first.constBits());
+
+  // a new result replaces the published one without touching what readers hold
+  pixelator.setStitchColors({ QColorConstants::Svg::white, QColorConstants::Svg::black });
+  REQUIRE_EQ(pixelator.runSynchronously(), errors::NONE);
+  CHECK_NE(pixelator.resultImage().constBits(), first.constBits());
+  CHECK(first == expected);
+  CHECK_EQ(pixelator.stitchChart().stitchCount(), 17u);
+}
+
+TEST_CASE("test pipeline statistics")
+{
+  QImage source(120, 90, QImage::Format_RGB32);
+  source.fill(QColorConstants::Svg::navy);
+  QtPixelator pixelator;
+  pixelator.setInputImage(source);
+  pixelator.setStitchSizes(10, 10, 23, 17);
+  pixelator.setStitchColors({ QColorConstants::Svg::navy, QColorConstants::Svg::white });
+  REQUIRE_EQ(pixelator.runSynchronously(), errors::NONE);
+  PipelineStats& stats{ *pixelator.stats() };
+  const qint64 resultBytes{ pixelator.resultImage().sizeInBytes() };
+  CHECK_EQ(stats.runsTriggered(), 1);
+  CHECK_EQ(stats.cacheHits(), 0);
+  CHECK_EQ(stats.cacheMisses(), 3);
+  CHECK_GT(stats.stitchesPerSecond(), 0.);
+  CHECK_GT(stats.stageMilliseconds().value("downsample").toDouble(), 0.);
+  CHECK_EQ(stats.peakStageBytes().value("scalePixels").toLongLong(), resultBytes);
+  CHECK_EQ(stats.peakStageBytes().value("drawHelpers").toLongLong(), resultBytes);
+
+  // a new grid color reuses the stixel layer and the indices
+  pixelator.setHelperSettings(true, QColorConstants::Svg::blue, QColorConstants::Svg::darkgray, 5);
+  REQUIRE_EQ(pixelator.runSynchronously(), errors::NONE);
+  CHECK_EQ(stats.runsTriggered(), 2);
+  CHECK_EQ(stats.runsCoalesced(), 0);
+  CHECK_EQ(stats.cacheHits(), 2);
+  CHECK_EQ(stats.cacheMisses(), 3);
+  CHECK_EQ(stats.stageMilliseconds().value("downsample").toDouble(), 0.);
+  CHECK_EQ(stats.stageMilliseconds().value("scalePixels").toDouble(), 0.);
+  CHECK_GT(stats.stageMilliseconds().value("drawHelpers").toDouble(), 0.);
+
+  stats.reset();
+  CHECK_EQ(stats.runsTriggered(), 0);
+  CHECK_EQ(stats.cacheMisses(), 0);
+  CHECK_EQ(stats.peakStageBytes().value("scalePixels").toLongLong(), 0);
+}
+
+TEST_CASE("test stixel sizes stay within the limits")
+{
+  QImage source(120, 90, QImage::Format_RGB32);
+  source.fill(QColorConstants::Svg::navy);
+  QtPixelator pixelator;
+  pixelator.setInputImage(source);
+  pixelator.setStitchColors({ QColorConstants::Svg::navy, QColorConstants::Svg::white });
+
+  // co-prime gauges below the default limit keep their exact stixels
+  REQUIRE_EQ(pixelator.setStitchSizes(10, 10, 31, 23), errors::NONE);
+  REQUIRE_EQ(pixelator.runSynchronously(), errors::NONE);
+  CHECK_EQ(pixelator.resultImage().size(), QSize(23 * 31, 31 * 23));
+  CHECK_EQ(pixelator.aspectError(), 0.);
+
+  // larger ones get the closest stixel within the limit instead of a 97 x 89 one
+  REQUIRE_EQ(pixelator.setStitchSizes(10, 10, 97, 89), errors::NONE);
+  CHECK_NE(pixelator.aspectError(), 0.);
+  CHECK_LT(std::abs(pixelator.aspectError()), .001);
+  pixelator.setStixelLimits(16, 0);
+  REQUIRE_EQ(pixelator.setStitchSizes(10, 10, 97, 89), errors::NONE);
+  REQUIRE_EQ(pixelator.runSynchronously(), errors::NONE);
+  CHECK_LE(pixelator.resultImage().width(), 89 * 16);
+  CHECK_LE(pixelator.resultImage().height(), 97 * 16);
+  CHECK_LT(std::abs(pixelator.aspectError()), .002);
+  CHECK_EQ(pixelator.stitchChart().stitchCount(), 89u);
+  CHECK_EQ(pixelator.stitchChart().rowCount(), 97u);
+
+  pixelator.setStixelLimits(4, 0);
+  REQUIRE_EQ(pixelator.setStitchSizes(10, 10, 31, 23), errors::NONE);
+  REQUIRE_EQ(pixelator.runSynchronously(), errors::NONE);
+  CHECK_EQ(pixelator.resultImage().size(), QSize(23 * 4, 31 * 3));
+  CHECK_EQ(pixelator.aspectError(), doctest::Approx(3. / 4. * 31. / 23. - 1.));
+
+  // a chart with more stitches than the budget has pixels fails and keeps the previous sizes
+  pixelator.setStixelLimits(0, 1000);
+  CHECK_EQ(pixelator.setStitchSizes(10, 10, 97, 89), errors::INVALID_IMAGE_SIZES);
+  REQUIRE_EQ(pixelator.runSynchronously(), errors::NONE);
+  CHECK_EQ(pixelator.resultImage().size(), QSize(23 * 4, 31 * 3));
+}
+
+#include <QTemporaryDir>
+#include <QFile>
+
+TEST_CASE("test results above the memory budget get written in strips")
+{
+  QImage source(120, 90, QImage::Format_RGB32);
+  for (int y = 0; y < source.height(); ++y)
+  {
+    for (int x = 0; x < source.width(); ++x)
+    {
+      source.setPixel(x, y, qRgb((x * 2) % 256, (y * 3) % 256, (x * y) % 256));
+    }
+  }
+  QTemporaryDir directory;
+  REQUIRE(directory.isValid());
+  const QString path{ directory.filePath("strips.png") };
+  for (bool gridEnabled : { true, false })
+  {
+    CAPTURE(gridEnabled);
+    QtPixelator pixelator;
+    pixelator.setInputImage(source);
+    pixelator.setStitchSizes(20, 15, 30, 20);
+    pixelator.setStitchColors({ QColorConstants::Svg::red, QColorConstants::Svg::navy, QColorConstants::Svg::white });
+    // 3 stitch rows per grid cell, so strips end in the middle of cells
+    pixelator.setHelperSettings(gridEnabled, QColorConstants::Svg::blue, QColorConstants::Svg::darkgray, 3);
+    REQUIRE_EQ(pixelator.runSynchronously(), errors::NONE);
+    const QImage full{ pixelator.resultImage() };
+    REQUIRE_EQ(pixelator.estimatedResultBytes(), (qulonglong)full.sizeInBytes());
+    const qulonglong rowBytes{ pixelator.estimatedResultBytes() / 45 };
+
+    // strips of several rows, of a single row, and a budget too small for even one row
+    for (qulonglong budget : { 7 * rowBytes + 3, rowBytes, rowBytes / 2 })
+    {
+      CAPTURE(budget);
+      pixelator.setMemoryBudget(budget);
+      REQUIRE_EQ(pixelator.runSynchronously(), errors::NONE);
+      CHECK(pixelator.resultImage().isNull());
+      CHECK_EQ(pixelator.stitchChart().rowCount(), 45u);
+      pixelator.stats()->reset();
+      pixelator.setStoragePath(QUrl::fromLocalFile(path));
+      REQUIRE_EQ(pixelator.commit(), errors::NONE);
+      CHECK(QImage(path).convertToFormat(QImage::Format_RGB32) == full);
+      CHECK_LE(pixelator.stats()->peakStageBytes().value("commit").toULongLong(), std::max(budget, rowBytes));
+    }
+
+    // charts within the budget stay in memory
+    pixelator.setMemoryBudget(pixelator.estimatedResultBytes());
+    REQUIRE_EQ(pixelator.runSynchronously(), errors::NONE);
+    CHECK(pixelator.resultImage() == full);
+  }
+
+  QtPixelator pixelator;
+  pixelator.setInputImage(source);
+  pixelator.setStitchSizes(20, 15, 30, 20);
+  pixelator.setStitchColors({ QColorConstants::Svg::red, QColorConstants::Svg::navy });
+  pixelator.setMemoryBudget(1000);
+  REQUIRE_EQ(pixelator.runSynchronously(), errors::NONE);
+  const QString jpeg{ directory.filePath("strips.jpg") };
+  pixelator.setStoragePath(QUrl::fromLocalFile(jpeg));
+  CHECK_EQ(pixelator.commit(), errors::WRONG_OUTPUT_FILE);
+  CHECK_FALSE(QFile::exists(jpeg));
+}
+
+TEST_CASE("test scanline stixel rendering matches painted stixels")
+{
+  const std::vector<QRgb> palette{ qRgb(255, 0, 0), qRgb(0, 128, 255), qRgb(250, 250, 250) };
+  const unsigned stitchCount{ 7 };
+  const unsigned rowCount{ 5 };
+  // index 3 is outside the palette
+  one_bit::StitchChart chart(stitchCount, rowCount, 4);
+  for (unsigned y = 0; y < rowCount; ++y)
+  {
+    for (unsigned x = 0; x < stitchCount; ++x)
+    {
+      chart.setIndex(x, y, ((y * stitchCount + x) * 5) % 4);
+    }
+  }
+  for (auto [stitchWidth, stitchHeight] : { std::pair<unsigned, unsigned>{ 3, 4 }, { 1, 1 }, { 5, 2 }, { 2, 1 } })
+  {
+    for (bool gridEnabled : { true, false })
+    {
+      const QColor gridColor{ QColorConstants::Svg::darkgray };
+      // reference: one painter rectangle per stitch, the way stixels used to be drawn
+      QImage painted(stitchCount * stitchWidth, rowCount * stitchHeight, QImage::Format_RGB32);
+      painted.fill(qRgb(1, 2, 3));
+      QPainter qPainter(&painted);
+      for (unsigned y = 0; y < rowCount; ++y)
+      {
+        for (unsigned x = 0; x < stitchCount; ++x)
+        {
+          const unsigned index{ chart.index(x, y) };
+          QColor stixelColor{ index < palette.size() ? palette[index] : qRgb(0, 0, 0) };
+          qPainter.setPen(gridEnabled ? gridColor : stixelColor);
+          qPainter.setBrush(stixelColor);
+          qPainter.drawRect(x * stitchWidth, y * stitchHeight, stitchWidth, stitchHeight);
+        }
+      }
+      qPainter.end();
+
+      QImage rendered(painted.size(), QImage::Format_RGB32);
+      const stixel_rendering::Layout layout{ stitchWidth, stitchHeight, gridEnabled, gridColor.rgb() };
+      for (unsigned y = 0; y < rowCount; ++y)
+      {
+        stixel_rendering::render_row(chart, y, palette, layout, rendered.scanLine(y * stitchHeight), rendered.bytesPerLine());
+      }
+      CHECK(rendered == painted);
+    }
+  }
+}
+
+TEST_CASE("test cached stages match a fresh run")
+{
+  QImage source(120, 90, QImage::Format_RGB32);
+  for (int y = 0; y < source.height(); ++y)
+  {
+    for (int x = 0; x < source.width(); ++x)
+    {
+      source.setPixel(x, y, qRgb((x * 2) % 256, (y * 3) % 256, (x * y) % 256));
+    }
+  }
+  const std::vector<QColor> firstPalette{ QColorConstants::Svg::red, QColorConstants::Svg::green, QColorConstants::Svg::black };
+  const std::vector<QColor> secondPalette{ QColorConstants::Svg::white, QColorConstants::Svg::navy, QColorConstants::Svg::orange };
+  auto fresh = [&source](const std::vector<QColor>& in_palette, bool in_grid, QColor in_primary, QColor in_secondary) {
+    QtPixelator pixelator;
+    pixelator.setInputImage(source);
+    pixelator.setStitchSizes(20, 15, 30, 20);
+    pixelator.setStitchColors(in_palette);
+    pixelator.setHelperSettings(in_grid, in_primary, in_secondary, 5);
+    REQUIRE_EQ(pixelator.runSynchronously(), errors::NONE);
+    return pixelator.resultImage();
+  };
+
+  QtPixelator cached;
+  cached.setInputImage(source);
+  cached.setStitchSizes(20, 15, 30, 20);
+  cached.setStitchColors(firstPalette);
+  REQUIRE_EQ(cached.runSynchronously(), errors::NONE);
+  CHECK(cached.resultImage() == fresh(firstPalette, true, QColorConstants::Svg::red, QColorConstants::Svg::darkgray));
+
+  // only the grid color changes: recomposite on top of the cached stixels
+  cached.setHelperSettings(true, QColorConstants::Svg::blue, QColorConstants::Svg::darkgray, 5);
+  REQUIRE_EQ(cached.runSynchronously(), errors::NONE);
+  CHECK(cached.resultImage() == fresh(firstPalette, true, QColorConstants::Svg::blue, QColorConstants::Svg::darkgray));
+
+  // the outline color is part of the stixel layer
+  cached.setHelperSettings(true, QColorConstants::Svg::blue, QColorConstants::Svg::yellow, 5);
+  REQUIRE_EQ(cached.runSynchronously(), errors::NONE);
+  CHECK(cached.resultImage() == fresh(firstPalette, true, QColorConstants::Svg::blue, QColorConstants::Svg::yellow));
+
+  // palette changes requantize the cached averages
+  cached.setStitchColors(secondPalette);
+  REQUIRE_EQ(cached.runSynchronously(), errors::NONE);
+  CHECK(cached.resultImage() == fresh(secondPalette, true, QColorConstants::Svg::blue, QColorConstants::Svg::yellow));
+
+  cached.setHelperSettings(false, QColorConstants::Svg::blue, QColorConstants::Svg::yellow, 5);
+  REQUIRE_EQ(cached.runSynchronously(), errors::NONE);
+  CHECK(cached.resultImage() == fresh(secondPalette, false, QColorConstants::Svg::blue, QColorConstants::Svg::yellow));
+
+  // going back to earlier settings must not pick up the grid drawn in between
+  cached.setHelperSettings(true, QColorConstants::Svg::blue, QColorConstants::Svg::yellow, 5);
+  REQUIRE_EQ(cached.runSynchronously(), errors::NONE);
+  CHECK(cached.resultImage() == fresh(secondPalette, true, QColorConstants::Svg::blue, QColorConstants::Svg::yellow));
+
+  // the chart of the result holds one index per stitch
+  const auto chart{ cached.stitchChart() };
+  CHECK_EQ(chart.stitchCount(), 40u);
+  CHECK_EQ(chart.rowCount(), 45u);
+  CHECK_EQ(chart.bitsPerStitch(), 2u);
+  const auto counts{ chart.colorCounts() };
+  REQUIRE_EQ(counts.size(), 3u);
+  CHECK_EQ(counts[0] + counts[1] + counts[2], 40u * 45u);
+}
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+TEST_CASE("test asynchronous runs only publish the newest generation")
+{
+  int argc{ 0 };
+  QCoreApplication app(argc, nullptr);
+  QImage source(200, 300, QImage::Format_RGB32);
+  source.fill(qRgb(20, 40, 200));
+
+  QtPixelator pixelator;
+  unsigned created{ 0 };
+  int lastProgress{ -1 };
+  QObject::connect(&pixelator, &QtPixelator::pixelationCreated, [&created]() { ++created; });
+  QObject::connect(&pixelator, &QtPixelator::progressChanged, [&lastProgress](int in_percent) { lastProgress = in_percent; });
+  pixelator.setInputImage(source);
+  pixelator.setStitchSizes(40, 60, 30, 22);
+  pixelator.setStitchColors({ QColorConstants::Svg::red, QColorConstants::Svg::blue });
+
+  // every run supersedes the one before, the last one has a different palette
+  for (int run = 0; run < 5; ++run)
+  {
+    REQUIRE_EQ(pixelator.run(), errors::NONE);
+  }
+  pixelator.setStitchColors({ QColorConstants::Svg::white, QColorConstants::Svg::black });
+  REQUIRE_EQ(pixelator.run(), errors::NONE);
+
+  QElapsedTimer timer;
+  timer.start();
+  while (created == 0 && timer.elapsed() < 30000)
+  {
+    app.processEvents(QEventLoop::AllEvents, 10);
+  }
+  // give stale generations a chance to show up if they weren't dropped
+  app.processEvents(QEventLoop::AllEvents, 100);
+  CHECK_EQ(created, 1u);
+  CHECK_EQ(lastProgress, 100);
+  CHECK_EQ(pixelator.progress(), 100);
+  CHECK_EQ(pixelator.resultImage().pixel(2, 2), QColor(QColorConstants::Svg::black).rgb());
+  // the five runs before the last one got replaced or cancelled
+  CHECK_EQ(pixelator.stats()->runsTriggered(), 6);
+  CHECK_EQ(pixelator.stats()->runsCoalesced(), 5);
+
+  // settings errors are reported right away
+  QtPixelator unset;
+  CHECK_EQ(unset.run(), errors::WRONG_INPUT_FILE);
+}
+
+TEST_CASE("test wavefront dithering matches a single thread")
+{
+  QImage averages(97, 61, QImage::Format_RGB32);
+  for (int y = 0; y < averages.height(); ++y)
+  {
+    for (int x = 0; x < averages.width(); ++x)
+    {
+      averages.setPixel(x, y, qRgb(x * 255 / 96, y * 255 / 60, (x * y) % 256));
+    }
+  }
+  PaletteLookup palette({ QColorConstants::Svg::black, QColorConstants::Svg::white, QColorConstants::Svg::red, QColorConstants::Svg::navy });
+  for (auto mode : { one_bit::DitherMode::NONE, one_bit::DitherMode::FLOYD_STEINBERG, one_bit::DitherMode::ATKINSON, one_bit::DitherMode::BAYER })
+  {
+    CAPTURE((int)mode);
+    parallel::set_worker_count(1);
+    const auto serial{ dithering::dither(mode, averages, palette, []() { return true; }) };
+    REQUIRE_FALSE(serial.isEmpty());
+    for (unsigned workers : { 2u, 7u, 0u })
+    {
+      parallel::set_worker_count(workers);
+      CHECK(dithering::dither(mode, averages, palette, []() { return true; }) == serial);
+    }
+    std::atomic<unsigned> rows{ 0 };
+    CHECK(dithering::dither(mode, averages, palette, [&rows]() { return ++rows < 10; }).isEmpty());
+  }
+  parallel::set_worker_count(0);
+}
+
+TEST_CASE("test dithering mixes palette colors")
+{
+  QImage gray(64, 64, QImage::Format_RGB32);
+  gray.fill(qRgb(128, 128, 128));
+  PaletteLookup palette({ QColorConstants::Svg::black, QColorConstants::Svg::white });
+  const auto plain{ dithering::dither(one_bit::DitherMode::NONE, gray, palette, []() { return true; }).colorCounts() };
+  CHECK((plain[0] == 0 || plain[1] == 0));
+  for (auto mode : { one_bit::DitherMode::FLOYD_STEINBERG, one_bit::DitherMode::ATKINSON, one_bit::DitherMode::BAYER })
+  {
+    CAPTURE((int)mode);
+    const auto counts{ dithering::dither(mode, gray, palette, []() { return true; }).colorCounts() };
+    // mid gray comes out as about half black, half white
+    CHECK_GT(counts[0], 64u * 64u * 4 / 10);
+    CHECK_GT(counts[1], 64u * 64u * 4 / 10);
+  }
+
+  QtPixelator pixelator;
+  CHECK_EQ(pixelator.setDitherMode((int)one_bit::DitherMode::ATKINSON), errors::NONE);
+  CHECK_EQ(pixelator.setDitherMode(-1), errors::INVALID_DITHER_MODE);
+  CHECK_EQ(pixelator.setDitherMode((int)one_bit::DitherMode::BAYER + 1), errors::INVALID_DITHER_MODE);
+}
+
+TEST_CASE("test palette proposals find the dominant colors")
+{
+  QImage source(300, 200, QImage::Format_RGB32);
+  source.fill(qRgb(200, 30, 40));
+  for (int y = 0; y < 200; ++y)
+  {
+    for (int x = 180; x < 300; ++x)
+    {
+      // a little noise, the proposal has to average it out
+      source.setPixel(x, y, x < 270 ? qRgb(20 + (x + y) % 3, 40, 120) : qRgb(250, 250, 250));
+    }
+  }
+  const auto twoColors{ palette_extraction::propose_palette(source, 2) };
+  REQUIRE_EQ(twoColors.size(), 2u);
+  CHECK_EQ(twoColors[0], qRgb(200, 30, 40));
+  CHECK_EQ(qBlue(twoColors[1]), 120);
+
+  const auto threeColors{ palette_extraction::propose_palette(source, 3) };
+  REQUIRE_EQ(threeColors.size(), 3u);
+  CHECK_EQ(threeColors[0], qRgb(200, 30, 40));
+  CHECK_EQ(threeColors[2], qRgb(250, 250, 250));
+
+  // no more colors than the image has
+  QImage flat(50, 50, QImage::Format_ARGB32);
+  flat.fill(qRgb(10, 200, 10));
+  CHECK_EQ(palette_extraction::propose_palette(flat, 8), std::vector<QRgb>{ qRgb(10, 200, 10) });
+  CHECK(palette_extraction::propose_palette(QImage{}, 4).empty());
+  CHECK(palette_extraction::propose_palette(flat, 0).empty());
+}
+
+TEST_CASE("test palette proposals only sample the input region")
+{
+  // red on the left, navy on the right, with a white stripe along the bottom
+  QImage source(300, 200, QImage::Format_RGB32);
+  for (int y = 0; y < 200; ++y)
+  {
+    for (int x = 0; x < 300; ++x)
+    {
+      source.setPixel(x, y, y >= 170 ? qRgb(250, 250, 250) : x < 150 ? qRgb(200, 30, 40) : qRgb(20, 40, 120));
+    }
+  }
+  CHECK_EQ(palette_extraction::propose_palette(source, QRect(160, 10, 100, 100), 4), std::vector<QRgb>{ qRgb(20, 40, 120) });
+  CHECK_EQ(palette_extraction::propose_palette(source, source.rect(), 3), palette_extraction::propose_palette(source, 3));
+  CHECK(palette_extraction::propose_palette(source, QRect(400, 0, 10, 10), 3).empty());
+
+  QtPixelator pixelator;
+  REQUIRE_EQ(pixelator.setInputRegion(source, QRect(0, 100, 140, 100)), errors::NONE);
+  const QVariantList proposal{ pixelator.proposePalette(4, false) };
+  REQUIRE_EQ(proposal.size(), 2);
+  // mostly red, the navy half of the image lies outside the region
+  CHECK_EQ(proposal[0].value<QColor>(), QColor(qRgb(200, 30, 40)));
+  CHECK_EQ(proposal[1].value<QColor>(), QColor(qRgb(250, 250, 250)));
+}
+
+TEST_CASE("test palette proposals don't depend on the worker count")
+{
+  QImage source(640, 480, QImage::Format_RGB32);
+  for (int y = 0; y < source.height(); ++y)
+  {
+    for (int x = 0; x < source.width(); ++x)
+    {
+      source.setPixel(x, y, qRgb(x * 255 / 639, y * 255 / 479, (x ^ y) % 256));
+    }
+  }
+  parallel::set_worker_count(1);
+  const auto serial{ palette_extraction::propose_palette(source, 12) };
+  CHECK_EQ(serial.size(), 12u);
+  parallel::set_worker_count(6);
+  CHECK_EQ(palette_extraction::propose_palette(source, 12), serial);
+  parallel::set_worker_count(0);
+}
+
+TEST_CASE("test yarn catalog")
+{
+  YarnCatalog catalog;
+  std::istringstream valid{ "name,red,green,blue\n"
+    "Snow White, 255, 250, 250\r\n"
+    "\n"
+    "\"Red, dark\",#8b0000\n"
+    "Navy,0,0,128\n"
+    "Midnight,#000080\n" };
+  REQUIRE_EQ(catalog.read(valid), errors::NONE);
+  REQUIRE_EQ(catalog.size(), 4);
+  CHECK_EQ(catalog.name(0), "Snow White");
+  CHECK_EQ(catalog.color(0), qRgb(255, 250, 250));
+  CHECK_EQ(catalog.name(1), "Red, dark");
+  CHECK_EQ(catalog.color(1), qRgb(139, 0, 0));
+  CHECK_EQ(catalog.nearest(qRgb(250, 250, 250)), 0);
+  // same color twice, the first entry wins
+  CHECK_EQ(catalog.nearest(qRgb(0, 0, 120)), 2);
+  const std::vector<QRgb> proposal{ qRgb(0, 0, 120), qRgb(0, 0, 130), qRgb(10, 10, 140), qRgb(200, 0, 0), qRgb(255, 255, 255) };
+  // the dark red is taken by then, so red gets the last free yarn and white none at all
+  const std::vector<int> yarns{ 2, 3, 1, 0, -1 };
+  CHECK_EQ(catalog.nearestDistinct(proposal), yarns);
+
+  // errors keep the catalog that was read before
+  std::istringstream invalid{ "Snow White,255,250,250\nGrass,0,256,0\n" };
+  CHECK_EQ(catalog.read(invalid), errors::INVALID_CATALOG);
+  CHECK_EQ(catalog.size(), 4);
+  std::istringstream empty{ "name,red,green,blue\n" };
+  CHECK_EQ(catalog.read(empty), errors::INVALID_CATALOG);
+  CHECK_EQ(catalog.size(), 4);
+}
+
+TEST_CASE("test yarn catalog lookup matches a linear scan")
+{
+  std::ostringstream csv;
+  for (int entry = 0; entry < 500; ++entry)
+  {
+    csv << "Yarn " << entry << "," << (entry * 37) % 256 << "," << (entry * 101) % 256 << "," << (entry * 173) % 256 << "\n";
+  }
+  std::istringstream stream{ csv.str() };
+  YarnCatalog catalog;
+  REQUIRE_EQ(catalog.read(stream), errors::NONE);
+  std::vector<QColor> entries;
+  for (int index = 0; index < catalog.size(); ++index)
+  {
+    entries.push_back(QColor(catalog.color(index)));
+  }
+  for (QRgb color = 0; color < 0x1000000; color += 0x1f3d7)
+  {
+    CHECK_EQ(catalog.color(catalog.nearest(0xff000000u | color)), minDiff(QColor(0xff000000u | color), entries).rgb());
+  }
+}
+#endif
+
+#ifdef STIXELATOR_BENCHMARK
+#include <benchmark/benchmark.h>
+
+// runs single stages of a pixelator on synthetic input, reaching its private stage functions
+class PixelatorBenchmark
+{
+public:
+  // an in_stitchCount square chart from a gradient four times as large, in_colorCount colors, stixels of in_stitchWidth x in_stitchHeight
+  PixelatorBenchmark(unsigned in_stitchCount, unsigned in_colorCount, unsigned in_stitchWidth, unsigned in_stitchHeight, one_bit::DitherMode in_ditherMode)
+    : pixelator{}
+    , job{}
+  {
+    pixelator.setInputImage(gradient(4 * in_stitchCount));
+    pixelator.setStitchSizes(10, 10, in_stitchCount, in_stitchCount);
+    pixelator.setStitchColors(palette(in_colorCount));
+    job = pixelator.createJob();
+    job->stitchWidth = in_stitchWidth;
+    job->stitchHeight = in_stitchHeight;
+    job->ditherMode = in_ditherMode;
+    // the rows only count towards the progress, which never gets anywhere near a report
+    job->totalRows = std::numeric_limits<unsigned>::max();
+  }
+
+  static QImage gradient(unsigned in_size)
+  {
+    QImage result(in_size, in_size, QImage::Format_RGB32);
+    for (unsigned y = 0; y < in_size; ++y)
+    {
+      for (unsigned x = 0; x < in_size; ++x)
+      {
+        result.setPixel(x, y, qRgb(x * 255 / in_size, y * 255 / in_size, (x * y) % 256));
+      }
+    }
+    return result;
+  }
+
+  static std::vector<QColor> palette(unsigned in_colorCount)
+  {
+    // the blue channel alone keeps up to 256 colors distinct
+    std::vector<QColor> result;
+    for (unsigned color = 0; color < in_colorCount; ++color)
+    {
+      result.push_back(QColor(qRgb((color * 37) % 256, (color * 91) % 256, color % 256)));
+    }
+    return result;
+  }
+
+  QImage downsample() { return pixelator.downsample(*job); }
+  one_bit::StitchChart pixelate(const QImage& in_averages) { return pixelator.pixelate(*job, in_averages); }
+  QImage scalePixels(const one_bit::StitchChart& in_chart) { return pixelator.scalePixels(*job, in_chart); }
+  bool drawHelpers(QImage& io_result) { return pixelator.drawHelpers(*job, io_result); }
+
+private:
+  QtPixelator pixelator;
+  std::unique_ptr<QtPixelator::Job> job;
+};
+
+void BM_colorDistance(benchmark::State& state)
+{
+  const auto colors{ PixelatorBenchmark::palette(256) };
+  size_t pair{ 0 };
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(colorDistance(colors[pair % 256], colors[(pair * 7 + 3) % 256]));
+    ++pair;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_colorDistance);
+
+// range: palette size
+void BM_minDiff(benchmark::State& state)
+{
+  const auto palette{ PixelatorBenchmark::palette((unsigned)state.range(0)) };
+  const auto sources{ PixelatorBenchmark::palette(256) };
+  size_t source{ 0 };
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(minDiff(sources[(source++ * 13) % 256], palette));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_minDiff)->RangeMultiplier(4)->Range(2, 256);
+
+// ranges: stitches per side, palette size, dither mode
+void BM_pixelate(benchmark::State& state)
+{
+  PixelatorBenchmark bench((unsigned)state.range(0), (unsigned)state.range(1), 4, 4, (one_bit::DitherMode)state.range(2));
+  const QImage averages{ bench.downsample() };
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(bench.pixelate(averages));
+  }
+  state.SetItemsProcessed(state.iterations() * averages.width() * averages.height());
+}
+BENCHMARK(BM_pixelate)->ArgsProduct({ { 64, 256, 1024 }, { 2, 16, 256 }, { (int)one_bit::DitherMode::NONE, (int)one_bit::DitherMode::FLOYD_STEINBERG } })->Unit(benchmark::kMillisecond);
+
+// ranges: stitches per side, stixel width, stixel height
+void BM_scalePixels(benchmark::State& state)
+{
+  PixelatorBenchmark bench((unsigned)state.range(0), 16, (unsigned)state.range(1), (unsigned)state.range(2), one_bit::DitherMode::NONE);
+  const auto chart{ bench.pixelate(bench.downsample()) };
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(bench.scalePixels(chart));
+  }
+  state.SetItemsProcessed(state.iterations() * chart.stitchCount() * chart.rowCount());
+}
+BENCHMARK(BM_scalePixels)->ArgsProduct({ { 64, 256, 1024 }, { 2, 10 }, { 3, 10 } })->Unit(benchmark::kMillisecond);
+
+// ranges: stitches per side, stixel width, stixel height
+void BM_drawHelpers(benchmark::State& state)
+{
+  PixelatorBenchmark bench((unsigned)state.range(0), 16, (unsigned)state.range(1), (unsigned)state.range(2), one_bit::DitherMode::NONE);
+  const QImage stixels{ bench.scalePixels(bench.pixelate(bench.downsample())) };
+  for (auto _ : state)
+  {
+    // the grid goes onto a fresh copy each time, just like in a run
+    QImage result{ stixels };
+    benchmark::DoNotOptimize(bench.drawHelpers(result));
+  }
+  state.SetBytesProcessed(state.iterations() * stixels.sizeInBytes());
+}
+BENCHMARK(BM_drawHelpers)->ArgsProduct({ { 64, 256, 1024 }, { 2, 10 }, { 3, 10 } })->Unit(benchmark::kMillisecond);
+
+// ranges: stitches and rows per gauge, like the inputs of recomputeSizes()
+void BM_chart_geometry(benchmark::State& state)
+{
+  const unsigned stitches{ (unsigned)state.range(0) };
+  const unsigned rows{ (unsigned)state.range(1) };
+  unsigned offset{ 0 };
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(geometry::chart_geometry(50, 50, rows, stitches + offset % 4, geometry::Limits{ 64, 1ull << 28 }));
+    ++offset;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_chart_geometry)->ArgsProduct({ { 12, 22, 97 }, { 16, 30, 1009 } });
+
+BENCHMARK_MAIN();
 #endif
\ No newline at end of file
@@ -1,47 +1,206 @@
 #pragma once
 #include <QObject>
 #include <QImage>
+#include <QRect>
 #include <QUrl>
 #include <QColor>
+#include <QVariantList>
+#include <QString>
+#include "PaletteLookup.h"
+#include "StitchChart.h"
+#include "StixelRenderer.h"
+#include "setting_enums.h"
+#include "YarnCatalog.h"
+#include "geometry.h"
+#include "PipelineStats.h"
 
 #include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <optional>
 
 
 class QtPixelator : public QObject {
   Q_OBJECT
+#ifdef STIXELATOR_BENCHMARK
+  friend class PixelatorBenchmark;
+#endif
   Q_PROPERTY(QImage resultBuffer READ resultImage)
+  Q_PROPERTY(int progress READ progress NOTIFY progressChanged)
+  Q_PROPERTY(PipelineStats* stats READ stats CONSTANT)
 public:
   explicit QtPixelator (QObject* in_parent = nullptr);
+  ~QtPixelator();
+  // hands the current settings to the worker thread and returns right away, superseding any earlier run
   Q_INVOKABLE int run();
+  // same pipeline on the calling thread, for callers without an event loop or that need the result right away
+  Q_INVOKABLE int runSynchronously();
   Q_INVOKABLE int commit();
   Q_INVOKABLE int setInputImage(const QImage& in_image);
+  // pixelates in_region of in_image, sampling straight from its pixels. The image is shared, not copied.
+  Q_INVOKABLE int setInputRegion(const QImage& in_image, const QRect& in_region);
   Q_INVOKABLE int setStoragePath(const QUrl& in_url);
   Q_INVOKABLE int setStitchSizes(const int& in_width, const int& in_height, const int& in_rowsPerGauge, const int& in_stitchesPerGauge);
+  // largest stixel side and result pixel count the next setStitchSizes may choose, 0 leaves a limit open
+  Q_INVOKABLE int setStixelLimits(unsigned in_maxStixelSize, qulonglong in_maxPixels);
+  // results larger than in_bytes aren't kept as an image, commit renders them strip by strip straight into the file.
+  // A strip holds at least one stitch row, so a budget below one row still gets strips of one row. 0 keeps every result in memory.
+  Q_INVOKABLE int setMemoryBudget(qulonglong in_bytes);
   Q_INVOKABLE int setStitchColors(const std::vector<QColor> in_colors);
+  // any number of colors up to PaletteLookup::MAX_SIZE, e.g. a QML color array
+  Q_INVOKABLE int setStitchPalette(const QVariantList& in_colors);
+  // takes a one_bit::DitherMode value, NONE maps every stitch to the closest color
+  Q_INVOKABLE int setDitherMode(int in_mode);
   Q_INVOKABLE int setHelperSettings(bool gridEnabled, QColor primaryColor, QColor secondaryColor, unsigned gridCount);
+  // CSV file of yarn names and colors that proposed palettes can be snapped to
+  Q_INVOKABLE int setYarnCatalog(const QUrl& in_url);
+  // up to in_colorCount colors picked from the input image, optionally replaced by the closest distinct yarns
+  Q_INVOKABLE QVariantList proposePalette(int in_colorCount, bool in_snapToCatalog);
+  // catalog name of a yarn with exactly this color, empty if there is none
+  Q_INVOKABLE QString yarnName(const QColor& in_color) const;
 
   QImage resultImage() const;
+  // palette indices of the current result, one entry per stitch
+  one_bit::StitchChart stitchChart() const;
+  int progress() const;
+  // relative deviation of the stixels' aspect ratio from the stitch's, 0 unless the stixel limits forced an approximation
+  double aspectError() const;
+  // bytes of the result image the current stitch sizes lead to
+  qulonglong estimatedResultBytes() const;
+  PipelineStats* stats();
 signals:
   void pixelationCreated();
+  // the newest run failed with in_error, superseded runs are dropped without a signal
+  void pixelationFailed(int in_error);
+  void progressChanged(int in_percent);
 
 private:
-  void recomputeSizes(const int& in_width, const int& in_height, const int& in_rowsPerGauge, const int& in_stitchesPerGauge);
-  QImage pixelate();
-  bool scalePixels(const QImage& colorMap);
-  void drawHelpers();
+  // snapshot of everything a run depends on, so the setters never race with a running job
+  struct Job
+  {
+    unsigned generation;
+    QImage image;
+    QRect region;
+    unsigned stitchWidth;
+    unsigned stitchHeight;
+    unsigned stitchCount;
+    unsigned rowCount;
+    std::shared_ptr<PaletteLookup> palette;
+    std::vector<QRgb> paletteColors;
+    one_bit::DitherMode ditherMode;
+    QColor auxColorSec;
+    QColor auxColorPri;
+    unsigned helperGrid;
+    bool gridEnabled;
+    // stitch rows per strip if the result gets rendered on commit, 0 renders it right away
+    unsigned stripRows;
+    unsigned totalRows;
+    std::atomic<unsigned> finishedRows;
+    PipelineSample sample;
+  };
+
+  // settings each intermediate result depends on, a stage only reruns when its key changes
+  struct AveragesKey
+  {
+    qint64 image;
+    QRect region;
+    unsigned stitchCount;
+    unsigned rowCount;
+    bool operator==(const AveragesKey& in_other) const;
+  };
+  struct IndexKey
+  {
+    AveragesKey averages;
+    std::vector<QRgb> palette;
+    one_bit::DitherMode ditherMode;
+    bool operator==(const IndexKey& in_other) const;
+  };
+  struct StixelKey
+  {
+    IndexKey indices;
+    unsigned stitchWidth;
+    unsigned stitchHeight;
+    bool gridEnabled;
+    QRgb outlineColor;
+    bool operator==(const StixelKey& in_other) const;
+  };
+  // everything commit needs to render a result that was too large to keep
+  struct StripRendering
+  {
+    std::vector<QRgb> palette;
+    stixel_rendering::Layout layout;
+    QColor helperColor;
+    unsigned helperGrid;
+    unsigned stripRows;
+  };
+  // one published outcome, never modified once it's handed over, so readers share it instead of copying it
+  struct Result
+  {
+    // null if the result gets rendered in strips
+    QImage image;
+    one_bit::StitchChart chart;
+    StripRendering strips;
+  };
+
+  template<typename Key, typename Artifact>
+  struct CachedStage
+  {
+    std::optional<Key> key;
+    Artifact artifact;
+  };
+
+  bool recomputeSizes(const int& in_width, const int& in_height, const int& in_rowsPerGauge, const int& in_stitchesPerGauge);
+  std::unique_ptr<Job> createJob();
+  void workLoop();
+  int execute(Job& in_job);
+  void finishJob(unsigned in_generation, int in_result, const PipelineSample& in_sample);
+  bool superseded(const Job& in_job) const;
+  // counts a finished row towards the progress, returns false once the job has been superseded
+  bool rowFinished(Job& in_job);
+  QImage downsample(Job& in_job);
+  one_bit::StitchChart pixelate(Job& in_job, const QImage& in_averages);
+  QImage scalePixels(Job& in_job, const one_bit::StitchChart& in_chart);
+  bool drawHelpers(Job& in_job, QImage& io_result);
+  int exportStrips(const Result& in_result);
   int checkSettings();
 
   QImage imageBuffer;
-  QImage resultBuffer;
+  QRect imageRegion;
   QUrl sourcePath;
   QUrl storagePath;
   unsigned stitchWidth;
   unsigned stitchHeight;
   unsigned stitchCount;
   unsigned rowCount;
+  geometry::Limits stixelLimits;
+  double stixelAspectError;
+  qulonglong memoryBudget;
   std::vector<QColor> colors;
+  std::shared_ptr<PaletteLookup> paletteLookup;
+  one_bit::DitherMode ditherMode;
+  YarnCatalog yarnCatalog;
   QColor auxColorSec;
   QColor auxColorPri;
   unsigned helperGrid;
   bool gridEnabled;
+
+  std::mutex cacheMutex;
+  CachedStage<AveragesKey, QImage> averagesCache;
+  CachedStage<IndexKey, one_bit::StitchChart> indexCache;
+  CachedStage<StixelKey, QImage> stixelCache;
+
+  PipelineStats pipelineStats;
+  std::atomic<unsigned> generation;
+  std::atomic<int> progressPercent;
+  // guards the pointer only, the worker composes the next result beside it and swaps it in when complete
+  mutable std::mutex resultMutex;
+  std::shared_ptr<const Result> publishedResult;
+  std::mutex jobMutex;
+  std::condition_variable jobAvailable;
+  std::unique_ptr<Job> pendingJob;
+  bool stopping;
+  std::thread worker;
 };
\ No newline at end of file
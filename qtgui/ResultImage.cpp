@@ -3,52 +3,292 @@
 #include "logging.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <QMouseEvent>
+#include <QWheelEvent>
+#include <QQuickWindow>
+#include <QSGTransformNode>
+#include <QSGSimpleTextureNode>
+
+namespace
+{
+  std::vector<QRect> tileRects(const QSize& in_size, int in_tileSize);
+  bool tileChanged(const QImage& in_old, const QImage& in_new, const QRect& in_tile);
+  qreal axisOffset(qreal in_view, qreal in_content, qreal in_pan);
+
+  // edge length of a tile, small enough for any texture size limit
+  constexpr int tileSize{ 512 };
+  constexpr qreal maximumZoom{ 64. };
+  // zoom step per wheel notch
+  constexpr qreal zoomStep{ 1.25 };
+}
 
 ResultImage::ResultImage(QQuickItem* parent)
-: QQuickPaintedItem()
+: QQuickItem(parent)
 , image{}
+, dirtyTiles{}
+, tilesChanged{ true }
+, zoomFactor{ 1. }
+, pan{ 0, 0 }
+, lastMousePosition{}
 {
+  setFlag(ItemHasContents, true);
+  setClip(true);
+  setAcceptedMouseButtons(Qt::LeftButton);
 }
 
 void ResultImage::setData(const QImage& data)
 {
   if (data.isNull())
   {
-    logging::logger() << logging::Level::NOTE << "Input Image empty!" << logging::Level::OFF;
+    STIXELATOR_LOG(NOTE, "Input Image empty!");
   }
   else
   {
-    logging::logger() << logging::Level::DEBUG << "Setting Result Image" << logging::Level::OFF;
+    STIXELATOR_LOG(DEBUG, "Setting Result Image");
+  }
+  if (data.size() != image.size() || data.format() != image.format())
+  {
+    tilesChanged = true;
+    resetView();
+  }
+  else if (!tilesChanged)
+  {
+    const auto tiles{ tileRects(image.size(), tileSize) };
+    for (size_t tile = 0; tile < tiles.size(); ++tile)
+    {
+      if (!dirtyTiles[tile]) dirtyTiles[tile] = tileChanged(image, data, tiles[tile]);
+    }
   }
   image = data;
   if (image.isNull())
   {
-    logging::logger() << logging::Level::WARNING << "Result Image empty!" << logging::Level::OFF;
+    STIXELATOR_LOG(WARNING, "Result Image empty!");
   }
   else
   {
-    logging::logger() << logging::Level::DEBUG << "Set Result Image" << logging::Level::OFF;
+    STIXELATOR_LOG(DEBUG, "Set Result Image");
+  }
+  update();
+}
+
+QImage ResultImage::data() const
+{
+  return image;
+}
+
+qreal ResultImage::zoom() const
+{
+  return zoomFactor;
+}
+
+void ResultImage::setZoom(qreal in_zoom)
+{
+  zoomAround(QPointF(width() / 2, height() / 2), in_zoom);
+}
+
+void ResultImage::resetView()
+{
+  pan = { 0, 0 };
+  if (zoomFactor != 1.)
+  {
+    zoomFactor = 1.;
+    zoomChanged();
   }
   update();
 }
 
-void ResultImage::paint(QPainter* painter){
-  QRectF bounds = boundingRect();
-  if(image.isNull())
+QSGNode* ResultImage::updatePaintNode(QSGNode* in_oldNode, UpdatePaintNodeData*)
+{
+  auto* root{ static_cast<QSGTransformNode*>(in_oldNode) };
+  if (image.isNull())
   {
-    painter->fillRect(bounds, Qt::green);
-    return;
+    delete root;
+    tilesChanged = true;
+    return nullptr;
+  }
+  if (!root)
+  {
+    root = new QSGTransformNode;
+    tilesChanged = true;
+  }
+  const auto tiles{ tileRects(image.size(), tileSize) };
+  if (tilesChanged)
+  {
+    while (QSGNode* child = root->firstChild())
+    {
+      root->removeChildNode(child);
+      delete child;
+    }
+    for (const auto& tile : tiles)
+    {
+      auto* node{ new QSGSimpleTextureNode };
+      node->setOwnsTexture(true);
+      node->setRect(tile);
+      root->appendChildNode(node);
+    }
+    dirtyTiles.assign(tiles.size(), true);
+    tilesChanged = false;
   }
-  QImage scaled = image.scaledToWidth(bounds.width());
-  QPointF center = bounds.center() - scaled.rect().center();
 
-  if(center.x() < 0) center.setX(0);
-  if(center.y() < 0) center.setY(0);
-  painter->drawImage(center, scaled);
+  const qreal currentScale{ imageScale() };
+  // magnified stixels stay crisp, shrunk ones get smoothed
+  const auto filtering{ currentScale >= 1. ? QSGTexture::Nearest : QSGTexture::Linear };
+  size_t tile{ 0 };
+  for (QSGNode* child = root->firstChild(); child; child = child->nextSibling(), ++tile)
+  {
+    auto* node{ static_cast<QSGSimpleTextureNode*>(child) };
+    if (dirtyTiles[tile])
+    {
+      node->setTexture(window()->createTextureFromImage(tiles.size() == 1 ? image : image.copy(tiles[tile])));
+      dirtyTiles[tile] = false;
+    }
+    node->setFiltering(filtering);
+  }
+
+  QMatrix4x4 matrix;
+  matrix.translate(offset().x(), offset().y());
+  matrix.scale(currentScale);
+  root->setMatrix(matrix);
+  return root;
 }
 
-QImage ResultImage::data() const
+void ResultImage::geometryChanged(const QRectF& in_newGeometry, const QRectF& in_oldGeometry)
 {
-  return image;
-}
\ No newline at end of file
+  QQuickItem::geometryChanged(in_newGeometry, in_oldGeometry);
+  update();
+}
+
+void ResultImage::wheelEvent(QWheelEvent* in_event)
+{
+  const qreal notches{ in_event->angleDelta().y() / 120. };
+  zoomAround(in_event->position(), zoomFactor * std::pow(zoomStep, notches));
+  in_event->accept();
+}
+
+void ResultImage::mousePressEvent(QMouseEvent* in_event)
+{
+  lastMousePosition = in_event->localPos();
+  in_event->accept();
+}
+
+void ResultImage::mouseMoveEvent(QMouseEvent* in_event)
+{
+  moveTo(offset() + in_event->localPos() - lastMousePosition);
+  lastMousePosition = in_event->localPos();
+}
+
+void ResultImage::mouseDoubleClickEvent(QMouseEvent* in_event)
+{
+  resetView();
+  in_event->accept();
+}
+
+qreal ResultImage::imageScale() const
+{
+  if (image.isNull() || width() <= 0 || height() <= 0) return 1.;
+  return std::min(width() / image.width(), height() / image.height()) * zoomFactor;
+}
+
+QPointF ResultImage::offset() const
+{
+  const qreal currentScale{ imageScale() };
+  return QPointF(axisOffset(width(), image.width() * currentScale, pan.x()), axisOffset(height(), image.height() * currentScale, pan.y()));
+}
+
+void ResultImage::moveTo(const QPointF& in_offset)
+{
+  const qreal currentScale{ imageScale() };
+  const QPointF centered{ (width() - image.width() * currentScale) / 2, (height() - image.height() * currentScale) / 2 };
+  pan = in_offset - centered;
+  // whatever lies beyond the edges gets dropped, so panning back responds right away
+  pan = offset() - centered;
+  update();
+}
+
+void ResultImage::zoomAround(const QPointF& in_position, qreal in_zoom)
+{
+  const qreal zoom{ std::clamp(in_zoom, 1., maximumZoom) };
+  if (image.isNull() || zoom == zoomFactor) return;
+  // the image pixel under in_position stays there
+  const QPointF imagePosition{ (in_position - offset()) / imageScale() };
+  zoomFactor = zoom;
+  moveTo(in_position - imagePosition * imageScale());
+  zoomChanged();
+}
+
+namespace
+{
+  std::vector<QRect> tileRects(const QSize& in_size, int in_tileSize)
+  {
+    std::vector<QRect> result;
+    for (int y = 0; y < in_size.height(); y += in_tileSize)
+    {
+      for (int x = 0; x < in_size.width(); x += in_tileSize)
+      {
+        result.emplace_back(x, y, std::min(in_tileSize, in_size.width() - x), std::min(in_tileSize, in_size.height() - y));
+      }
+    }
+    return result;
+  }
+
+  bool tileChanged(const QImage& in_old, const QImage& in_new, const QRect& in_tile)
+  {
+    // the same buffer can't have changed
+    if (in_old.cacheKey() == in_new.cacheKey()) return false;
+    const int bytesPerPixel{ in_new.depth() / 8 };
+    for (int y = in_tile.top(); y <= in_tile.bottom(); ++y)
+    {
+      if (0 != std::memcmp(in_old.constScanLine(y) + in_tile.x() * bytesPerPixel, in_new.constScanLine(y) + in_tile.x() * bytesPerPixel, in_tile.width() * bytesPerPixel)) return true;
+    }
+    return false;
+  }
+
+  qreal axisOffset(qreal in_view, qreal in_content, qreal in_pan)
+  {
+    const qreal centered{ (in_view - in_content) / 2 };
+    // content smaller than the view stays centered, larger content always covers the whole view
+    if (in_content <= in_view) return centered;
+    return std::clamp(centered + in_pan, in_view - in_content, 0.);
+  }
+}
+
+#ifdef DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest.h>
+
+TEST_CASE("test tileRects") {
+  const auto tiles{ tileRects(QSize(1100, 512), 512) };
+  REQUIRE_EQ(tiles.size(), 3u);
+  CHECK_EQ(tiles[0], QRect(0, 0, 512, 512));
+  CHECK_EQ(tiles[1], QRect(512, 0, 512, 512));
+  CHECK_EQ(tiles[2], QRect(1024, 0, 76, 512));
+  CHECK_EQ(tileRects(QSize(100, 1030), 512).size(), 3u);
+  CHECK(tileRects(QSize(), 512).empty());
+}
+
+TEST_CASE("test tileChanged") {
+  QImage before(1100, 600, QImage::Format_RGB32);
+  before.fill(Qt::white);
+  QImage after{ before.copy() };
+  after.setPixel(1099, 599, qRgb(1, 2, 3));
+  const auto tiles{ tileRects(before.size(), 512) };
+  REQUIRE_EQ(tiles.size(), 6u);
+  for (size_t tile = 0; tile < tiles.size(); ++tile)
+  {
+    CHECK_EQ(tileChanged(before, after, tiles[tile]), tile == 5);
+    CHECK_FALSE(tileChanged(before, before, tiles[tile]));
+  }
+}
+
+TEST_CASE("test axisOffset") {
+  // smaller content is centered whatever the pan
+  CHECK_EQ(axisOffset(400, 200, 0), 100);
+  CHECK_EQ(axisOffset(400, 200, 150), 100);
+  // larger content can move until its edges reach the view's edges
+  CHECK_EQ(axisOffset(400, 800, 0), -200);
+  CHECK_EQ(axisOffset(400, 800, 150), -50);
+  CHECK_EQ(axisOffset(400, 800, 500), 0);
+  CHECK_EQ(axisOffset(400, 800, -500), -400);
+}
+#endif
\ No newline at end of file
@@ -1,18 +1,54 @@
 #pragma once
-#include <QQuickPaintedItem>
 #include <QQuickItem>
-#include <QPainter>
 #include <QImage>
+#include <QPointF>
+#include <vector>
 
-class ResultImage : public QQuickPaintedItem
+class QSGNode;
+
+// Shows the pixelation result as scene graph textures. The image is cut into tiles, which keeps large charts
+// below texture size limits and lets updates re-upload only the tiles that changed. Zooming and panning just
+// change the transform above the tiles.
+class ResultImage : public QQuickItem
 {
   Q_OBJECT
   Q_PROPERTY(QImage data READ data WRITE setData)
+  Q_PROPERTY(qreal zoom READ zoom WRITE setZoom NOTIFY zoomChanged)
 public:
   ResultImage(QQuickItem* parent = nullptr);
   Q_INVOKABLE void setData(const QImage& data);
-  void paint(QPainter* painter);
   QImage data() const;
+  // magnification on top of fitting the whole image into the item, 1 shows all of it
+  qreal zoom() const;
+  Q_INVOKABLE void setZoom(qreal in_zoom);
+  // whole image, centered
+  Q_INVOKABLE void resetView();
+
+signals:
+  void zoomChanged();
+
+protected:
+  QSGNode* updatePaintNode(QSGNode* in_oldNode, UpdatePaintNodeData* in_data) override;
+  void geometryChanged(const QRectF& in_newGeometry, const QRectF& in_oldGeometry) override;
+  void wheelEvent(QWheelEvent* in_event) override;
+  void mousePressEvent(QMouseEvent* in_event) override;
+  void mouseMoveEvent(QMouseEvent* in_event) override;
+  void mouseDoubleClickEvent(QMouseEvent* in_event) override;
+
 private:
+  // item pixels per image pixel
+  qreal imageScale() const;
+  // position of the image's top left corner on the item
+  QPointF offset() const;
+  void moveTo(const QPointF& in_offset);
+  void zoomAround(const QPointF& in_position, qreal in_zoom);
+
   QImage image;
-};
+  // tiles to upload with the next updatePaintNode(), all of them once the tile grid changed
+  std::vector<bool> dirtyTiles;
+  bool tilesChanged;
+  qreal zoomFactor;
+  // shift away from the centered position, in item pixels
+  QPointF pan;
+  QPointF lastMousePosition;
+};
\ No newline at end of file
@@ -0,0 +1,314 @@
+#include "ScanlineKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define ONE_BIT_X86_KERNELS
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define ONE_BIT_TARGET(isa) __attribute__((target(isa)))
+#else
+#define ONE_BIT_TARGET(isa)
+#endif
+
+namespace
+{
+  // QColor::getHsl reports whole degrees, so the cylinder angles come from a table instead of cos/sin per pixel
+  struct TrigTable
+  {
+    static constexpr int size{ 361 };
+    float cosine[size];
+    float sine[size];
+
+    TrigTable()
+    {
+      const double pi{ std::atan(1) * 4 };
+      for (int degrees = 0; degrees < size; ++degrees)
+      {
+        cosine[degrees] = (float)std::cos(pi * degrees / 180.);
+        sine[degrees] = (float)std::sin(pi * degrees / 180.);
+      }
+    }
+  };
+
+  const TrigTable& trigTable();
+  void nearestEntriesScalar(const scanline_kernels::CylinderPalette& in_palette, const QRgb* in_line, int in_count, int32_t* out_indices, float* out_margins);
+#ifdef ONE_BIT_X86_KERNELS
+  void nearestEntriesSse42(const scanline_kernels::CylinderPalette& in_palette, const QRgb* in_line, int in_count, int32_t* out_indices, float* out_margins);
+  void nearestEntriesAvx2(const scanline_kernels::CylinderPalette& in_palette, const QRgb* in_line, int in_count, int32_t* out_indices, float* out_margins);
+#endif
+}
+
+namespace scanline_kernels
+{
+  InstructionSet best_instruction_set()
+  {
+    static const InstructionSet detected = []() {
+      if (is_supported(InstructionSet::AVX2)) return InstructionSet::AVX2;
+      if (is_supported(InstructionSet::SSE42)) return InstructionSet::SSE42;
+      return InstructionSet::SCALAR;
+    }();
+    return detected;
+  }
+
+  bool is_supported(InstructionSet in_set)
+  {
+    switch (in_set)
+    {
+    case InstructionSet::SCALAR:
+      return true;
+#if defined(ONE_BIT_X86_KERNELS) && defined(_MSC_VER)
+    case InstructionSet::SSE42:
+    {
+      int info[4];
+      __cpuid(info, 1);
+      return (info[2] & (1 << 20)) != 0;
+    }
+    case InstructionSet::AVX2:
+    {
+      int info[4];
+      __cpuid(info, 1);
+      const bool osSavesYmm{ (info[2] & (1 << 27)) && ((_xgetbv(0) & 0x6) == 0x6) };
+      __cpuidex(info, 7, 0);
+      return osSavesYmm && (info[1] & (1 << 5)) != 0;
+    }
+#elif defined(ONE_BIT_X86_KERNELS)
+    case InstructionSet::SSE42:
+      return __builtin_cpu_supports("sse4.2");
+    case InstructionSet::AVX2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+    }
+  }
+
+  void nearest_entries(const CylinderPalette& in_palette, const QRgb* in_line, int in_count, int32_t* out_indices, float* out_margins)
+  {
+    nearest_entries(best_instruction_set(), in_palette, in_line, in_count, out_indices, out_margins);
+  }
+
+  void nearest_entries(InstructionSet in_set, const CylinderPalette& in_palette, const QRgb* in_line, int in_count, int32_t* out_indices, float* out_margins)
+  {
+    switch (is_supported(in_set) ? in_set : InstructionSet::SCALAR)
+    {
+#ifdef ONE_BIT_X86_KERNELS
+    case InstructionSet::AVX2:
+      nearestEntriesAvx2(in_palette, in_line, in_count, out_indices, out_margins);
+      break;
+    case InstructionSet::SSE42:
+      nearestEntriesSse42(in_palette, in_line, in_count, out_indices, out_margins);
+      break;
+#endif
+    default:
+      nearestEntriesScalar(in_palette, in_line, in_count, out_indices, out_margins);
+      break;
+    }
+  }
+}
+
+namespace
+{
+  const TrigTable& trigTable()
+  {
+    static const TrigTable table;
+    return table;
+  }
+
+  // follows QColor::toHsl/getHsl: 16 bit rounding of lightness, saturation and hue*100, then truncation to 8 bit and whole degrees
+  void nearestEntriesScalar(const scanline_kernels::CylinderPalette& in_palette, const QRgb* in_line, int in_count, int32_t* out_indices, float* out_margins)
+  {
+    const TrigTable& table{ trigTable() };
+    const int paletteSize{ (int)in_palette.rc.size() };
+    for (int x = 0; x < in_count; ++x)
+    {
+      const float red{ (float)qRed(in_line[x]) };
+      const float green{ (float)qGreen(in_line[x]) };
+      const float blue{ (float)qBlue(in_line[x]) };
+      const float maxComponent{ std::max(red, std::max(green, blue)) };
+      const float minComponent{ std::min(red, std::min(green, blue)) };
+      const float delta{ maxComponent - minComponent };
+      const float sum{ maxComponent + minComponent };
+
+      const float lightness{ std::floor(std::floor(sum * 128.5f + .5f) / 256.f) };
+      float rc{ 127.f };
+      float pl{ 127.f };
+      if (delta > 0.f)
+      {
+        const float ratio{ (sum < 255.f) ? delta / sum : delta / (510.f - sum) };
+        const float saturation{ std::floor(std::floor(ratio * 65535.f + .5f) / 256.f) };
+        float hue{ (red == maxComponent) ? (green - blue) / delta : (green == maxComponent) ? 2.f + (blue - red) / delta : 4.f + (red - green) / delta };
+        hue *= 60.f;
+        if (hue < 0.f) hue += 360.f;
+        const int degrees{ std::clamp((int)std::floor(std::floor(hue * 100.f + .5f) / 100.f), 0, TrigTable::size - 1) };
+        rc += table.cosine[degrees] * saturation * .5f;
+        pl += table.sine[degrees] * saturation * .5f;
+      }
+
+      float best{ std::numeric_limits<float>::infinity() };
+      float second{ std::numeric_limits<float>::infinity() };
+      int32_t bestIndex{ 0 };
+      for (int entry = 0; entry < paletteSize; ++entry)
+      {
+        const float drc{ rc - in_palette.rc[entry] };
+        const float dpl{ pl - in_palette.pl[entry] };
+        const float dv{ lightness - in_palette.v[entry] };
+        const float distance{ drc * drc + dpl * dpl + dv * dv };
+        if (distance < best)
+        {
+          second = best;
+          best = distance;
+          bestIndex = entry;
+        }
+        else if (distance < second)
+        {
+          second = distance;
+        }
+      }
+      out_indices[x] = bestIndex;
+      out_margins[x] = std::sqrt(second) - std::sqrt(best);
+    }
+  }
+
+#ifdef ONE_BIT_X86_KERNELS
+  ONE_BIT_TARGET("sse4.2")
+  void nearestEntriesSse42(const scanline_kernels::CylinderPalette& in_palette, const QRgb* in_line, int in_count, int32_t* out_indices, float* out_margins)
+  {
+    const TrigTable& table{ trigTable() };
+    const int paletteSize{ (int)in_palette.rc.size() };
+    const __m128i byteMask{ _mm_set1_epi32(0xff) };
+    const __m128 zero{ _mm_setzero_ps() };
+    const __m128 half{ _mm_set1_ps(.5f) };
+    const __m128 infinity{ _mm_set1_ps(std::numeric_limits<float>::infinity()) };
+    alignas(16) int32_t degrees[4];
+
+    int x = 0;
+    for (; x + 4 <= in_count; x += 4)
+    {
+      const __m128i pixels{ _mm_loadu_si128((const __m128i*)(in_line + x)) };
+      const __m128 red{ _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 16), byteMask)) };
+      const __m128 green{ _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 8), byteMask)) };
+      const __m128 blue{ _mm_cvtepi32_ps(_mm_and_si128(pixels, byteMask)) };
+      const __m128 maxComponent{ _mm_max_ps(red, _mm_max_ps(green, blue)) };
+      const __m128 minComponent{ _mm_min_ps(red, _mm_min_ps(green, blue)) };
+      const __m128 delta{ _mm_sub_ps(maxComponent, minComponent) };
+      const __m128 sum{ _mm_add_ps(maxComponent, minComponent) };
+
+      const __m128 lightness{ _mm_floor_ps(_mm_mul_ps(_mm_floor_ps(_mm_add_ps(_mm_mul_ps(sum, _mm_set1_ps(128.5f)), half)), _mm_set1_ps(1.f / 256.f))) };
+
+      const __m128 chromatic{ _mm_cmpgt_ps(delta, zero) };
+      const __m128 safeDelta{ _mm_blendv_ps(_mm_set1_ps(1.f), delta, chromatic) };
+      const __m128 denominator{ _mm_blendv_ps(_mm_sub_ps(_mm_set1_ps(510.f), sum), sum, _mm_cmplt_ps(sum, _mm_set1_ps(255.f))) };
+      const __m128 safeDenominator{ _mm_blendv_ps(_mm_set1_ps(1.f), denominator, chromatic) };
+      const __m128 ratio{ _mm_div_ps(delta, safeDenominator) };
+      const __m128 saturation{ _mm_and_ps(chromatic, _mm_floor_ps(_mm_mul_ps(_mm_floor_ps(_mm_add_ps(_mm_mul_ps(ratio, _mm_set1_ps(65535.f)), half)), _mm_set1_ps(1.f / 256.f)))) };
+
+      const __m128 hueRed{ _mm_div_ps(_mm_sub_ps(green, blue), safeDelta) };
+      const __m128 hueGreen{ _mm_add_ps(_mm_set1_ps(2.f), _mm_div_ps(_mm_sub_ps(blue, red), safeDelta)) };
+      const __m128 hueBlue{ _mm_add_ps(_mm_set1_ps(4.f), _mm_div_ps(_mm_sub_ps(red, green), safeDelta)) };
+      __m128 hue{ _mm_blendv_ps(_mm_blendv_ps(hueBlue, hueGreen, _mm_cmpeq_ps(green, maxComponent)), hueRed, _mm_cmpeq_ps(red, maxComponent)) };
+      hue = _mm_mul_ps(hue, _mm_set1_ps(60.f));
+      hue = _mm_add_ps(hue, _mm_and_ps(_mm_cmplt_ps(hue, zero), _mm_set1_ps(360.f)));
+      const __m128 wholeDegrees{ _mm_floor_ps(_mm_div_ps(_mm_floor_ps(_mm_add_ps(_mm_mul_ps(hue, _mm_set1_ps(100.f)), half)), _mm_set1_ps(100.f))) };
+      const __m128i degreeIndex{ _mm_min_epi32(_mm_max_epi32(_mm_cvttps_epi32(wholeDegrees), _mm_setzero_si128()), _mm_set1_epi32(TrigTable::size - 1)) };
+      _mm_store_si128((__m128i*)degrees, degreeIndex);
+      const __m128 cosine{ _mm_setr_ps(table.cosine[degrees[0]], table.cosine[degrees[1]], table.cosine[degrees[2]], table.cosine[degrees[3]]) };
+      const __m128 sine{ _mm_setr_ps(table.sine[degrees[0]], table.sine[degrees[1]], table.sine[degrees[2]], table.sine[degrees[3]]) };
+      const __m128 radius{ _mm_mul_ps(saturation, half) };
+      const __m128 rc{ _mm_add_ps(_mm_set1_ps(127.f), _mm_mul_ps(cosine, radius)) };
+      const __m128 pl{ _mm_add_ps(_mm_set1_ps(127.f), _mm_mul_ps(sine, radius)) };
+
+      __m128 best{ infinity };
+      __m128 second{ infinity };
+      __m128i bestIndex{ _mm_setzero_si128() };
+      for (int entry = 0; entry < paletteSize; ++entry)
+      {
+        const __m128 drc{ _mm_sub_ps(rc, _mm_set1_ps(in_palette.rc[entry])) };
+        const __m128 dpl{ _mm_sub_ps(pl, _mm_set1_ps(in_palette.pl[entry])) };
+        const __m128 dv{ _mm_sub_ps(lightness, _mm_set1_ps(in_palette.v[entry])) };
+        const __m128 distance{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(drc, drc), _mm_mul_ps(dpl, dpl)), _mm_mul_ps(dv, dv)) };
+        const __m128 closer{ _mm_cmplt_ps(distance, best) };
+        const __m128 runnerUp{ _mm_cmplt_ps(distance, second) };
+        second = _mm_blendv_ps(_mm_blendv_ps(second, distance, runnerUp), best, closer);
+        best = _mm_blendv_ps(best, distance, closer);
+        bestIndex = _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(bestIndex), _mm_castsi128_ps(_mm_set1_epi32(entry)), closer));
+      }
+      _mm_storeu_si128((__m128i*)(out_indices + x), bestIndex);
+      _mm_storeu_ps(out_margins + x, _mm_sub_ps(_mm_sqrt_ps(second), _mm_sqrt_ps(best)));
+    }
+    nearestEntriesScalar(in_palette, in_line + x, in_count - x, out_indices + x, out_margins + x);
+  }
+
+  ONE_BIT_TARGET("avx2")
+  void nearestEntriesAvx2(const scanline_kernels::CylinderPalette& in_palette, const QRgb* in_line, int in_count, int32_t* out_indices, float* out_margins)
+  {
+    const TrigTable& table{ trigTable() };
+    const int paletteSize{ (int)in_palette.rc.size() };
+    const __m256i byteMask{ _mm256_set1_epi32(0xff) };
+    const __m256 zero{ _mm256_setzero_ps() };
+    const __m256 half{ _mm256_set1_ps(.5f) };
+    const __m256 infinity{ _mm256_set1_ps(std::numeric_limits<float>::infinity()) };
+
+    int x = 0;
+    for (; x + 8 <= in_count; x += 8)
+    {
+      const __m256i pixels{ _mm256_loadu_si256((const __m256i*)(in_line + x)) };
+      const __m256 red{ _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pixels, 16), byteMask)) };
+      const __m256 green{ _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pixels, 8), byteMask)) };
+      const __m256 blue{ _mm256_cvtepi32_ps(_mm256_and_si256(pixels, byteMask)) };
+      const __m256 maxComponent{ _mm256_max_ps(red, _mm256_max_ps(green, blue)) };
+      const __m256 minComponent{ _mm256_min_ps(red, _mm256_min_ps(green, blue)) };
+      const __m256 delta{ _mm256_sub_ps(maxComponent, minComponent) };
+      const __m256 sum{ _mm256_add_ps(maxComponent, minComponent) };
+
+      const __m256 lightness{ _mm256_floor_ps(_mm256_mul_ps(_mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(sum, _mm256_set1_ps(128.5f)), half)), _mm256_set1_ps(1.f / 256.f))) };
+
+      const __m256 chromatic{ _mm256_cmp_ps(delta, zero, _CMP_GT_OQ) };
+      const __m256 safeDelta{ _mm256_blendv_ps(_mm256_set1_ps(1.f), delta, chromatic) };
+      const __m256 denominator{ _mm256_blendv_ps(_mm256_sub_ps(_mm256_set1_ps(510.f), sum), sum, _mm256_cmp_ps(sum, _mm256_set1_ps(255.f), _CMP_LT_OQ)) };
+      const __m256 safeDenominator{ _mm256_blendv_ps(_mm256_set1_ps(1.f), denominator, chromatic) };
+      const __m256 ratio{ _mm256_div_ps(delta, safeDenominator) };
+      const __m256 saturation{ _mm256_and_ps(chromatic, _mm256_floor_ps(_mm256_mul_ps(_mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(ratio, _mm256_set1_ps(65535.f)), half)), _mm256_set1_ps(1.f / 256.f)))) };
+
+      const __m256 hueRed{ _mm256_div_ps(_mm256_sub_ps(green, blue), safeDelta) };
+      const __m256 hueGreen{ _mm256_add_ps(_mm256_set1_ps(2.f), _mm256_div_ps(_mm256_sub_ps(blue, red), safeDelta)) };
+      const __m256 hueBlue{ _mm256_add_ps(_mm256_set1_ps(4.f), _mm256_div_ps(_mm256_sub_ps(red, green), safeDelta)) };
+      __m256 hue{ _mm256_blendv_ps(_mm256_blendv_ps(hueBlue, hueGreen, _mm256_cmp_ps(green, maxComponent, _CMP_EQ_OQ)), hueRed, _mm256_cmp_ps(red, maxComponent, _CMP_EQ_OQ)) };
+      hue = _mm256_mul_ps(hue, _mm256_set1_ps(60.f));
+      hue = _mm256_add_ps(hue, _mm256_and_ps(_mm256_cmp_ps(hue, zero, _CMP_LT_OQ), _mm256_set1_ps(360.f)));
+      const __m256 wholeDegrees{ _mm256_floor_ps(_mm256_div_ps(_mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(hue, _mm256_set1_ps(100.f)), half)), _mm256_set1_ps(100.f))) };
+      const __m256i degreeIndex{ _mm256_min_epi32(_mm256_max_epi32(_mm256_cvttps_epi32(wholeDegrees), _mm256_setzero_si256()), _mm256_set1_epi32(TrigTable::size - 1)) };
+      const __m256 cosine{ _mm256_i32gather_ps(table.cosine, degreeIndex, 4) };
+      const __m256 sine{ _mm256_i32gather_ps(table.sine, degreeIndex, 4) };
+      const __m256 radius{ _mm256_mul_ps(saturation, half) };
+      const __m256 rc{ _mm256_add_ps(_mm256_set1_ps(127.f), _mm256_mul_ps(cosine, radius)) };
+      const __m256 pl{ _mm256_add_ps(_mm256_set1_ps(127.f), _mm256_mul_ps(sine, radius)) };
+
+      __m256 best{ infinity };
+      __m256 second{ infinity };
+      __m256i bestIndex{ _mm256_setzero_si256() };
+      for (int entry = 0; entry < paletteSize; ++entry)
+      {
+        const __m256 drc{ _mm256_sub_ps(rc, _mm256_set1_ps(in_palette.rc[entry])) };
+        const __m256 dpl{ _mm256_sub_ps(pl, _mm256_set1_ps(in_palette.pl[entry])) };
+        const __m256 dv{ _mm256_sub_ps(lightness, _mm256_set1_ps(in_palette.v[entry])) };
+        const __m256 distance{ _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(drc, drc), _mm256_mul_ps(dpl, dpl)), _mm256_mul_ps(dv, dv)) };
+        const __m256 closer{ _mm256_cmp_ps(distance, best, _CMP_LT_OQ) };
+        const __m256 runnerUp{ _mm256_cmp_ps(distance, second, _CMP_LT_OQ) };
+        second = _mm256_blendv_ps(_mm256_blendv_ps(second, distance, runnerUp), best, closer);
+        best = _mm256_blendv_ps(best, distance, closer);
+        bestIndex = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(bestIndex), _mm256_castsi256_ps(_mm256_set1_epi32(entry)), closer));
+      }
+      _mm256_storeu_si256((__m256i*)(out_indices + x), bestIndex);
+      _mm256_storeu_ps(out_margins + x, _mm256_sub_ps(_mm256_sqrt_ps(second), _mm256_sqrt_ps(best)));
+    }
+    nearestEntriesScalar(in_palette, in_line + x, in_count - x, out_indices + x, out_margins + x);
+  }
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+#include <QColor>
+#include <vector>
+#include <cstdint>
+
+namespace scanline_kernels
+{
+  enum class InstructionSet
+  {
+    SCALAR,
+    SSE42,
+    AVX2,
+  };
+
+  // palette entries in single precision HSL cylinder coordinates, one array per axis
+  struct CylinderPalette
+  {
+    std::vector<float> rc;
+    std::vector<float> pl;
+    std::vector<float> v;
+  };
+
+  // bound for the distance error of the single precision conversion compared to QColor::getHsl, which may be
+  // off by one in each of hue, saturation and lightness. Gaps to the runner-up below twice this value have to
+  // be re-checked in double precision.
+  constexpr float conversionTolerance{ 3.f };
+
+  InstructionSet best_instruction_set();
+  bool is_supported(InstructionSet in_set);
+
+  // maps in_count pixels to the palette entry closest in the HSL cylinder and stores the distance gap to the
+  // second closest entry in out_margins (infinity for single entry palettes). in_palette must not be empty.
+  void nearest_entries(const CylinderPalette& in_palette, const QRgb* in_line, int in_count, int32_t* out_indices, float* out_margins);
+  void nearest_entries(InstructionSet in_set, const CylinderPalette& in_palette, const QRgb* in_line, int in_count, int32_t* out_indices, float* out_margins);
+}
\ No newline at end of file
@@ -1,9 +1,15 @@
 #include "SourceImage.h"
 
 #include "logging.h"
+#include "AreaDownsampler.h"
+#include "tracing.h"
 
 #include <algorithm>
+#include <cmath>
 #include <QMouseEvent>
+#include <QImageReader>
+#include <QGuiApplication>
+#include <QScreen>
 
 namespace
 {
@@ -12,30 +18,55 @@ namespace
   void adjustToAspectRatio(const QPointF& topLeft, QPointF& bottomRight, double targetAspectRatio, qreal paintedWidth, qreal paintedHeight);
   QString pointsToClippingInfo(const QPointF& topLeft, const QPointF& bottomRight);
   void scalePoint(const QPointF& source, QPoint& target, qreal scalingFactor);
+  QSize previewSize(const QSize& in_sourceSize, const QSize& in_displaySize, int in_stitchCount);
+  QSize fittedSize(const QSize& in_imageSize, const QSizeF& in_bounds);
+  std::vector<QImage> mipmapLevels(const QImage& in_image);
+  const QImage& nearestLevel(const std::vector<QImage>& in_levels, const QSize& in_size);
+
+  // source pixels per stitch kept in the preview, enough for the area average to match the full image closely
+  constexpr int previewPixelsPerStitch{ 4 };
+  // mipmaps stop halving below this size
+  constexpr int smallestMipmap{ 32 };
+  // drag previews get published at most this often
+  constexpr int previewIntervalMs{ 100 };
 }
 
 SourceImage::SourceImage(QQuickItem* parent)
 : QQuickPaintedItem()
 , filePath{}
+, sourceSize{}
+, stitchCount{ 0 }
 , resultSize{}
 , clipTopLeft{}
 , clipBottomRight{}
 , image{}
+, mipmaps{}
+, fittedImage{}
 , topLeft{ 0, 0 }
 , bottomRight{ 0, 0 }
 , newStartingPoint{ -1, -1 }
 , newTopLeft{ -1, -1 }
 , newBottomRight{ -1, -1 }
 , abort{ false }
+, previewTimer{}
+, publishedImage{ 0 }
+, publishedSize{}
+, publishedClip{}
 {
   logging::logger().setLogLevel(logging::Level::NOTE);
   setAcceptedMouseButtons(Qt::AllButtons);
+  previewTimer.setSingleShot(true);
+  previewTimer.setInterval(previewIntervalMs);
+  connect(&previewTimer, &QTimer::timeout, this, [this]() {
+    if (newStartingPoint.x() < 0 || abort) return;
+    previewDataChanged();
+  });
 }
 
 void SourceImage::mousePressEvent(QMouseEvent* theEvent)
 {
   newStartingPoint = { theEvent->localPos().x(), theEvent->localPos().y() };
-  logging::logger() << logging::Level::DEBUG << "MousePress: top left is " << newTopLeft.x() << ", " << newTopLeft.y() << logging::Level::OFF;
+  STIXELATOR_LOG(DEBUG, "MousePress: top left is " << newTopLeft.x() << ", " << newTopLeft.y());
 }
 
 void SourceImage::mouseMoveEvent(QMouseEvent* theEvent)
@@ -43,7 +74,7 @@ void SourceImage::mouseMoveEvent(QMouseEvent* theEvent)
   if (theEvent->buttons() & Qt::MouseButton::LeftButton)
   {
     QRectF bounds = boundingRect();
-    logging::logger() << logging::Level::DEBUG << "MouseMove: boundingRect " << bounds.width() << ", " << bounds.height() << logging::Level::OFF;
+    STIXELATOR_LOG(DEBUG, "MouseMove: boundingRect " << bounds.width() << ", " << bounds.height());
     QPointF tl = { boundedMin(newStartingPoint.x(), theEvent->localPos().x(), 0), boundedMin(newStartingPoint.y(), theEvent->localPos().y(), 0) };
     QPointF br = { boundedMax(newStartingPoint.x(), theEvent->localPos().x(), bounds.width() - 1), boundedMax(newStartingPoint.y(), theEvent->localPos().y(), bounds.height() - 1) };
     newTopLeft = tl;
@@ -51,17 +82,22 @@ void SourceImage::mouseMoveEvent(QMouseEvent* theEvent)
     abort = (theEvent->buttons() & Qt::MouseButton::RightButton);
     if (! abort)
     {
-      logging::logger() << logging::Level::DEBUG << "MouseMove: top left is " << newTopLeft.x() << ", " << newTopLeft.y() << ", bottom right is " << newBottomRight.x() << ", " << newBottomRight.y() << logging::Level::OFF;
+      STIXELATOR_LOG(DEBUG, "MouseMove: top left is " << newTopLeft.x() << ", " << newTopLeft.y() << ", bottom right is " << newBottomRight.x() << ", " << newBottomRight.y());
       update();
+      // the first move of a burst starts the timer, the ones until it fires share its preview
+      if (!previewTimer.isActive()) previewTimer.start();
     }
   }
 }
 
 void SourceImage::mouseReleaseEvent(QMouseEvent* theEvent)
 {
+  // the selection itself gets published by the next paint, replacing the preview even if it didn't change
+  previewTimer.stop();
+  if (newTopLeft.x() >= 0) publishedClip = QRect{};
   if (abort)
   {
-    logging::logger() << logging::Level::NOTE << "MouseRelease (aborted)" << logging::Level::OFF;
+    STIXELATOR_LOG(NOTE, "MouseRelease (aborted)");
   }
   else
   {
@@ -71,47 +107,100 @@ void SourceImage::mouseReleaseEvent(QMouseEvent* theEvent)
     topLeft = tl;
     bottomRight = br;
 
-    logging::logger() << logging::Level::NOTE << "MouseRelease: top left is " << topLeft.x() << ", " << topLeft.y() << ", bottom right is " << bottomRight.x() << ", " << bottomRight.y() << logging::Level::OFF;
+    STIXELATOR_LOG(NOTE, "MouseRelease: top left is " << topLeft.x() << ", " << topLeft.y() << ", bottom right is " << bottomRight.x() << ", " << bottomRight.y());
   }
   newStartingPoint = { -1, -1 };
   newTopLeft = { -1, -1 };
   newBottomRight = { -1, -1 };
   update(); // triggers paint(...)
-  logging::logger() << logging::Level::NOTE << "Clipping to (" << clipTopLeft.x() << ", " << clipTopLeft.y() << ")/(" << clipBottomRight.x() << ", " << clipBottomRight.y() << ")" << logging::Level::OFF;
-  logging::logger() << logging::Level::NOTE << "Based on (" << topLeft.x() << ", " << topLeft.y() << ")/(" << bottomRight.x() << ", " << bottomRight.y() << ")" << logging::Level::OFF;
+  STIXELATOR_LOG(NOTE, "Clipping to (" << clipTopLeft.x() << ", " << clipTopLeft.y() << ")/(" << clipBottomRight.x() << ", " << clipBottomRight.y() << ")");
+  STIXELATOR_LOG(NOTE, "Based on (" << topLeft.x() << ", " << topLeft.y() << ")/(" << bottomRight.x() << ", " << bottomRight.y() << ")");
 }
 
 void SourceImage::setPath(const QUrl& data)
 {
   filePath = data;
-  image.load(data.toLocalFile());
+  decodePreview();
   const std::string fileQuality{ image.isNull() ? "empty " : "" };
-  logging::logger() << logging::Level::NOTE << "Loaded a new " << fileQuality << "file" << logging::Level::OFF;
+  STIXELATOR_LOG(NOTE, "Loaded a new " << fileQuality << "file");
   topLeft = { 0, 0 };
   QRectF bounds = boundingRect();
   bottomRight = { bounds.width() - 1, bounds.height() - 1 };
   newTopLeft = { -1, -1 };
   newBottomRight = { -1, -1 };
   clipTopLeft = { 0, 0 };
-  clipBottomRight = { image.width() - 1, image.height() - 1 };
-  logging::logger() << logging::Level::NOTE << "File Size is " << image.width() << "x" << image.height() << logging::Level::OFF;
+  clipBottomRight = { sourceSize.width() - 1, sourceSize.height() - 1 };
+  STIXELATOR_LOG(NOTE, "File Size is " << sourceSize.width() << "x" << sourceSize.height() << ", preview uses " << image.width() << "x" << image.height());
   update(); // triggers paint(...)
 }
 
+void SourceImage::decodePreview()
+{
+  tracing::Span span{ "decodePreview" };
+  QImageReader reader{ filePath.toLocalFile() };
+  const QScreen* screen{ QGuiApplication::primaryScreen() };
+  const QSize displaySize{ screen ? screen->size() * screen->devicePixelRatio() : QSize(1920, 1080) };
+  sourceSize = reader.size();
+  if (sourceSize.isValid())
+  {
+    // formats like JPEG decode straight to the smaller size, without ever holding the full image
+    const QSize decodeSize{ previewSize(sourceSize, displaySize, stitchCount) };
+    if (decodeSize != sourceSize) reader.setScaledSize(decodeSize);
+    image = reader.read();
+  }
+  else
+  {
+    // formats that can't tell their size up front get decoded in full once
+    image = reader.read();
+    sourceSize = image.size();
+    const QSize decodeSize{ previewSize(sourceSize, displaySize, stitchCount) };
+    if (!image.isNull() && decodeSize != sourceSize)
+    {
+      image = image.scaled(decodeSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+  }
+  span.setBytes(image.sizeInBytes());
+  mipmaps = mipmapLevels(image);
+  fittedImage = QImage{};
+}
+
+const QImage& SourceImage::fitted(const QSizeF& in_bounds) const
+{
+  const QSize size{ fittedSize(image.size(), in_bounds) };
+  if (fittedImage.size() != size)
+  {
+    const QImage& level{ nearestLevel(mipmaps, size) };
+    fittedImage = (level.size() == size) ? level : downsampling::area_average(level, size);
+  }
+  return fittedImage;
+}
+
 void SourceImage::setResultWidth(const int& width)
 {
-  logging::logger() << logging::Level::NOTE << "new width: " << width << logging::Level::OFF;
+  STIXELATOR_LOG(NOTE, "new width: " << width);
   resultSize.setX(width);
   update(); // triggers paint(...)
 }
 
 void SourceImage::setResultHeight(const int& height)
 {
-  logging::logger() << logging::Level::NOTE << "new height: " << height << logging::Level::OFF;
+  STIXELATOR_LOG(NOTE, "new height: " << height);
   resultSize.setY(height);
   update(); // triggers paint(...)
 }
 
+void SourceImage::setStitchCount(const int& count)
+{
+  stitchCount = count;
+  // more stitches than the preview resolves, decode again at a higher resolution
+  if (!image.isNull() && image.width() < sourceSize.width() && image.width() < count * previewPixelsPerStitch)
+  {
+    decodePreview();
+    STIXELATOR_LOG(NOTE, "Preview now uses " << image.width() << "x" << image.height());
+    update(); // triggers paint(...)
+  }
+}
+
 void SourceImage::paint(QPainter* painter) {
   QRectF bounds = boundingRect();
   if (image.isNull())
@@ -119,11 +208,8 @@ void SourceImage::paint(QPainter* painter) {
     painter->fillRect(bounds, Qt::white);
     return;
   }
-  QImage scaled = image.scaledToWidth(bounds.width());
-  if (scaled.height() > bounds.height())
-  {
-    scaled = image.scaledToHeight(bounds.height());
-  }
+  // while dragging, the bounds stay the same and this is just a blit of the cached image
+  const QImage& scaled = fitted(bounds.size());
   QPointF center = bounds.center() - scaled.rect().center();
 
   if (center.x() < 0)
@@ -140,25 +226,66 @@ void SourceImage::paint(QPainter* painter) {
   painter->drawRect(newTopLeft.x(), newTopLeft.y(), newBottomRight.x() - newTopLeft.x(), newBottomRight.y() - newTopLeft.y());
 
   newClipping();
+  // during a drag only previews get published, the selection follows on release
+  if (newStartingPoint.x() < 0) publishSelection(scaled.size());
+}
+
+void SourceImage::publishSelection(const QSize& in_fittedSize)
+{
+  const QRect clip{ clipTopLeft, clipBottomRight };
+  if (image.cacheKey() == publishedImage && in_fittedSize == publishedSize && clip == publishedClip) return;
+  publishedImage = image.cacheKey();
+  publishedSize = in_fittedSize;
+  publishedClip = clip;
   dataChanged();
 }
 
 QImage SourceImage::data() const
 {
-  QRectF bounds = boundingRect();
-  QImage scaled = image.scaledToWidth(bounds.width());
-  if (scaled.height() > bounds.height())
-  {
-    scaled = image.scaledToHeight(bounds.height());
-  }
-  auto returnValue{ scaled.copy(QRectF(topLeft, bottomRight).toRect()) };
-  logging::logger() << logging::Level::DEBUG << "Clipping to (" << clipTopLeft.x() << ", " << clipTopLeft.y() << ")/(" << clipBottomRight.x() << ", " << clipBottomRight.y() << ")" << logging::Level::OFF;
+  auto returnValue{ image.isNull() ? QImage{} : image.copy(sourceRegion()) };
+  STIXELATOR_LOG(DEBUG, "Clipping to (" << clipTopLeft.x() << ", " << clipTopLeft.y() << ")/(" << clipBottomRight.x() << ", " << clipBottomRight.y() << ")");
   const std::string outputIsValid{ returnValue.isNull() ? "empty " : "" };
   const std::string inputIsValid{ image.isNull() ? "empty " : "" };
-  logging::logger() << logging::Level::DEBUG << "Returning " << outputIsValid << "file copied from " << inputIsValid << "input" << logging::Level::OFF;
+  STIXELATOR_LOG(DEBUG, "Returning " << outputIsValid << "file copied from " << inputIsValid << "input");
   return returnValue;
 }
 
+QImage SourceImage::fullResolutionData() const
+{
+  QImageReader reader{ filePath.toLocalFile() };
+  // the reader skips decoding most of what lies outside the region where the format allows it
+  reader.setClipRect(QRect(clipTopLeft, clipBottomRight).intersected(QRect(QPoint(0, 0), sourceSize)));
+  tracing::Span span{ "fullResolutionData" };
+  auto returnValue{ reader.read() };
+  span.setBytes(returnValue.sizeInBytes());
+  STIXELATOR_LOG(DEBUG, "Decoded " << returnValue.width() << "x" << returnValue.height() << " at full resolution");
+  return returnValue;
+}
+
+QImage SourceImage::sourceData() const
+{
+  return image;
+}
+
+QRect SourceImage::sourceRegion() const
+{
+  return toSourceRegion(topLeft, bottomRight);
+}
+
+QRect SourceImage::dragRegion() const
+{
+  if (newTopLeft.x() < 0) return sourceRegion();
+  return toSourceRegion(newTopLeft, newBottomRight);
+}
+
+QRect SourceImage::toSourceRegion(const QPointF& in_topLeft, const QPointF& in_bottomRight) const
+{
+  if (image.isNull()) return QRect{};
+  const QSize paintedSize{ fittedSize(image.size(), boundingRect().size()) };
+  const qreal scaling{ 1. * image.width() / paintedSize.width() };
+  return QRectF(in_topLeft * scaling, in_bottomRight * scaling).toRect().intersected(image.rect());
+}
+
 int SourceImage::clipWidth() const
 {
   return clipBottomRight.x() - clipTopLeft.x();
@@ -195,7 +322,8 @@ void SourceImage::normalizeLocations(qreal paintedWidth, qreal paintedHeight)
   adjustToAspectRatio(topLeft, bottomRight, definedAspectRatio, paintedWidth, paintedHeight);
   adjustToAspectRatio(newTopLeft, newBottomRight, definedAspectRatio, paintedWidth, paintedHeight);
 
-  qreal scaling{ image.width() / paintedWidth };
+  // clipping coordinates refer to the file, not to the preview
+  qreal scaling{ sourceSize.width() / paintedWidth };
   scalePoint(topLeft, clipTopLeft, scaling);
   scalePoint(bottomRight, clipBottomRight, scaling);
   scalePoint(newTopLeft, newClipTopLeft, scaling);
@@ -282,10 +410,60 @@ namespace
     target.setX(source.x() * scalingFactor);
     target.setY(source.y() * scalingFactor);
   }
+
+  QSize previewSize(const QSize& in_sourceSize, const QSize& in_displaySize, int in_stitchCount)
+  {
+    if (in_sourceSize.isEmpty()) return in_sourceSize;
+    // fills the display in at least one direction, and covers each stitch with a few pixels
+    const double displayScale{ std::min(1. * in_displaySize.width() / in_sourceSize.width(), 1. * in_displaySize.height() / in_sourceSize.height()) };
+    const double stitchScale{ 1. * in_stitchCount * previewPixelsPerStitch / in_sourceSize.width() };
+    const double scale{ std::max(displayScale, stitchScale) };
+    if (scale >= 1.) return in_sourceSize;
+    return QSize(std::max(1, (int)std::ceil(scale * in_sourceSize.width())), std::max(1, (int)std::ceil(scale * in_sourceSize.height())));
+  }
+
+  QSize fittedSize(const QSize& in_imageSize, const QSizeF& in_bounds)
+  {
+    if (in_imageSize.isEmpty()) return QSize{};
+    // full width, unless that makes the image too high
+    int width{ std::max(1, (int)in_bounds.width()) };
+    int height{ std::max(1, (int)std::lround(1. * in_imageSize.height() * width / in_imageSize.width())) };
+    if (height > in_bounds.height())
+    {
+      height = std::max(1, (int)in_bounds.height());
+      width = std::max(1, (int)std::lround(1. * in_imageSize.width() * height / in_imageSize.height()));
+    }
+    return QSize(width, height);
+  }
+
+  std::vector<QImage> mipmapLevels(const QImage& in_image)
+  {
+    tracing::Span span{ "mipmapLevels", (unsigned long long)in_image.sizeInBytes() };
+    std::vector<QImage> result;
+    if (in_image.isNull()) return result;
+    result.push_back(in_image);
+    while (result.back().width() / 2 >= smallestMipmap && result.back().height() / 2 >= smallestMipmap)
+    {
+      const QImage& previous{ result.back() };
+      result.push_back(downsampling::area_average(previous, QSize(previous.width() / 2, previous.height() / 2)));
+    }
+    return result;
+  }
+
+  const QImage& nearestLevel(const std::vector<QImage>& in_levels, const QSize& in_size)
+  {
+    // the smallest level that still has enough pixels, the full preview for anything larger
+    auto level{ in_levels.rbegin() };
+    while (level != in_levels.rend() && (level->width() < in_size.width() || level->height() < in_size.height())) ++level;
+    return (level == in_levels.rend()) ? in_levels.front() : *level;
+  }
 }
 
 #ifdef DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest.h>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
 
 TEST_CASE("test boundedMin") {
   CHECK_EQ(boundedMin(1, 2, 3), 3);
@@ -329,4 +507,106 @@ TEST_CASE("test scalePoint") {
   CHECK_EQ(target.x(), 20);
   CHECK_EQ(target.x(), 20);
 }
+TEST_CASE("test previewSize") {
+  // large photos shrink to the display
+  CHECK_EQ(previewSize(QSize(8000, 6000), QSize(1920, 1080), 100), QSize(1440, 1080));
+  CHECK_EQ(previewSize(QSize(6000, 8000), QSize(1920, 1080), 100), QSize(810, 1080));
+  // unless the stitches need more pixels
+  CHECK_EQ(previewSize(QSize(8000, 6000), QSize(1920, 1080), 500), QSize(2000, 1500));
+  // never above the source size
+  CHECK_EQ(previewSize(QSize(1000, 800), QSize(1920, 1080), 100), QSize(1000, 800));
+  CHECK_EQ(previewSize(QSize(8000, 6000), QSize(1920, 1080), 4000), QSize(8000, 6000));
+  CHECK_EQ(previewSize(QSize(), QSize(1920, 1080), 100), QSize());
+}
+TEST_CASE("test fittedSize") {
+  CHECK_EQ(fittedSize(QSize(800, 600), QSizeF(400, 400)), QSize(400, 300));
+  CHECK_EQ(fittedSize(QSize(600, 800), QSizeF(400, 400)), QSize(300, 400));
+  CHECK_EQ(fittedSize(QSize(600, 800), QSizeF(300.7, 400)), QSize(300, 400));
+  // the fitted size fits itself
+  CHECK_EQ(fittedSize(QSize(1000, 333), fittedSize(QSize(1000, 333), QSizeF(457, 400))), QSize(457, 152));
+  CHECK_EQ(fittedSize(QSize(), QSizeF(400, 400)), QSize());
+}
+
+TEST_CASE("test mipmap levels") {
+  QImage preview(500, 130, QImage::Format_RGB32);
+  preview.fill(qRgb(10, 20, 30));
+  const auto levels{ mipmapLevels(preview) };
+  REQUIRE_EQ(levels.size(), 3u);
+  CHECK_EQ(levels[1].size(), QSize(250, 65));
+  CHECK_EQ(levels[2].size(), QSize(125, 32));
+  CHECK_EQ(levels[2].pixel(7, 7), qRgb(10, 20, 30));
+  CHECK(mipmapLevels(QImage{}).empty());
+
+  CHECK_EQ(nearestLevel(levels, QSize(100, 26)).size(), QSize(125, 32));
+  CHECK_EQ(nearestLevel(levels, QSize(126, 20)).size(), QSize(250, 65));
+  CHECK_EQ(nearestLevel(levels, QSize(250, 65)).size(), QSize(250, 65));
+  CHECK_EQ(nearestLevel(levels, QSize(900, 200)).size(), QSize(500, 130));
+}
+
+namespace
+{
+  // makes the mouse handlers callable without a window delivering events
+  struct DraggedImage : SourceImage
+  {
+    using SourceImage::mousePressEvent;
+    using SourceImage::mouseMoveEvent;
+    using SourceImage::mouseReleaseEvent;
+  };
+
+  void wait(QCoreApplication& io_app, int in_milliseconds)
+  {
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.elapsed() < in_milliseconds)
+    {
+      io_app.processEvents(QEventLoop::AllEvents, 10);
+    }
+  }
+}
+
+TEST_CASE("test a drag only publishes previews until it ends") {
+  int argc{ 0 };
+  QCoreApplication app(argc, nullptr);
+  QTemporaryDir directory;
+  REQUIRE(directory.isValid());
+  const QString path{ directory.filePath("source.png") };
+  QImage source(400, 200, QImage::Format_RGB32);
+  source.fill(qRgb(60, 120, 180));
+  REQUIRE(source.save(path));
+
+  DraggedImage item;
+  item.setSize(QSizeF(200, 100));
+  item.setPath(QUrl::fromLocalFile(path));
+  QImage canvas(200, 100, QImage::Format_ARGB32);
+  QPainter painter(&canvas);
+  item.paint(&painter);
+
+  unsigned selections{ 0 };
+  unsigned previews{ 0 };
+  QObject::connect(&item, &SourceImage::dataChanged, [&selections]() { ++selections; });
+  QObject::connect(&item, &SourceImage::previewDataChanged, [&previews]() { ++previews; });
+
+  QMouseEvent press(QEvent::MouseButtonPress, QPointF(10, 10), Qt::LeftButton, Qt::LeftButton, Qt::NoModifier);
+  item.mousePressEvent(&press);
+  for (const QPointF& position : { QPointF(80, 40), QPointF(120, 60), QPointF(150, 80) })
+  {
+    QMouseEvent move(QEvent::MouseMove, position, Qt::NoButton, Qt::LeftButton, Qt::NoModifier);
+    item.mouseMoveEvent(&move);
+    item.paint(&painter);
+    // long enough for the preview timer to fire before the next move
+    wait(app, 250);
+    item.paint(&painter);
+  }
+  CHECK_EQ(selections, 0u);
+  CHECK_GE(previews, 1u);
+
+  const unsigned previewsBeforeRelease{ previews };
+  QMouseEvent release(QEvent::MouseButtonRelease, QPointF(150, 80), Qt::LeftButton, Qt::NoButton, Qt::NoModifier);
+  item.mouseReleaseEvent(&release);
+  item.paint(&painter);
+  wait(app, 250);
+  CHECK_EQ(selections, 1u);
+  CHECK_EQ(previews, previewsBeforeRelease);
+  painter.end();
+}
 #endif
\ No newline at end of file
@@ -3,14 +3,20 @@
 #include <QQuickItem>
 #include <QPainter>
 #include <QImage>
+#include <QTimer>
+#include <vector>
 
 class SourceImage : public QQuickPaintedItem
 {
   Q_OBJECT
     Q_PROPERTY(QImage imageBuffer READ data NOTIFY dataChanged)
+    Q_PROPERTY(QImage sourceBuffer READ sourceData NOTIFY dataChanged)
+    Q_PROPERTY(QRect sourceRegion READ sourceRegion NOTIFY dataChanged)
+    Q_PROPERTY(QRect dragRegion READ dragRegion NOTIFY previewDataChanged)
     Q_PROPERTY(QUrl path WRITE setPath NOTIFY pathChanged)
     Q_PROPERTY(int resultWidth WRITE setResultWidth NOTIFY widthChanged)
     Q_PROPERTY(int resultHeight WRITE setResultHeight NOTIFY heightChanged)
+    Q_PROPERTY(int stitchCount WRITE setStitchCount)
     Q_PROPERTY(int clipX READ clipX)
     Q_PROPERTY(int clipY READ clipY)
     Q_PROPERTY(int clipWidth READ clipWidth)
@@ -21,8 +27,18 @@ public:
   Q_INVOKABLE void setPath(const QUrl& path);
   Q_INVOKABLE void setResultWidth(const int& width);
   Q_INVOKABLE void setResultHeight(const int& height);
+  // stitches across the whole image, the preview keeps a few source pixels for each of them
+  Q_INVOKABLE void setStitchCount(const int& count);
   void paint(QPainter* painter);
+  // copy of the selected region, changes once per finished selection
   QImage data() const;
+  // the decoded image without scaling or copying, sourceRegion() and dragRegion() are given in its coordinates
+  QImage sourceData() const;
+  QRect sourceRegion() const;
+  // the region currently being dragged, updated a few times per second during the drag
+  QRect dragRegion() const;
+  // the selected region decoded from the file at full resolution, e.g. for saving
+  Q_INVOKABLE QImage fullResolutionData() const;
   int clipWidth() const;
   int clipHeight() const;
   int clipX() const;
@@ -31,6 +47,7 @@ public:
   
 signals:
   void dataChanged();
+  void previewDataChanged();
   void pathChanged();
   void widthChanged();
   void heightChanged();
@@ -43,19 +60,37 @@ protected:
 
 private:
   void normalizeLocations(qreal paintedWidth, qreal paintedHeight);
+  // decodes the file scaled down to what display and stitch count need
+  void decodePreview();
+  // the preview scaled to fit in_bounds, only resampled when the bounds change
+  const QImage& fitted(const QSizeF& in_bounds) const;
+  // emits dataChanged() if the selection differs from the one data() returned last time
+  void publishSelection(const QSize& in_fittedSize);
+  // a rectangle on the item in coordinates of the decoded image
+  QRect toSourceRegion(const QPointF& in_topLeft, const QPointF& in_bottomRight) const;
 
   QUrl filePath;
+  QSize sourceSize;
+  int stitchCount;
   QPoint resultSize;
   QPoint clipTopLeft;
   QPoint clipBottomRight;
   QPoint newClipTopLeft;
   QPoint newClipBottomRight;
   QImage image;
+  // the preview and its successive halvings, so fitting it to the item only resamples the nearest level
+  std::vector<QImage> mipmaps;
+  mutable QImage fittedImage;
   QPointF topLeft;
   QPointF bottomRight;
   QPointF newStartingPoint;
   QPointF newTopLeft;
   QPointF newBottomRight;
   bool abort;
+  QTimer previewTimer;
+  // what the last dataChanged() was about
+  qint64 publishedImage;
+  QSize publishedSize;
+  QRect publishedClip;
   const double aspectRatioMaxDelta = 0.05;
 };
@@ -0,0 +1,35 @@
+#include "StixelRenderer.h"
+#include <algorithm>
+#include <cstring>
+
+namespace stixel_rendering
+{
+  void render_row(const one_bit::StitchChart& in_chart, unsigned in_row, const std::vector<QRgb>& in_palette, const Layout& in_layout, uchar* out_firstLine, qsizetype in_bytesPerLine)
+  {
+    const unsigned stitchCount{ in_chart.stitchCount() };
+    const unsigned stitchWidth{ in_layout.stitchWidth };
+    const unsigned lineWidth{ stitchCount * stitchWidth };
+    // with the grid enabled the first line of the row is outline only, the stixel span starts below it
+    const unsigned spanLine{ in_layout.gridEnabled ? 1u : 0u };
+    if (in_layout.gridEnabled)
+    {
+      QRgb* gridLine{ (QRgb*)out_firstLine };
+      std::fill(gridLine, gridLine + lineWidth, in_layout.gridColor);
+    }
+    if (spanLine >= in_layout.stitchHeight) return;
+
+    QRgb* span{ (QRgb*)(out_firstLine + spanLine * in_bytesPerLine) };
+    for (unsigned stitch = 0; stitch < stitchCount; ++stitch)
+    {
+      const unsigned index{ in_chart.index(stitch, in_row) };
+      const QRgb color{ (index < in_palette.size()) ? in_palette[index] : qRgb(0, 0, 0) };
+      QRgb* stixel{ span + stitch * stitchWidth };
+      std::fill(stixel, stixel + stitchWidth, color);
+      if (in_layout.gridEnabled) stixel[0] = in_layout.gridColor;
+    }
+    for (unsigned line = spanLine + 1; line < in_layout.stitchHeight; ++line)
+    {
+      std::memcpy(out_firstLine + line * in_bytesPerLine, span, lineWidth * sizeof(QRgb));
+    }
+  }
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+#include <QColor>
+#include <QImage>
+#include "StitchChart.h"
+#include <vector>
+#include <cstdint>
+
+namespace stixel_rendering
+{
+  struct Layout
+  {
+    unsigned stitchWidth;
+    unsigned stitchHeight;
+    bool gridEnabled;
+    // color of the outline at the top and left edge of every stixel when the grid is enabled
+    QRgb gridColor;
+  };
+
+  // writes the in_layout.stitchHeight pixel lines of one chart row to out_firstLine. Each stixel takes the palette
+  // color of its index, indices outside the palette are painted black. One line gets composed per row, all other
+  // lines of the row are copies of it or of the grid line pattern.
+  void render_row(const one_bit::StitchChart& in_chart, unsigned in_row, const std::vector<QRgb>& in_palette, const Layout& in_layout, uchar* out_firstLine, qsizetype in_bytesPerLine);
+}
\ No newline at end of file
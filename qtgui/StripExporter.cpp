@@ -0,0 +1,168 @@
+#include "StripExporter.h"
+#include <QFileInfo>
+#include <array>
+#include <algorithm>
+
+namespace
+{
+  uint32_t crc32(uint32_t in_crc, const char* in_data, qsizetype in_size);
+  uint32_t adler32(uint32_t in_adler, const char* in_data, qsizetype in_size);
+  void appendBigEndian(QByteArray& io_data, uint32_t in_value);
+
+  // a stored deflate block holds up to 64 KiB - 1
+  constexpr qsizetype MAX_STORED_BLOCK{ 0xffff };
+}
+
+StripExporter::StripExporter()
+  : file{}
+  , size{}
+  , writtenLines{ 0 }
+  , adler{ 1 }
+  , line{}
+  , chunk{}
+{}
+
+StripExporter::~StripExporter()
+{
+  if (file.isOpen())
+  {
+    file.close();
+    file.remove();
+  }
+}
+
+bool StripExporter::open(const QString& in_path, const QSize& in_size)
+{
+  if (file.isOpen() || in_size.isEmpty() || !supports(in_path)) return false;
+  file.setFileName(in_path);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+  size = in_size;
+  writtenLines = 0;
+  adler = 1;
+  // every line starts with filter type 0, the pixels go in unchanged
+  line.resize(1 + 3 * (qsizetype)size.width());
+  line[0] = 0;
+
+  const char signature[]{ "\x89PNG\r\n\x1a\n" };
+  if (file.write(signature, 8) != 8) return false;
+  QByteArray header;
+  appendBigEndian(header, size.width());
+  appendBigEndian(header, size.height());
+  // 8 bits per channel, truecolor, deflate, adaptive filtering, no interlacing
+  header.append("\x08\x02\x00\x00\x00", 5);
+  // the zlib header for a 32 KiB window without a preset dictionary leads the image data
+  return writeChunk("IHDR", header) && writeChunk("IDAT", QByteArray("\x78\x01", 2));
+}
+
+bool StripExporter::write(const QImage& in_strip)
+{
+  if (!file.isOpen() || in_strip.width() != size.width() || in_strip.height() > size.height() - writtenLines) return false;
+  const QImage strip{ in_strip.format() == QImage::Format_RGB32 ? in_strip : in_strip.convertToFormat(QImage::Format_RGB32) };
+  const int width{ size.width() };
+  for (int y = 0; y < strip.height(); ++y)
+  {
+    const QRgb* pixels{ (const QRgb*)strip.constScanLine(y) };
+    char* rgb{ line.data() + 1 };
+    for (int x = 0; x < width; ++x)
+    {
+      *rgb++ = (char)qRed(pixels[x]);
+      *rgb++ = (char)qGreen(pixels[x]);
+      *rgb++ = (char)qBlue(pixels[x]);
+    }
+    adler = adler32(adler, line.constData(), line.size());
+    // one chunk per line, made of as many stored blocks as the line needs
+    chunk.clear();
+    for (qsizetype offset = 0; offset < line.size(); offset += MAX_STORED_BLOCK)
+    {
+      const uint16_t length{ (uint16_t)std::min(MAX_STORED_BLOCK, line.size() - offset) };
+      const char blockHeader[]{ 0, (char)(length & 0xff), (char)(length >> 8), (char)(~length & 0xff), (char)((uint16_t)~length >> 8) };
+      chunk.append(blockHeader, 5);
+      chunk.append(line.constData() + offset, length);
+    }
+    if (!writeChunk("IDAT", chunk)) return false;
+    ++writtenLines;
+  }
+  return true;
+}
+
+bool StripExporter::finish()
+{
+  if (!file.isOpen() || writtenLines != size.height()) return false;
+  // an empty final block closes the deflate stream, the checksum of all lines closes the zlib stream
+  chunk = QByteArray("\x01\x00\x00\xff\xff", 5);
+  appendBigEndian(chunk, adler);
+  if (!writeChunk("IDAT", chunk) || !writeChunk("IEND", QByteArray{}) || !file.flush()) return false;
+  file.close();
+  return file.error() == QFileDevice::NoError;
+}
+
+bool StripExporter::supports(const QString& in_path)
+{
+  return QFileInfo(in_path).suffix().compare("png", Qt::CaseInsensitive) == 0;
+}
+
+bool StripExporter::writeChunk(const char* in_type, const QByteArray& in_data)
+{
+  QByteArray header;
+  appendBigEndian(header, (uint32_t)in_data.size());
+  header.append(in_type, 4);
+  QByteArray trailer;
+  // the checksum covers the type and the data, not the length
+  appendBigEndian(trailer, crc32(crc32(0, in_type, 4), in_data.constData(), in_data.size()));
+  return file.write(header) == header.size() && file.write(in_data) == in_data.size() && file.write(trailer) == trailer.size();
+}
+
+namespace
+{
+  uint32_t crc32(uint32_t in_crc, const char* in_data, qsizetype in_size)
+  {
+    static const std::array<uint32_t, 256> table{ []() {
+      std::array<uint32_t, 256> result{};
+      for (uint32_t entry = 0; entry < 256; ++entry)
+      {
+        uint32_t value{ entry };
+        for (int bit = 0; bit < 8; ++bit)
+        {
+          value = (value & 1) ? 0xedb88320u ^ (value >> 1) : value >> 1;
+        }
+        result[entry] = value;
+      }
+      return result;
+    }() };
+    uint32_t crc{ ~in_crc };
+    for (qsizetype index = 0; index < in_size; ++index)
+    {
+      crc = table[(crc ^ (uint8_t)in_data[index]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+  }
+
+  uint32_t adler32(uint32_t in_adler, const char* in_data, qsizetype in_size)
+  {
+    // 5552 bytes is the most that can be summed up before the sums could overflow
+    constexpr qsizetype MAX_RUN{ 5552 };
+    constexpr uint32_t MODULUS{ 65521 };
+    uint32_t low{ in_adler & 0xffff };
+    uint32_t high{ in_adler >> 16 };
+    while (in_size > 0)
+    {
+      const qsizetype run{ std::min(MAX_RUN, in_size) };
+      for (qsizetype index = 0; index < run; ++index)
+      {
+        low += (uint8_t)in_data[index];
+        high += low;
+      }
+      low %= MODULUS;
+      high %= MODULUS;
+      in_data += run;
+      in_size -= run;
+    }
+    return (high << 16) | low;
+  }
+
+  void appendBigEndian(QByteArray& io_data, uint32_t in_value)
+  {
+    const char bytes[]{ (char)(in_value >> 24), (char)(in_value >> 16), (char)(in_value >> 8), (char)in_value };
+    io_data.append(bytes, 4);
+  }
+}
\ No newline at end of file
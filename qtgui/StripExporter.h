@@ -0,0 +1,36 @@
+#pragma once
+#include <QByteArray>
+#include <QFile>
+#include <QImage>
+#include <QSize>
+#include <QString>
+#include <cstdint>
+
+// Writes an RGB PNG of known size a strip of lines at a time, so a result never has to exist as one image.
+// Qt's image writers only take whole images, so the lines go into uncompressed deflate blocks and the file gets
+// about as large as the raw pixels. An unfinished file gets removed once the exporter goes out of scope.
+class StripExporter
+{
+public:
+  StripExporter();
+  ~StripExporter();
+
+  // creates in_path for an image of in_size, false if it can't be written
+  bool open(const QString& in_path, const QSize& in_size);
+  // appends the lines of in_strip below those written so far, it has to be as wide as the image
+  bool write(const QImage& in_strip);
+  // completes the file, false if lines are missing or the file couldn't be written
+  bool finish();
+  // only PNG files can be written in strips
+  static bool supports(const QString& in_path);
+
+private:
+  bool writeChunk(const char* in_type, const QByteArray& in_data);
+
+  QFile file;
+  QSize size;
+  int writtenLines;
+  uint32_t adler;
+  QByteArray line;
+  QByteArray chunk;
+};
\ No newline at end of file
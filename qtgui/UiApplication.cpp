@@ -34,6 +34,12 @@ namespace gui_mode
       return errors::QT_ERROR;
     }
 
+    // only reachable through QtPixelator.stats
+    if (-1 == qmlRegisterUncreatableType<PipelineStats>(appUri.c_str(), majorVersion, minorVersion, "PipelineStats", "PipelineStats belong to a QtPixelator"))
+    {
+      return errors::QT_ERROR;
+    }
+
     if (-1 == qmlRegisterType<SourceImage>(appUri.c_str(), majorVersion, minorVersion, "SourceImage"))
     {
       return errors::QT_ERROR;
@@ -49,7 +55,7 @@ namespace gui_mode
       return errors::QT_ERROR;
     }
 
-    logging::logger() << logging::Level::DEBUG << "UI App set up!" << logging::Level::OFF;
+    STIXELATOR_LOG(DEBUG, "UI App set up!");
 
     // connect to application engine
     QQmlApplicationEngine engine;
@@ -60,7 +66,7 @@ namespace gui_mode
     QObject::connect(&engine, &QQmlApplicationEngine::objectCreated,
       &uiApp, failureSlot, Qt::QueuedConnection);
     engine.load(url);
-    logging::logger() << logging::Level::DEBUG << "UI engine connected!" << logging::Level::OFF;
+    STIXELATOR_LOG(DEBUG, "UI engine connected!");
 
     return uiApp.exec();
   }
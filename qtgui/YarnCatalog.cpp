@@ -0,0 +1,177 @@
+#include "YarnCatalog.h"
+#include "logging.h"
+#include <sstream>
+#include <optional>
+#include <limits>
+
+namespace
+{
+  struct Entry
+  {
+    std::string name;
+    QRgb color;
+  };
+
+  std::string trimmed(const std::string& in_text);
+  std::vector<std::string> fields(const std::string& in_line);
+  std::optional<int> channel(const std::string& in_field);
+  std::optional<Entry> entry(const std::string& in_line);
+}
+
+YarnCatalog::YarnCatalog()
+  : names{}
+  , colors{}
+  , points{}
+  , tree{}
+{}
+
+errors::Code YarnCatalog::read(std::istream& in_stream)
+{
+  std::vector<std::string> readNames;
+  std::vector<QRgb> readColors;
+  std::string line;
+  unsigned lineNumber{ 0 };
+  bool firstLine{ true };
+  while (std::getline(in_stream, line))
+  {
+    ++lineNumber;
+    if (trimmed(line).empty()) continue;
+    const auto parsed{ entry(line) };
+    const bool header{ firstLine };
+    firstLine = false;
+    if (!parsed)
+    {
+      if (header) continue;
+      STIXELATOR_LOG(ERR, "Invalid yarn catalog entry in line " << lineNumber << ": " << line);
+      return errors::INVALID_CATALOG;
+    }
+    readNames.push_back(parsed->name);
+    readColors.push_back(parsed->color);
+  }
+  if (readNames.empty())
+  {
+    STIXELATOR_LOG(ERR, "Yarn catalog has no entries");
+    return errors::INVALID_CATALOG;
+  }
+
+  names.swap(readNames);
+  colors.swap(readColors);
+  points.clear();
+  for (const auto& color : colors)
+  {
+    points.push_back(color_space::HsvPoint::fromColor(QColor(color)));
+  }
+  tree = color_space::CylinderTree(points);
+  STIXELATOR_LOG(DEBUG, "Read " << (unsigned)names.size() << " yarns");
+  return errors::NONE;
+}
+
+int YarnCatalog::size() const
+{
+  return (int)names.size();
+}
+
+const std::string& YarnCatalog::name(int in_index) const
+{
+  return names[in_index];
+}
+
+QRgb YarnCatalog::color(int in_index) const
+{
+  return colors[in_index];
+}
+
+int YarnCatalog::nearest(QRgb in_color) const
+{
+  return tree.nearest(color_space::HsvPoint::fromColor(QColor(in_color)));
+}
+
+std::vector<int> YarnCatalog::nearestDistinct(const std::vector<QRgb>& in_colors) const
+{
+  std::vector<int> result;
+  std::vector<bool> taken(names.size(), false);
+  for (const auto& color : in_colors)
+  {
+    int closest{ nearest(color) };
+    if (closest >= 0 && taken[closest])
+    {
+      // only collisions fall back to scanning the entries that are still free
+      const auto point{ color_space::HsvPoint::fromColor(QColor(color)) };
+      double closestDistance{ std::numeric_limits<double>::max() };
+      closest = -1;
+      for (int index = 0; index < size(); ++index)
+      {
+        if (taken[index]) continue;
+        const double currDistance{ color_space::distance(point, points[index]) };
+        if (currDistance < closestDistance)
+        {
+          closestDistance = currDistance;
+          closest = index;
+        }
+      }
+    }
+    if (closest >= 0) taken[closest] = true;
+    result.push_back(closest);
+  }
+  return result;
+}
+
+namespace
+{
+  std::string trimmed(const std::string& in_text)
+  {
+    const auto first{ in_text.find_first_not_of(" \t\r\n") };
+    if (first == std::string::npos) return {};
+    const auto last{ in_text.find_last_not_of(" \t\r\n") };
+    return in_text.substr(first, last - first + 1);
+  }
+
+  std::vector<std::string> fields(const std::string& in_line)
+  {
+    std::vector<std::string> result;
+    std::stringstream stream{ in_line };
+    std::string field;
+    while (std::getline(stream, field, ','))
+    {
+      result.push_back(field);
+    }
+    return result;
+  }
+
+  std::optional<int> channel(const std::string& in_field)
+  {
+    if (in_field.empty() || in_field.size() > 3 || in_field.find_first_not_of("0123456789") != std::string::npos) return std::nullopt;
+    const int value{ std::stoi(in_field) };
+    if (value > 255) return std::nullopt;
+    return value;
+  }
+
+  std::optional<Entry> entry(const std::string& in_line)
+  {
+    const auto parts{ fields(in_line) };
+    if (parts.size() < 2) return std::nullopt;
+    // names may contain commas themselves, the color is always taken from the last fields
+    auto joinedName = [&parts](size_t in_nameFields) {
+      std::string name{ parts[0] };
+      for (size_t index = 1; index < in_nameFields; ++index) name += "," + parts[index];
+      name = trimmed(name);
+      if (name.size() >= 2 && name.front() == '"' && name.back() == '"') name = name.substr(1, name.size() - 2);
+      return name;
+    };
+
+    const std::string last{ trimmed(parts.back()) };
+    if (last.size() == 7 && last[0] == '#' && last.find_first_not_of("0123456789abcdefABCDEF", 1) == std::string::npos)
+    {
+      const std::string name{ joinedName(parts.size() - 1) };
+      if (name.empty()) return std::nullopt;
+      return Entry{ name, 0xff000000u | (QRgb)std::stoul(last.substr(1), nullptr, 16) };
+    }
+    if (parts.size() < 4) return std::nullopt;
+    const auto red{ channel(trimmed(parts[parts.size() - 3])) };
+    const auto green{ channel(trimmed(parts[parts.size() - 2])) };
+    const auto blue{ channel(trimmed(parts[parts.size() - 1])) };
+    const std::string name{ joinedName(parts.size() - 3) };
+    if (!red || !green || !blue || name.empty()) return std::nullopt;
+    return Entry{ name, qRgb(*red, *green, *blue) };
+  }
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+#include <QColor>
+#include <string>
+#include <vector>
+#include <istream>
+#include "HslCylinder.h"
+#include "CylinderTree.h"
+#include "error_codes.h"
+
+// Named yarn colors, read from CSV lines of either "name,red,green,blue" or "name,#rrggbb".
+// A header line in front is skipped. Entries are indexed in a k-d tree of the HSL cylinder,
+// so matching a color against catalogs of thousands of yarns stays cheap.
+class YarnCatalog
+{
+public:
+  YarnCatalog();
+
+  // replaces the catalog with the entries read from in_stream, keeps the current one on errors
+  errors::Code read(std::istream& in_stream);
+  int size() const;
+  const std::string& name(int in_index) const;
+  QRgb color(int in_index) const;
+  // catalog entry closest to in_color, -1 for an empty catalog
+  int nearest(QRgb in_color) const;
+  // closest entry for each of in_colors, earlier colors get first pick and no entry is used twice.
+  // Colors left over once every entry is taken map to -1.
+  std::vector<int> nearestDistinct(const std::vector<QRgb>& in_colors) const;
+
+private:
+  std::vector<std::string> names;
+  std::vector<QRgb> colors;
+  std::vector<color_space::HsvPoint> points;
+  color_space::CylinderTree tree;
+};
\ No newline at end of file
@@ -1,6 +1,7 @@
 import QtQuick 2.12
 import QtQuick.Controls 2.14
 import QtQuick.Layouts 1.14
+import QtQuick.Dialogs 1.3
 import starturtle.stixelator 1.0
 
 ApplicationWindow {
@@ -9,6 +10,19 @@ ApplicationWindow {
   width: 800
   height: 600
   title: qsTr("Image Pixelation")
+  // set while the full resolution run for the chart to save is underway
+  property bool commitPending: false
+
+  // commits or reports the outcome of saving, then goes back to previewing the selection
+  function finishSaving(result) {
+    commitPending = false
+    if (result !== 0) {
+      saveError.text = qsTr("Saving the chart failed with error %1.").arg(result)
+      saveError.open()
+    }
+    pixelator.setInputRegion(imagePreview.sourceData, imagePreview.sourceRegion)
+    pixelator.run()
+  }
 
   menuBar: MenuBar {
     MenuBarItem {
@@ -25,6 +39,12 @@ ApplicationWindow {
         imagePreview.getOutputFile()
       }
     }
+    MenuBarItem {
+      text: qsTr("&Yarns...")
+      onTriggered: {
+        yarnCatalogGet.open()
+      }
+    }
     MenuBarItem {
       text: qsTr("&Quit")
       icon.name: "application-exit"
@@ -43,6 +63,7 @@ ApplicationWindow {
       {
         imagePreview.input.resultWidth = resultWidth
         imagePreview.input.resultHeight = resultHeight
+        imagePreview.input.stitchCount = Math.ceil(resultWidth / 10 * stitchColumns)
         pixelator.setStitchSizes(resultWidth, resultHeight, stitchRows, stitchColumns)
         pixelator.run()
         console.log("Set preview dimensions to " + imagePreview.input.resultWidth + "/" + imagePreview.input.resultHeight)
@@ -53,10 +74,13 @@ ApplicationWindow {
       id: pixelColors
       Layout.fillWidth: false
       onColorsChanged: {
-        pixelator.setStitchColors(pixelColors.colors)
+        pixelator.setStitchPalette(pixelColors.colors)
         pixelator.run()
         console.log("Set colors to " + pixelColors.colors)
       }
+      onProposalRequested: {
+        pixelColors.applyColors(pixelator.proposePalette(colorCount, true))
+      }
     }
 
     GridLines {
@@ -76,23 +100,38 @@ ApplicationWindow {
       id: imagePreview
       onInputDataChanged:
       {
-        pixelator.setInputImage(imagePreview.previewData)
+        // finishing the save picks up the latest selection
+        if (mainWindow.commitPending) return
+        pixelator.setInputRegion(imagePreview.sourceData, imagePreview.sourceRegion)
         console.log("Updated input image, trigger pixelation")
         pixelator.run()
       }
+      onInputPreviewChanged:
+      {
+        // the next preview or the final selection supersedes this run
+        if (mainWindow.commitPending) return
+        pixelator.setInputRegion(imagePreview.sourceData, imagePreview.dragRegion)
+        pixelator.run()
+      }
       onClippingSizeChanged:
       {
         footer.update
       }
       onStoragePathSet:
       {
-        pixelator.setStoragePath(storagePath)
-        pixelator.commit()
+        // the preview works on a scaled down copy, the saved chart uses the selected region at full resolution.
+        // It runs on the worker like any other, the result gets committed once it's created.
+        var result = pixelator.setStoragePath(storagePath)
+        if (result === 0) result = pixelator.setInputImage(imagePreview.input.fullResolutionData())
+        if (result === 0) result = pixelator.run()
+        if (result === 0) mainWindow.commitPending = true
+        else mainWindow.finishSaving(result)
       }
     }
     Component.onCompleted: {
       imagePreview.input.resultWidth = pixelSizes.resultWidth
       imagePreview.input.resultHeight = pixelSizes.resultHeight
+      imagePreview.input.stitchCount = Math.ceil(pixelSizes.resultWidth / 10 * pixelSizes.stitchColumns)
     }
     onHeightChanged: {
       imagePreview.height = contentItem.height - pixelColors.height
@@ -101,23 +140,75 @@ ApplicationWindow {
       imagePreview.width = contentItem.width
     }
   }
+  FileDialog {
+    id: yarnCatalogGet
+    title: "Please choose a yarn catalog"
+    nameFilters: [ "Yarn catalogs (*.csv)", "All files (*)" ]
+    visible: false
+    selectExisting: true
+    onAccepted: {
+      console.log("Yarn catalog result: " + pixelator.setYarnCatalog(fileUrl))
+    }
+  }
   QtPixelator {
     id: pixelator
     onPixelationCreated: {
+      if (mainWindow.commitPending) {
+        mainWindow.finishSaving(pixelator.commit())
+        return
+      }
       console.log("new pixelation created")
       imagePreview.updatePreview(pixelator.resultBuffer)
     }
+    onPixelationFailed: {
+      if (mainWindow.commitPending) mainWindow.finishSaving(in_error)
+    }
+  }
+  MessageDialog {
+    id: saveError
+    title: qsTr("Could not save the chart")
+    icon: StandardIcon.Warning
   }
   footer: ToolBar {
     RowLayout {
       anchors.fill: parent
       Label { text: imagePreview.clippingInfo }
+      Label {
+        // live pipeline numbers, hovering lists each stage
+        property var stats: pixelator.stats
+        Layout.alignment: Qt.AlignRight
+        text: qsTr("%1 st/s, cache %2/%3, %4 of %5 runs coalesced")
+          .arg(Math.round(stats.stitchesPerSecond))
+          .arg(stats.cacheHits).arg(stats.cacheHits + stats.cacheMisses)
+          .arg(stats.runsCoalesced).arg(stats.runsTriggered)
+        ToolTip.visible: statsHover.containsMouse
+        ToolTip.text: {
+          var lines = []
+          for (var stage in stats.stageMilliseconds) {
+            lines.push(stage + ": " + stats.stageMilliseconds[stage].toFixed(1) + " ms, peak "
+              + (stats.peakStageBytes[stage] / 1048576).toFixed(1) + " MiB")
+          }
+          return lines.join("\n")
+        }
+        MouseArea {
+          id: statsHover
+          anchors.fill: parent
+          hoverEnabled: true
+        }
+      }
+      ProgressBar {
+        Layout.alignment: Qt.AlignRight
+        from: 0
+        to: 100
+        value: pixelator.progress
+        visible: pixelator.progress > 0 && pixelator.progress < 100
+      }
     }
   }
   Component.onCompleted: {
     pixelator.setStitchSizes(pixelSizes.resultWidth, pixelSizes.resultHeight, pixelSizes.stitchRows, pixelSizes.stitchColumns)
     console.log("Initialize stitch counts to " + pixelSizes.stitchColumns + "M " + pixelSizes.stitchRows + "R, totaling " + pixelSizes.resultWidth + "x" + pixelSizes.resultHeight + "cm")
-    pixelator.setStitchColors(pixelColors.colors)
+    pixelator.setStitchPalette(pixelColors.colors)
     console.log("Initialize colors to " + pixelColors.colors)
   }
 }
\ No newline at end of file
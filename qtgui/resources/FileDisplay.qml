@@ -38,19 +38,23 @@ Frame {
   }
   property var sourcePath: inputFileGet.fileUrl
   property var storagePath: outputFileGet.fileUrl
-  property var previewData: inputImage.imageBuffer
+  property var sourceData: inputImage.sourceBuffer
+  property var sourceRegion: inputImage.sourceRegion
+  property var dragRegion: inputImage.dragRegion
   function getInputFile() {inputFileGet.open()}
   function getOutputFile() {outputFileGet.open()}
   function updatePreview(image) {outputImage.setData(image)}
   property var input: inputImage
   property string clippingInfo: inputImage.clippingInfo
   signal inputDataChanged()
+  signal inputPreviewChanged()
   signal clippingSizeChanged()
   signal storagePathSet()
 
   Component.onCompleted:
   {
     inputImage.dataChanged.connect(inputDataChanged)
+    inputImage.previewDataChanged.connect(inputPreviewChanged)
     inputImage.newClipping.connect(clippingSizeChanged)
     outputFileGet.accepted.connect(storagePathSet)
   }
@@ -201,6 +201,12 @@ Pane {
         }
       }
     }
+    Button {
+      id: propose
+      text: "Propose"
+      Layout.columnSpan: 8
+      onClicked: proposalRequested(colors.length)
+    }
     PixelColorSettings {
       id: cols1
       pixelColor: "black"
@@ -320,6 +326,7 @@ Pane {
       pixelColor: "firebrick"
     }
   }
+  signal proposalRequested(int colorCount)
   property variant colors: {
     if (cols24.visible) {
       return [cols1.pixelColor, cols2.pixelColor, cols3.pixelColor, cols4.pixelColor, cols5.pixelColor, cols6.pixelColor, cols7.pixelColor, cols8.pixelColor, cols9.pixelColor, cols10.pixelColor, cols11.pixelColor, cols12.pixelColor, cols13.pixelColor, cols14.pixelColor, cols15.pixelColor, cols16.pixelColor, cols17.pixelColor, cols18.pixelColor, cols19.pixelColor, cols20.pixelColor, cols21.pixelColor, cols22.pixelColor, cols23.pixelColor, cols24.pixelColor]
@@ -391,4 +398,11 @@ Pane {
       return [cols1.pixelColor, cols2.pixelColor]
     }
   }
+  // replaces the visible colors in order, colors without a proposal keep their value
+  function applyColors(proposal) {
+    var fields = [cols1, cols2, cols3, cols4, cols5, cols6, cols7, cols8, cols9, cols10, cols11, cols12, cols13, cols14, cols15, cols16, cols17, cols18, cols19, cols20, cols21, cols22, cols23, cols24]
+    for (var index = 0; index < proposal.length && index < fields.length && fields[index].visible; ++index) {
+      fields[index].pixelColor = proposal[index]
+    }
+  }
 }
\ No newline at end of file
@@ -59,7 +59,11 @@ std::map<std::string,std::function<bool(const std::string&)>> ArgumentParser::in
     { "-infile", std::bind(&ArgumentParser::parse_input_file, this, std::placeholders::_1) },
     { "-outfile", std::bind(&ArgumentParser::parse_output_file, this, std::placeholders::_1) },
     { "-gui", std::bind(&ArgumentParser::parse_use_gui, this, std::placeholders::_1) },
-    { "-crop-region", std::bind(&ArgumentParser::parse_crop_region, this, std::placeholders::_1)}
+    { "-crop-region", std::bind(&ArgumentParser::parse_crop_region, this, std::placeholders::_1)},
+    { "-threads", std::bind(&ArgumentParser::parse_worker_threads, this, std::placeholders::_1) },
+    { "-dither", std::bind(&ArgumentParser::parse_dither_mode, this, std::placeholders::_1) },
+    { "-trace", std::bind(&ArgumentParser::parse_trace_file, this, std::placeholders::_1) },
+    { "-memory-budget", std::bind(&ArgumentParser::parse_memory_budget, this, std::placeholders::_1) }
   };
 }
 
@@ -105,6 +109,15 @@ std::map<std::string,std::function<bool(const std::string&)>> ArgumentParser::in
     // value is optional, defaults to TOP_LEFT.
     return one_bit::CropRegion::TOP_LEFT;
   }
+
+  DitherMode ArgumentParser::parse_delegate_DitherMode(const string& in_arg_val)
+  {
+    if (in_arg_val == "NONE") return DitherMode::NONE;
+    if (in_arg_val == "FLOYD_STEINBERG") return DitherMode::FLOYD_STEINBERG;
+    if (in_arg_val == "ATKINSON") return DitherMode::ATKINSON;
+    if (in_arg_val == "BAYER") return DitherMode::BAYER;
+    throw std::invalid_argument(in_arg_val + " is not a valid dither mode enum name");
+  }
 }
 
 namespace
@@ -140,6 +153,10 @@ one_bit::CropRegion DoctestArgumentParser::getCropRegion(const std::string& stri
 {
   return argParser.parse_delegate_CropRegion(stringToParse);
 }
+one_bit::DitherMode DoctestArgumentParser::getDitherMode(const std::string& stringToParse, one_bit::ArgumentParser& argParser)
+{
+  return argParser.parse_delegate_DitherMode(stringToParse);
+}
 
 TEST_CASE("test integer parsing") {
   DoctestArgumentParser argParser;
@@ -245,4 +262,16 @@ TEST_CASE("test CropRegion parsing") {
   CHECK_EQ(argParser.getCropRegion("BIKINI_BOTTOM", parserToTest), fallbackRegion);
   CHECK_EQ(argParser.getCropRegion("BOTTOMLINE", parserToTest), fallbackRegion);
 }
+
+TEST_CASE("test DitherMode parsing") {
+  DoctestArgumentParser argParser;
+  one_bit::ArgumentParser parserToTest;
+  CHECK_EQ(argParser.getDitherMode("NONE", parserToTest), one_bit::DitherMode::NONE);
+  CHECK_EQ(argParser.getDitherMode("FLOYD_STEINBERG", parserToTest), one_bit::DitherMode::FLOYD_STEINBERG);
+  CHECK_EQ(argParser.getDitherMode("ATKINSON", parserToTest), one_bit::DitherMode::ATKINSON);
+  CHECK_EQ(argParser.getDitherMode("BAYER", parserToTest), one_bit::DitherMode::BAYER);
+  CHECK_THROWS(argParser.getDitherMode("", parserToTest));
+  CHECK_THROWS(argParser.getDitherMode("FLOYD", parserToTest));
+  CHECK_THROWS(argParser.getDitherMode("bayer", parserToTest));
+}
 #endif
\ No newline at end of file
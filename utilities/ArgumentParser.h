@@ -19,6 +19,7 @@ public:
   bool getBool(const std::string& stringToParse, one_bit::ArgumentParser& argParser);
   one_bit::UiMode getUiMode(const std::string& stringToParse, one_bit::ArgumentParser& argParser);
   one_bit::CropRegion getCropRegion(const std::string& stringToParse, one_bit::ArgumentParser& argParser);
+  one_bit::DitherMode getDitherMode(const std::string& stringToParse, one_bit::ArgumentParser& argParser);
 };
 #endif
 using string = std::string;
@@ -27,7 +28,7 @@ namespace one_bit
 class ArgumentParser
 {
 #ifdef DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
-  friend class DoctestArgumentParser;
+  friend class ::DoctestArgumentParser;
 #endif
   OPTIONAL_PROPERTY(int, height)
   OPTIONAL_PROPERTY(int, width)
@@ -37,6 +38,10 @@ class ArgumentParser
   OPTIONAL_PROPERTY(string, output_file)
   OPTIONAL_PROPERTY(UiMode, use_gui)
   OPTIONAL_PROPERTY(CropRegion, crop_region)
+  OPTIONAL_PROPERTY(int, worker_threads)
+  OPTIONAL_PROPERTY(DitherMode, dither_mode)
+  OPTIONAL_PROPERTY(string, trace_file)
+  OPTIONAL_PROPERTY(int, memory_budget)
 public:
   ArgumentParser();
   bool parseArgs(int argc, char** argv);
@@ -48,6 +53,7 @@ private:
   bool parse_delegate_bool(const string& in_arg_val);
   UiMode parse_delegate_UiMode(const string& in_arg_val);
   CropRegion parse_delegate_CropRegion(const string& in_arg_val);
+  DitherMode parse_delegate_DitherMode(const string& in_arg_val);
   const std::map<string, std::function<bool(const string&)> > parsers;
 };
 }
\ No newline at end of file
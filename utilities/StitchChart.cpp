@@ -0,0 +1,295 @@
+#include "StitchChart.h"
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+  unsigned bitsForColors(unsigned in_colorCount);
+  uint64_t repeatLane(uint64_t in_value, unsigned in_bits);
+  unsigned countBits(uint64_t in_word);
+}
+
+namespace one_bit
+{
+StitchChart::StitchChart()
+  : stitches{ 0 }
+  , rows{ 0 }
+  , colors{ 0 }
+  , bits{ 1 }
+  , rowStride{ 0 }
+  , words{}
+{}
+
+StitchChart::StitchChart(unsigned in_stitchCount, unsigned in_rowCount, unsigned in_colorCount)
+  : stitches{ in_stitchCount }
+  , rows{ in_rowCount }
+  , colors{ in_colorCount }
+  , bits{ bitsForColors(in_colorCount) }
+  , rowStride{ ((size_t)in_stitchCount * bitsForColors(in_colorCount) + 63) / 64 }
+  , words(rowStride * in_rowCount, 0)
+{}
+
+unsigned StitchChart::stitchCount() const
+{
+  return stitches;
+}
+
+unsigned StitchChart::rowCount() const
+{
+  return rows;
+}
+
+unsigned StitchChart::colorCount() const
+{
+  return colors;
+}
+
+unsigned StitchChart::bitsPerStitch() const
+{
+  return bits;
+}
+
+bool StitchChart::isEmpty() const
+{
+  return stitches == 0 || rows == 0;
+}
+
+unsigned StitchChart::index(unsigned in_stitch, unsigned in_row) const
+{
+  const size_t bit{ (size_t)in_stitch * bits };
+  const uint64_t mask{ (uint64_t{ 1 } << bits) - 1 };
+  return (unsigned)((words[in_row * rowStride + bit / 64] >> (bit % 64)) & mask);
+}
+
+void StitchChart::setIndex(unsigned in_stitch, unsigned in_row, unsigned in_index)
+{
+  const size_t bit{ (size_t)in_stitch * bits };
+  const uint64_t mask{ (uint64_t{ 1 } << bits) - 1 };
+  uint64_t& word{ words[in_row * rowStride + bit / 64] };
+  word = (word & ~(mask << (bit % 64))) | ((in_index & mask) << (bit % 64));
+}
+
+void StitchChart::setRow(unsigned in_row, const int32_t* in_indices)
+{
+  // lanes never straddle words since the lane widths divide 64
+  const unsigned lanesPerWord{ 64 / bits };
+  uint64_t* row{ words.data() + in_row * rowStride };
+  for (size_t word = 0; word < rowStride; ++word)
+  {
+    const unsigned first{ (unsigned)(word * lanesPerWord) };
+    const unsigned last{ std::min(stitches, first + lanesPerWord) };
+    uint64_t packed{ 0 };
+    for (unsigned stitch = first; stitch < last; ++stitch)
+    {
+      const uint64_t index{ (uint64_t)std::max(0, in_indices[stitch]) };
+      packed |= index << ((stitch - first) * bits);
+    }
+    row[word] = packed;
+  }
+}
+
+void StitchChart::unpackRow(unsigned in_row, int32_t* out_indices) const
+{
+  const unsigned lanesPerWord{ 64 / bits };
+  const uint64_t mask{ (uint64_t{ 1 } << bits) - 1 };
+  const uint64_t* row{ rowWords(in_row) };
+  for (size_t word = 0; word < rowStride; ++word)
+  {
+    const unsigned first{ (unsigned)(word * lanesPerWord) };
+    const unsigned last{ std::min(stitches, first + lanesPerWord) };
+    uint64_t packed{ row[word] };
+    for (unsigned stitch = first; stitch < last; ++stitch)
+    {
+      out_indices[stitch] = (int32_t)(packed & mask);
+      packed >>= bits;
+    }
+  }
+}
+
+const uint64_t* StitchChart::rowWords(unsigned in_row) const
+{
+  return words.data() + in_row * rowStride;
+}
+
+size_t StitchChart::wordsPerRow() const
+{
+  return rowStride;
+}
+
+std::vector<size_t> StitchChart::colorCounts() const
+{
+  std::vector<size_t> counts(colors, 0);
+  if (isEmpty() || colors == 0) return counts;
+  const unsigned lanesPerWord{ 64 / bits };
+  const uint64_t lowBits{ repeatLane(1, bits) };
+  // padding lanes at the end of each row hold 0 and must not count as stitches of color 0
+  const unsigned lastWordLanes{ stitches - (unsigned)(rowStride - 1) * lanesPerWord };
+  const uint64_t lastWordMask{ lastWordLanes * bits == 64 ? ~uint64_t{ 0 } : (uint64_t{ 1 } << (lastWordLanes * bits)) - 1 };
+  for (unsigned color = 0; color < colors; ++color)
+  {
+    const uint64_t pattern{ repeatLane(color, bits) };
+    size_t count{ 0 };
+    for (unsigned row = 0; row < rows; ++row)
+    {
+      const uint64_t* rowData{ rowWords(row) };
+      for (size_t word = 0; word < rowStride; ++word)
+      {
+        // lanes equal to the color become zero, folding each lane into its lowest bit leaves that bit clear only for them
+        uint64_t difference{ rowData[word] ^ pattern };
+        for (unsigned shift = 1; shift < bits; shift <<= 1)
+        {
+          difference |= difference >> shift;
+        }
+        uint64_t matches{ ~difference & lowBits };
+        if (word + 1 == rowStride) matches &= lastWordMask;
+        count += countBits(matches);
+      }
+    }
+    counts[color] = count;
+  }
+  return counts;
+}
+
+size_t StitchChart::byteSize() const
+{
+  return words.size() * sizeof(uint64_t);
+}
+
+bool StitchChart::operator==(const StitchChart& in_other) const
+{
+  return stitches == in_other.stitches && rows == in_other.rows && colors == in_other.colors && words == in_other.words;
+}
+
+bool StitchChart::operator!=(const StitchChart& in_other) const
+{
+  return !(*this == in_other);
+}
+}
+
+namespace
+{
+  unsigned bitsForColors(unsigned in_colorCount)
+  {
+    unsigned bits{ 1 };
+    while (bits < 16 && (1u << bits) < in_colorCount)
+    {
+      bits <<= 1;
+    }
+    return bits;
+  }
+
+  uint64_t repeatLane(uint64_t in_value, unsigned in_bits)
+  {
+    uint64_t result{ 0 };
+    for (unsigned lane = 0; lane < 64; lane += in_bits)
+    {
+      result |= in_value << lane;
+    }
+    return result;
+  }
+
+  unsigned countBits(uint64_t in_word)
+  {
+#ifdef _MSC_VER
+    return (unsigned)__popcnt64(in_word);
+#else
+    return (unsigned)__builtin_popcountll(in_word);
+#endif
+  }
+}
+
+#ifdef DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest.h>
+
+TEST_CASE("test bits per stitch") {
+  CHECK_EQ(one_bit::StitchChart(3, 3, 0).bitsPerStitch(), 1u);
+  CHECK_EQ(one_bit::StitchChart(3, 3, 2).bitsPerStitch(), 1u);
+  CHECK_EQ(one_bit::StitchChart(3, 3, 3).bitsPerStitch(), 2u);
+  CHECK_EQ(one_bit::StitchChart(3, 3, 4).bitsPerStitch(), 2u);
+  CHECK_EQ(one_bit::StitchChart(3, 3, 5).bitsPerStitch(), 4u);
+  CHECK_EQ(one_bit::StitchChart(3, 3, 17).bitsPerStitch(), 8u);
+  CHECK_EQ(one_bit::StitchChart(3, 3, 257).bitsPerStitch(), 16u);
+}
+
+TEST_CASE("test rows are word aligned") {
+  one_bit::StitchChart chart(65, 3, 2);
+  CHECK_EQ(chart.wordsPerRow(), 2u);
+  CHECK_EQ(chart.byteSize(), 3 * 2 * sizeof(uint64_t));
+  chart.setIndex(64, 0, 1);
+  CHECK_EQ(chart.rowWords(0)[1], 1u);
+  CHECK_EQ(chart.rowWords(1)[0], 0u);
+  // 400x600 stitches in two colors take 600 rows of 7 words
+  CHECK_EQ(one_bit::StitchChart(400, 600, 2).byteSize(), 600 * 7 * sizeof(uint64_t));
+}
+
+TEST_CASE("test packing and unpacking rows") {
+  for (unsigned colors : { 2u, 3u, 16u, 200u, 1000u })
+  {
+    one_bit::StitchChart chart(101, 4, colors);
+    std::vector<int32_t> row(101);
+    for (unsigned y = 0; y < 4; ++y)
+    {
+      for (unsigned x = 0; x < 101; ++x)
+      {
+        row[x] = (int32_t)((x * 7 + y * 3) % colors);
+      }
+      chart.setRow(y, row.data());
+    }
+    std::vector<int32_t> unpacked(101);
+    for (unsigned y = 0; y < 4; ++y)
+    {
+      chart.unpackRow(y, unpacked.data());
+      for (unsigned x = 0; x < 101; ++x)
+      {
+        CHECK_EQ(unpacked[x], (int32_t)((x * 7 + y * 3) % colors));
+        CHECK_EQ(chart.index(x, y), (x * 7 + y * 3) % colors);
+      }
+    }
+    chart.setIndex(100, 3, 1);
+    CHECK_EQ(chart.index(100, 3), 1u);
+    CHECK_EQ(chart.index(99, 3), (99 * 7 + 9) % colors);
+  }
+
+  // negative indices end up as the first color
+  one_bit::StitchChart chart(3, 1, 2);
+  const int32_t row[]{ -1, 1, -1 };
+  chart.setRow(0, row);
+  CHECK_EQ(chart.index(0, 0), 0u);
+  CHECK_EQ(chart.index(1, 0), 1u);
+}
+
+TEST_CASE("test color counts") {
+  for (unsigned colors : { 1u, 2u, 4u, 5u, 16u, 300u })
+  {
+    for (unsigned stitches : { 1u, 63u, 64u, 65u, 130u })
+    {
+      one_bit::StitchChart chart(stitches, 3, colors);
+      std::vector<size_t> expected(colors, 0);
+      std::vector<int32_t> row(stitches);
+      for (unsigned y = 0; y < 3; ++y)
+      {
+        for (unsigned x = 0; x < stitches; ++x)
+        {
+          row[x] = (int32_t)((x * x + y) % colors);
+          ++expected[row[x]];
+        }
+        chart.setRow(y, row.data());
+      }
+      CHECK_EQ(chart.colorCounts(), expected);
+    }
+  }
+  CHECK(one_bit::StitchChart().colorCounts().empty());
+  CHECK_EQ(one_bit::StitchChart(0, 5, 2).colorCounts(), std::vector<size_t>(2, 0));
+}
+
+TEST_CASE("test chart comparison") {
+  one_bit::StitchChart first(10, 2, 4);
+  one_bit::StitchChart second(10, 2, 4);
+  CHECK(first == second);
+  second.setIndex(3, 1, 2);
+  CHECK(first != second);
+  CHECK(first != one_bit::StitchChart(10, 2, 5));
+}
+#endif
\ No newline at end of file
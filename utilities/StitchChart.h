@@ -0,0 +1,47 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace one_bit
+{
+// Palette indices of a knitting chart, packed at the smallest of 1, 2, 4, 8 or 16 bits per stitch that holds
+// all colors. Rows are stored one after another and each row starts at a 64 bit word, so rows can be written
+// from different threads at the same time.
+class StitchChart
+{
+public:
+  StitchChart();
+  StitchChart(unsigned in_stitchCount, unsigned in_rowCount, unsigned in_colorCount);
+
+  unsigned stitchCount() const;
+  unsigned rowCount() const;
+  unsigned colorCount() const;
+  unsigned bitsPerStitch() const;
+  bool isEmpty() const;
+
+  unsigned index(unsigned in_stitch, unsigned in_row) const;
+  void setIndex(unsigned in_stitch, unsigned in_row, unsigned in_index);
+  // packs in_stitchCount indices into a row, negative indices are stored as 0
+  void setRow(unsigned in_row, const int32_t* in_indices);
+  void unpackRow(unsigned in_row, int32_t* out_indices) const;
+  const uint64_t* rowWords(unsigned in_row) const;
+  size_t wordsPerRow() const;
+
+  // number of stitches per palette index, counted a whole word at a time
+  std::vector<size_t> colorCounts() const;
+  // bytes held by the packed indices
+  size_t byteSize() const;
+
+  bool operator==(const StitchChart& in_other) const;
+  bool operator!=(const StitchChart& in_other) const;
+
+private:
+  unsigned stitches;
+  unsigned rows;
+  unsigned colors;
+  unsigned bits;
+  size_t rowStride;
+  std::vector<uint64_t> words;
+};
+}
\ No newline at end of file
@@ -1,12 +1,8 @@
-#include "Calculus.h"
-#include <optional>
-#include <set>
+#include "calculus.h"
+#include <limits>
 
 namespace
 {
-  std::optional<unsigned> divides(unsigned number, unsigned divisor);
-  std::set<unsigned> divisors(unsigned x);
-  unsigned search_greatest_common_divisor(unsigned smallerValue, unsigned largerValue);
   unsigned least_common_multiple(const std::vector<unsigned>& values);
 }
 
@@ -14,26 +10,17 @@ namespace calculus
 {
   unsigned greatest_common_divisor(unsigned a, unsigned b)
   {
-    if (a == b)
-    {
-      return a;
-    }
-    if (a < b)
+    if (a == 0 || b == 0)
     {
-      if (divides(b, a).has_value())
-      {
-        return a;
-      }
-      return search_greatest_common_divisor(a, b);
+      return 0;
     }
-    else
+    while (b != 0)
     {
-      if (divides(a, b).has_value())
-      {
-        return b;
-      }
-      return search_greatest_common_divisor(b, a);
+      const unsigned remainder{ a % b };
+      a = b;
+      b = remainder;
     }
+    return a;
   }
 
   unsigned least_common_multiple(unsigned a, unsigned b)
@@ -42,69 +29,36 @@ namespace calculus
     {
       return 0;
     }
-    if (divides(b, a).has_value())
-    {
-      return b;
-    }
-    if (divides(a, b).has_value())
-    {
-      return a;
-    }
-    unsigned gcd = greatest_common_divisor(a, b);
-    return a * b / gcd;//gcd * (a / gcd) * (b / gcd);
-  }
-}
-
-namespace
-{
-  std::optional<unsigned> divides(unsigned number, unsigned divisor)
-  {
-    if (number == 0 || divisor == 0)
+    // divide first, a * b alone overflows long before the result does
+    const auto result{ checked_multiply(a / greatest_common_divisor(a, b), b) };
+    if (!result || *result > std::numeric_limits<unsigned>::max())
     {
       return 0;
     }
-    unsigned result = number / divisor;
-    if (result * divisor == number)
-    {
-      return result;
-    }
-    return std::optional<unsigned>{};
+    return (unsigned)*result;
   }
 
-  std::set<unsigned> divisors(unsigned x)
+  std::optional<unsigned long long> checked_add(unsigned long long a, unsigned long long b)
   {
-    std::set<unsigned> divisors;
-    for (unsigned factor = 1; factor <= sqrt(x); ++factor)
+    if (a > std::numeric_limits<unsigned long long>::max() - b)
     {
-      auto result = divides(x, factor);
-      if (result.has_value())
-      {
-        divisors.insert(factor);
-        divisors.insert(result.value());
-      }
+      return std::nullopt;
     }
-    return divisors;
+    return a + b;
   }
-  unsigned search_greatest_common_divisor(unsigned smallerValue, unsigned largerValue)
-  {
-    auto divisors_smaller = divisors(smallerValue);
-    auto divisors_larger = divisors(largerValue);
 
-    if (divisors_smaller.empty())
-    {
-      return 0;
-    }
-
-    for (auto divisor = divisors_smaller.rbegin(); divisor != divisors_smaller.rend(); ++divisor)
+  std::optional<unsigned long long> checked_multiply(unsigned long long a, unsigned long long b)
+  {
+    if (a != 0 && b > std::numeric_limits<unsigned long long>::max() / a)
     {
-      if (std::find(divisors_larger.begin(), divisors_larger.end(), *divisor) != divisors_larger.end())
-      {
-        return *divisor;
-      }
+      return std::nullopt;
     }
-    return 1;
+    return a * b;
   }
+}
 
+namespace
+{
   unsigned least_common_multiple(const std::vector<unsigned>& values)
   {
     if (values.size() < 3)
@@ -139,111 +93,35 @@ namespace
 #ifdef DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest.h>
 
-TEST_CASE("test divides") {
-  auto result = divides(25, 3);
-  CHECK(!result.has_value());
-
-  result = divides(24, 3);
-  CHECK(result.has_value());
-  CHECK_EQ(result.value(), 8);
-
-  result = divides(3, 3);
-  CHECK(result.has_value());
-  CHECK_EQ(result.value(), 1);
-
-  result = divides(16, 4);
-  CHECK(result.has_value());
-  CHECK_EQ(result.value(), 4);
-
-  result = divides(0, 2);
-  CHECK(result.has_value());
-  CHECK_EQ(result.value(), 0);
-
-  result = divides(5, 0);
-  CHECK(result.has_value());
-  CHECK_EQ(result.value(), 0);
-
-  result = divides(0, 0);
-  CHECK(result.has_value());
-  CHECK_EQ(result.value(), 0);
-
-  result = divides(1953125, 16777216);
-  CHECK(!result.has_value());
-}
-
-TEST_CASE("test divisors") {
-  std::set<unsigned> result;
-
-  result = divisors(5);
-  CHECK_EQ(result.size(), 2);
-  CHECK_NE(result.find(1), result.end());
-  CHECK_NE(result.find(5), result.end());
-
-  result = divisors(16);
-  CHECK_EQ(result.size(), 5);
-  CHECK_NE(result.find(1), result.end());
-  CHECK_NE(result.find(2), result.end());
-  CHECK_NE(result.find(4), result.end());
-  CHECK_NE(result.find(8), result.end());
-  CHECK_NE(result.find(16), result.end());
-
-  result = divisors(24);
-  CHECK_EQ(result.size(), 8);
-  CHECK_NE(result.find(1), result.end());
-  CHECK_NE(result.find(2), result.end());
-  CHECK_NE(result.find(3), result.end());
-  CHECK_NE(result.find(4), result.end());
-  CHECK_NE(result.find(6), result.end());
-  CHECK_NE(result.find(8), result.end());
-  CHECK_NE(result.find(12), result.end());
-  CHECK_NE(result.find(24), result.end());
-
-  result = divisors(36);
-  CHECK_EQ(result.size(), 9);
-  CHECK_NE(result.find(1), result.end());
-  CHECK_NE(result.find(2), result.end());
-  CHECK_NE(result.find(3), result.end());
-  CHECK_NE(result.find(4), result.end());
-  CHECK_NE(result.find(6), result.end());
-  CHECK_NE(result.find(9), result.end());
-  CHECK_NE(result.find(12), result.end());
-  CHECK_NE(result.find(18), result.end());
-  CHECK_NE(result.find(36), result.end());
-
-  result = divisors(8192); // 2^13
-  CHECK_EQ(result.size(), 14);
-  unsigned factorInlist = 1;
-  for (auto i = 0; i < 14; ++i)
-  {
-    CHECK_NE(result.find(factorInlist), result.end());
-    factorInlist *= 2;
-  }
-
-  result = divisors(262144); // 2^18
-  CHECK_EQ(result.size(), 19);
-  factorInlist = 1;
-  for (auto i = 0; i < 19; ++i)
-  {
-    CHECK_NE(result.find(factorInlist), result.end());
-    factorInlist *= 2;
-  }
-}
-
-TEST_CASE("test search_greatest_common_divisor") {
-  CHECK_EQ(search_greatest_common_divisor(5, 3), 1);
-  CHECK_EQ(search_greatest_common_divisor(59049, 262144), 1);
-  CHECK_EQ(search_greatest_common_divisor(1024, 262144), 1024);
-  CHECK_EQ(search_greatest_common_divisor(24, 36), 12);
-  CHECK_EQ(search_greatest_common_divisor(0, 36), 0);
-}
-
 TEST_CASE("test greatest_common_divisor") {
   CHECK_EQ(calculus::greatest_common_divisor(5, 3), 1);
   CHECK_EQ(calculus::greatest_common_divisor(262144, 59049), 1);
   CHECK_EQ(calculus::greatest_common_divisor(262144, 1024), 1024);
   CHECK_EQ(calculus::greatest_common_divisor(1024, 262144), 1024);
   CHECK_EQ(calculus::greatest_common_divisor(36, 24), 12);
+  CHECK_EQ(calculus::greatest_common_divisor(24, 36), 12);
+  CHECK_EQ(calculus::greatest_common_divisor(17, 17), 17);
   CHECK_EQ(calculus::greatest_common_divisor(36, 0), 0);
+  CHECK_EQ(calculus::greatest_common_divisor(0, 36), 0);
+  // consecutive Fibonacci numbers are Euclid's worst case
+  CHECK_EQ(calculus::greatest_common_divisor(2971215073u, 1836311903u), 1);
+  CHECK_EQ(calculus::greatest_common_divisor(4294967295u, 4294967295u - 2), 1);
+  CHECK_EQ(calculus::greatest_common_divisor(4294967295u, 65535u), 65535);
+}
+
+TEST_CASE("test greatest_common_divisor matches a divisor search") {
+  for (unsigned a = 1; a <= 120; ++a)
+  {
+    for (unsigned b = 1; b <= 120; ++b)
+    {
+      unsigned expected{ 1 };
+      for (unsigned divisor = 1; divisor <= a && divisor <= b; ++divisor)
+      {
+        if (a % divisor == 0 && b % divisor == 0) expected = divisor;
+      }
+      CHECK_EQ(calculus::greatest_common_divisor(a, b), expected);
+    }
+  }
 }
 
 TEST_CASE("test pair-based least_common_multiple") {
@@ -259,6 +137,31 @@ TEST_CASE("test pair-based least_common_multiple") {
   CHECK_EQ(calculus::least_common_multiple(0, 0), 0);
 }
 
+TEST_CASE("test least_common_multiple doesn't overflow") {
+  // a * b overflows, the result doesn't
+  CHECK_EQ(calculus::least_common_multiple(4294967295u, 65535u), 4294967295u);
+  CHECK_EQ(calculus::least_common_multiple(2147483648u, 1073741824u), 2147483648u);
+  CHECK_EQ(calculus::least_common_multiple(65536u, 65535u), 4294901760u);
+  // the result itself doesn't fit
+  CHECK_EQ(calculus::least_common_multiple(65537u, 65536u), 0);
+  CHECK_EQ(calculus::least_common_multiple(4294967295u, 4294967294u), 0);
+}
+
+TEST_CASE("test checked arithmetic") {
+  const unsigned long long largest{ std::numeric_limits<unsigned long long>::max() };
+  CHECK_EQ(calculus::checked_add(2, 3).value(), 5u);
+  CHECK_EQ(calculus::checked_add(largest, 0).value(), largest);
+  CHECK_FALSE(calculus::checked_add(largest, 1).has_value());
+  CHECK_FALSE(calculus::checked_add(largest / 2 + 1, largest / 2 + 1).has_value());
+
+  CHECK_EQ(calculus::checked_multiply(6, 7).value(), 42u);
+  CHECK_EQ(calculus::checked_multiply(0, largest).value(), 0u);
+  CHECK_EQ(calculus::checked_multiply(largest, 1).value(), largest);
+  CHECK_EQ(calculus::checked_multiply(4294967295ull, 4294967297ull).value(), largest);
+  CHECK_FALSE(calculus::checked_multiply(4294967296ull, 4294967296ull).has_value());
+  CHECK_FALSE(calculus::checked_multiply(largest, 2).has_value());
+}
+
 TEST_CASE("test vector-based least_common_multiple")
 {
   CHECK_EQ(least_common_multiple({ 16, 8 }), 16);
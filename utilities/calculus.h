@@ -1,7 +1,14 @@
 #pragma once
 #include <vector>
+#include <optional>
 namespace calculus
 {
+  // Euclid's algorithm, 0 if either value is 0
   unsigned greatest_common_divisor(unsigned a, unsigned b);
+  // 0 if either value is 0 or the result doesn't fit an unsigned
   unsigned least_common_multiple(unsigned a, unsigned b);
+
+  // a + b and a * b, empty if the result overflows
+  std::optional<unsigned long long> checked_add(unsigned long long a, unsigned long long b);
+  std::optional<unsigned long long> checked_multiply(unsigned long long a, unsigned long long b);
 }
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include "cropping.h"
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+  enum class Alignment
+  {
+    LEADING,
+    CENTERED,
+    TRAILING,
+  };
+  Alignment horizontalAlignment(one_bit::CropRegion anchor);
+  Alignment verticalAlignment(one_bit::CropRegion anchor);
+  unsigned alignedOffset(unsigned available, unsigned used, Alignment alignment);
+}
+
+namespace cropping
+{
+  Rectangle crop_to_aspect_ratio(unsigned imageWidth, unsigned imageHeight, double targetAspectRatio, one_bit::CropRegion anchor)
+  {
+    if (imageWidth == 0 || imageHeight == 0 || !(targetAspectRatio > 0.))
+    {
+      return Rectangle{ 0, 0, imageWidth, imageHeight };
+    }
+    unsigned width{ imageWidth };
+    unsigned height{ imageHeight };
+    const double imageAspectRatio{ 1. * imageHeight / imageWidth };
+    if (imageAspectRatio > targetAspectRatio)
+    {
+      // image is too tall, use the full width
+      height = std::clamp((unsigned)std::lround(imageWidth * targetAspectRatio), 1u, imageHeight);
+    }
+    else
+    {
+      // image is too wide, use the full height
+      width = std::clamp((unsigned)std::lround(imageHeight / targetAspectRatio), 1u, imageWidth);
+    }
+    return Rectangle{
+      alignedOffset(imageWidth, width, horizontalAlignment(anchor)),
+      alignedOffset(imageHeight, height, verticalAlignment(anchor)),
+      width,
+      height
+    };
+  }
+}
+
+namespace
+{
+  Alignment horizontalAlignment(one_bit::CropRegion anchor)
+  {
+    switch (anchor)
+    {
+    case one_bit::CropRegion::TOP_LEFT:
+    case one_bit::CropRegion::LEFT:
+    case one_bit::CropRegion::BOTTOM_LEFT:
+      return Alignment::LEADING;
+    case one_bit::CropRegion::TOP_RIGHT:
+    case one_bit::CropRegion::RIGHT:
+    case one_bit::CropRegion::BOTTOM_RIGHT:
+      return Alignment::TRAILING;
+    default:
+      return Alignment::CENTERED;
+    }
+  }
+
+  Alignment verticalAlignment(one_bit::CropRegion anchor)
+  {
+    switch (anchor)
+    {
+    case one_bit::CropRegion::TOP_LEFT:
+    case one_bit::CropRegion::TOP:
+    case one_bit::CropRegion::TOP_RIGHT:
+      return Alignment::LEADING;
+    case one_bit::CropRegion::BOTTOM_LEFT:
+    case one_bit::CropRegion::BOTTOM:
+    case one_bit::CropRegion::BOTTOM_RIGHT:
+      return Alignment::TRAILING;
+    default:
+      return Alignment::CENTERED;
+    }
+  }
+
+  unsigned alignedOffset(unsigned available, unsigned used, Alignment alignment)
+  {
+    switch (alignment)
+    {
+    case Alignment::LEADING:
+      return 0;
+    case Alignment::TRAILING:
+      return available - used;
+    default:
+      return (available - used) / 2;
+    }
+  }
+}
+
+#ifdef DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest.h>
+
+TEST_CASE("test alignedOffset") {
+  CHECK_EQ(alignedOffset(100, 40, Alignment::LEADING), 0);
+  CHECK_EQ(alignedOffset(100, 40, Alignment::CENTERED), 30);
+  CHECK_EQ(alignedOffset(100, 40, Alignment::TRAILING), 60);
+  CHECK_EQ(alignedOffset(100, 100, Alignment::TRAILING), 0);
+}
+
+TEST_CASE("test crop_to_aspect_ratio keeps matching images") {
+  auto region = cropping::crop_to_aspect_ratio(200, 100, .5, one_bit::CropRegion::CENTER);
+  CHECK_EQ(region.x, 0);
+  CHECK_EQ(region.y, 0);
+  CHECK_EQ(region.width, 200);
+  CHECK_EQ(region.height, 100);
+}
+
+TEST_CASE("test crop_to_aspect_ratio on wide images") {
+  // 400x100 image cropped to a square uses the full height
+  auto region = cropping::crop_to_aspect_ratio(400, 100, 1., one_bit::CropRegion::TOP_LEFT);
+  CHECK_EQ(region.x, 0);
+  CHECK_EQ(region.y, 0);
+  CHECK_EQ(region.width, 100);
+  CHECK_EQ(region.height, 100);
+
+  region = cropping::crop_to_aspect_ratio(400, 100, 1., one_bit::CropRegion::TOP);
+  CHECK_EQ(region.x, 150);
+  CHECK_EQ(region.y, 0);
+
+  region = cropping::crop_to_aspect_ratio(400, 100, 1., one_bit::CropRegion::BOTTOM_RIGHT);
+  CHECK_EQ(region.x, 300);
+  CHECK_EQ(region.y, 0);
+  CHECK_EQ(region.width, 100);
+}
+
+TEST_CASE("test crop_to_aspect_ratio on tall images") {
+  // 100x400 image cropped to 2:1 height by width uses the full width
+  auto region = cropping::crop_to_aspect_ratio(100, 400, 2., one_bit::CropRegion::TOP_LEFT);
+  CHECK_EQ(region.x, 0);
+  CHECK_EQ(region.y, 0);
+  CHECK_EQ(region.width, 100);
+  CHECK_EQ(region.height, 200);
+
+  region = cropping::crop_to_aspect_ratio(100, 400, 2., one_bit::CropRegion::CENTER);
+  CHECK_EQ(region.y, 100);
+
+  region = cropping::crop_to_aspect_ratio(100, 400, 2., one_bit::CropRegion::BOTTOM_LEFT);
+  CHECK_EQ(region.x, 0);
+  CHECK_EQ(region.y, 200);
+
+  region = cropping::crop_to_aspect_ratio(100, 400, 2., one_bit::CropRegion::RIGHT);
+  CHECK_EQ(region.x, 0);
+  CHECK_EQ(region.y, 100);
+}
+
+TEST_CASE("test crop_to_aspect_ratio with degenerate input") {
+  auto region = cropping::crop_to_aspect_ratio(0, 400, 2., one_bit::CropRegion::CENTER);
+  CHECK_EQ(region.width, 0);
+  CHECK_EQ(region.height, 400);
+
+  region = cropping::crop_to_aspect_ratio(100, 400, 0., one_bit::CropRegion::CENTER);
+  CHECK_EQ(region.width, 100);
+  CHECK_EQ(region.height, 400);
+
+  // extreme ratios never produce an empty region
+  region = cropping::crop_to_aspect_ratio(100, 100, 1000., one_bit::CropRegion::CENTER);
+  CHECK_EQ(region.width, 1);
+  CHECK_EQ(region.height, 100);
+}
+#endif
\ No newline at end of file
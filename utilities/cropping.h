@@ -0,0 +1,16 @@
+#pragma once
+#include "setting_enums.h"
+
+namespace cropping
+{
+  struct Rectangle
+  {
+    unsigned x;
+    unsigned y;
+    unsigned width;
+    unsigned height;
+  };
+
+  // largest region of the given image with an aspect ratio (height / width) of targetAspectRatio, placed according to the anchor
+  Rectangle crop_to_aspect_ratio(unsigned imageWidth, unsigned imageHeight, double targetAspectRatio, one_bit::CropRegion anchor);
+}
\ No newline at end of file
@@ -16,5 +16,9 @@ namespace errors
   Code constexpr WRITE_ERROR = 10;
   Code constexpr DUPLICATE_COLOR = 11;
   Code constexpr INVALID_COLOR = 12;
+  Code constexpr PIXELATION_CANCELLED = 13;
+  Code constexpr INVALID_PALETTE_SIZE = 14;
+  Code constexpr INVALID_DITHER_MODE = 15;
+  Code constexpr INVALID_CATALOG = 16;
   Code constexpr NOT_IMPLEMENTED = -1;
 }
\ No newline at end of file
@@ -0,0 +1,389 @@
+#include "geometry.h"
+#include "calculus.h"
+#include <limits>
+#include <cmath>
+
+namespace
+{
+  // numerator / denominator, which stand for the stixel's height and width
+  struct Fraction
+  {
+    unsigned long long numerator;
+    unsigned long long denominator;
+  };
+
+  // bounds of the stixels that fit the limits
+  struct Bounds
+  {
+    unsigned long long maxSize;
+    unsigned long long maxArea;
+
+    bool fit(const Fraction& stixel) const;
+  };
+
+  // -1, 0 or 1 as first is less than, equal to or greater than second, exact for any value
+  int compare(Fraction first, Fraction second);
+  // first + steps * second, empty on overflow
+  std::optional<Fraction> advance(const Fraction& first, unsigned long long steps, const Fraction& second);
+  // largest number of steps in [1, maxSteps] for which advance(first, steps, second) still fits, assuming 1 does
+  unsigned long long fitting_steps(const Fraction& first, unsigned long long maxSteps, const Fraction& second, const Bounds& bounds);
+  // the piece's length in stitches or rows, rounded up
+  std::optional<unsigned> stitches(unsigned lengthCm, unsigned perGauge);
+}
+
+namespace geometry
+{
+  unsigned long long ChartGeometry::pixelWidth() const
+  {
+    return (unsigned long long)stitchCount * stixel.width;
+  }
+
+  unsigned long long ChartGeometry::pixelHeight() const
+  {
+    return (unsigned long long)rowCount * stixel.height;
+  }
+
+  std::optional<ChartGeometry> chart_geometry(unsigned widthCm, unsigned heightCm, unsigned rowsPerGauge, unsigned stitchesPerGauge, const Limits& limits)
+  {
+    const auto stitchCount{ stitches(widthCm, stitchesPerGauge) };
+    const auto rowCount{ stitches(heightCm, rowsPerGauge) };
+    if (!stitchCount || !rowCount || *stitchCount == 0 || *rowCount == 0)
+    {
+      return std::nullopt;
+    }
+    // the pixel budget, shared out evenly among all stitches
+    unsigned long long maxArea{ 0 };
+    if (limits.maxPixels > 0)
+    {
+      maxArea = limits.maxPixels / ((unsigned long long)*stitchCount * *rowCount);
+      if (maxArea == 0)
+      {
+        return std::nullopt;
+      }
+    }
+    const auto stixel{ closest_stixel_size(rowsPerGauge, stitchesPerGauge, limits.maxStixelSize, maxArea) };
+    if (!stixel)
+    {
+      return std::nullopt;
+    }
+    return ChartGeometry{ *stitchCount, *rowCount, *stixel };
+  }
+
+  std::optional<StixelSize> closest_stixel_size(unsigned rowsPerGauge, unsigned stitchesPerGauge, unsigned maxSize, unsigned long long maxArea)
+  {
+    if (rowsPerGauge == 0 || stitchesPerGauge == 0)
+    {
+      return std::nullopt;
+    }
+    // a stitch is 10 / stitchesPerGauge cm wide and 10 / rowsPerGauge cm tall
+    const unsigned divisor{ calculus::greatest_common_divisor(rowsPerGauge, stitchesPerGauge) };
+    const Fraction target{ stitchesPerGauge / divisor, rowsPerGauge / divisor };
+    const Bounds bounds{
+      maxSize > 0 ? maxSize : std::numeric_limits<unsigned>::max(),
+      maxArea > 0 ? maxArea : std::numeric_limits<unsigned long long>::max()
+    };
+
+    // walk down the Stern-Brocot tree towards the target, all fractions below a node have a larger numerator and denominator.
+    // Once a node doesn't fit, the best fitting fraction is one of the two that bracket it.
+    // Consecutive steps in the same direction are taken at once, so this takes logarithmic time like Euclid's algorithm.
+    Fraction lower{ 0, 1 };
+    Fraction upper{ 1, 0 };
+    while (true)
+    {
+      const auto mediant{ advance(lower, 1, upper) };
+      if (!mediant || !bounds.fit(*mediant))
+      {
+        break;
+      }
+      // all numerators and denominators fit an unsigned here, so none of these products overflows
+      const unsigned long long mediantSide{ mediant->numerator * target.denominator };
+      const unsigned long long targetSide{ target.numerator * mediant->denominator };
+      if (mediantSide == targetSide)
+      {
+        lower = *mediant;
+        upper = *mediant;
+        break;
+      }
+      const unsigned long long lowerGap{ target.numerator * lower.denominator - lower.numerator * target.denominator };
+      const unsigned long long upperGap{ upper.numerator * target.denominator - target.numerator * upper.denominator };
+      if (mediantSide < targetSide)
+      {
+        // lower moves towards the target while it stays below, reaching the target itself is up to the mediant check
+        const unsigned long long maxSteps{ (lowerGap - 1) / upperGap };
+        const unsigned long long steps{ fitting_steps(lower, maxSteps, upper, bounds) };
+        lower = *advance(lower, steps, upper);
+        if (steps < maxSteps) break;
+      }
+      else
+      {
+        const unsigned long long maxSteps{ (upperGap - 1) / lowerGap };
+        const unsigned long long steps{ fitting_steps(upper, maxSteps, lower, bounds) };
+        upper = *advance(upper, steps, lower);
+        if (steps < maxSteps) break;
+      }
+    }
+
+    auto aspectError = [&target](const Fraction& stixel) {
+      return (long double)(stixel.numerator * target.denominator) / (long double)(stixel.denominator * target.numerator) - 1.;
+    };
+    // 0/1 and 1/0 only bracket the tree, they are no stixels
+    const bool lowerValid{ lower.numerator > 0 };
+    const bool upperValid{ upper.denominator > 0 };
+    if (!lowerValid && !upperValid)
+    {
+      return std::nullopt;
+    }
+    Fraction best{ lowerValid ? lower : upper };
+    if (lowerValid && upperValid)
+    {
+      // both relative errors share the target's numerator: the gaps to the target over the stixel widths.
+      // The smaller stixel wins a tie, it takes less memory.
+      const Fraction lowerError{ target.numerator * lower.denominator - lower.numerator * target.denominator, lower.denominator };
+      const Fraction upperError{ upper.numerator * target.denominator - target.numerator * upper.denominator, upper.denominator };
+      const int comparison{ compare(upperError, lowerError) };
+      if (comparison < 0 || (comparison == 0 && upper.numerator * upper.denominator < lower.numerator * lower.denominator))
+      {
+        best = upper;
+      }
+    }
+    return StixelSize{ (unsigned)best.denominator, (unsigned)best.numerator, (double)aspectError(best) };
+  }
+}
+
+namespace
+{
+  bool Bounds::fit(const Fraction& stixel) const
+  {
+    if (stixel.numerator > maxSize || stixel.denominator > maxSize)
+    {
+      return false;
+    }
+    const auto area{ calculus::checked_multiply(stixel.numerator, stixel.denominator) };
+    return area && *area <= maxArea;
+  }
+
+  int compare(Fraction first, Fraction second)
+  {
+    // compares the integral parts, then the reciprocals of the remainders, just like Euclid's algorithm
+    int sign{ 1 };
+    while (true)
+    {
+      const unsigned long long firstWhole{ first.numerator / first.denominator };
+      const unsigned long long secondWhole{ second.numerator / second.denominator };
+      if (firstWhole != secondWhole)
+      {
+        return firstWhole < secondWhole ? -sign : sign;
+      }
+      const unsigned long long firstRemainder{ first.numerator % first.denominator };
+      const unsigned long long secondRemainder{ second.numerator % second.denominator };
+      if (firstRemainder == 0 || secondRemainder == 0)
+      {
+        return (firstRemainder == secondRemainder) ? 0 : (firstRemainder == 0 ? -sign : sign);
+      }
+      first = Fraction{ first.denominator, firstRemainder };
+      second = Fraction{ second.denominator, secondRemainder };
+      sign = -sign;
+    }
+  }
+
+  std::optional<Fraction> advance(const Fraction& first, unsigned long long steps, const Fraction& second)
+  {
+    const auto numeratorSteps{ calculus::checked_multiply(steps, second.numerator) };
+    const auto denominatorSteps{ calculus::checked_multiply(steps, second.denominator) };
+    if (!numeratorSteps || !denominatorSteps)
+    {
+      return std::nullopt;
+    }
+    const auto numerator{ calculus::checked_add(first.numerator, *numeratorSteps) };
+    const auto denominator{ calculus::checked_add(first.denominator, *denominatorSteps) };
+    if (!numerator || !denominator)
+    {
+      return std::nullopt;
+    }
+    return Fraction{ *numerator, *denominator };
+  }
+
+  unsigned long long fitting_steps(const Fraction& first, unsigned long long maxSteps, const Fraction& second, const Bounds& bounds)
+  {
+    unsigned long long fitting{ 1 };
+    unsigned long long failing{ maxSteps + 1 };
+    while (failing - fitting > 1)
+    {
+      const unsigned long long steps{ fitting + (failing - fitting) / 2 };
+      const auto stixel{ advance(first, steps, second) };
+      if (stixel && bounds.fit(*stixel))
+      {
+        fitting = steps;
+      }
+      else
+      {
+        failing = steps;
+      }
+    }
+    return fitting;
+  }
+
+  std::optional<unsigned> stitches(unsigned lengthCm, unsigned perGauge)
+  {
+    // the gauge is given per 10 cm, so this is lengthCm * perGauge / 10 rounded up, in integers to round exactly
+    const auto tenths{ calculus::checked_multiply(lengthCm, perGauge) };
+    if (!tenths || (*tenths + 9) / 10 > std::numeric_limits<unsigned>::max())
+    {
+      return std::nullopt;
+    }
+    return (unsigned)((*tenths + 9) / 10);
+  }
+}
+
+#ifdef DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest.h>
+
+// closest_stixel_size by trying every width
+geometry::StixelSize search_stixel_size(unsigned rowsPerGauge, unsigned stitchesPerGauge, unsigned maxSize, unsigned long long maxArea)
+{
+  const double target{ 1. * stitchesPerGauge / rowsPerGauge };
+  geometry::StixelSize best{ 0, 0, std::numeric_limits<double>::max() };
+  for (unsigned width = 1; width <= maxSize; ++width)
+  {
+    for (unsigned height = 1; height <= maxSize && width * height <= maxArea; ++height)
+    {
+      const double error{ 1. * height / width / target - 1. };
+      const bool closer{ std::abs(error) < std::abs(best.aspectError) - 1e-12 };
+      const bool smaller{ std::abs(error) <= std::abs(best.aspectError) + 1e-12 && width * height < best.width * best.height };
+      if (closer || smaller) best = geometry::StixelSize{ width, height, error };
+    }
+  }
+  return best;
+}
+
+TEST_CASE("test exact fraction comparison") {
+  CHECK_EQ(compare(Fraction{ 1, 2 }, Fraction{ 2, 4 }), 0);
+  CHECK_EQ(compare(Fraction{ 1, 3 }, Fraction{ 1, 2 }), -1);
+  CHECK_EQ(compare(Fraction{ 7, 2 }, Fraction{ 10, 3 }), 1);
+  CHECK_EQ(compare(Fraction{ 6, 2 }, Fraction{ 10, 3 }), -1);
+  CHECK_EQ(compare(Fraction{ 0, 5 }, Fraction{ 0, 7 }), 0);
+  // cross products of these overflow
+  const unsigned long long large{ 18446744073709551557ull };
+  CHECK_EQ(compare(Fraction{ large - 1, large }, Fraction{ large - 2, large - 1 }), 1);
+  CHECK_EQ(compare(Fraction{ large - 2, large - 1 }, Fraction{ large - 1, large }), -1);
+  CHECK_EQ(compare(Fraction{ large, large - 1 }, Fraction{ large, large - 1 }), 0);
+}
+
+TEST_CASE("test exact stixel sizes") {
+  // the least common multiple of both gauges, divided by each of them
+  auto stixel = geometry::closest_stixel_size(30, 22, 0, 0);
+  REQUIRE(stixel.has_value());
+  CHECK_EQ(stixel->width, 15);
+  CHECK_EQ(stixel->height, 11);
+  CHECK_EQ(stixel->aspectError, 0.);
+
+  stixel = geometry::closest_stixel_size(31, 23, 0, 0);
+  REQUIRE(stixel.has_value());
+  CHECK_EQ(stixel->width, 31);
+  CHECK_EQ(stixel->height, 23);
+
+  stixel = geometry::closest_stixel_size(20, 20, 1, 1);
+  REQUIRE(stixel.has_value());
+  CHECK_EQ(stixel->width, 1);
+  CHECK_EQ(stixel->height, 1);
+
+  stixel = geometry::closest_stixel_size(1, 1000, 1000, 0);
+  REQUIRE(stixel.has_value());
+  CHECK_EQ(stixel->width, 1);
+  CHECK_EQ(stixel->height, 1000);
+}
+
+TEST_CASE("test approximated stixel sizes") {
+  // 31 x 23 doesn't fit, 4 x 3 is the closest ratio that does
+  auto stixel = geometry::closest_stixel_size(31, 23, 4, 0);
+  REQUIRE(stixel.has_value());
+  CHECK_EQ(stixel->width, 4);
+  CHECK_EQ(stixel->height, 3);
+  CHECK_EQ(stixel->aspectError, doctest::Approx(3. / 4. * 31. / 23. - 1.));
+
+  // the area limit alone works the same way
+  stixel = geometry::closest_stixel_size(31, 23, 0, 12);
+  REQUIRE(stixel.has_value());
+  CHECK_EQ(stixel->width, 4);
+  CHECK_EQ(stixel->height, 3);
+
+  // large co-prime gauges that used to overflow
+  stixel = geometry::closest_stixel_size(4294967291u, 4294967279u, 64, 0);
+  REQUIRE(stixel.has_value());
+  CHECK_EQ(stixel->width, 1);
+  CHECK_EQ(stixel->height, 1);
+  CHECK_LT(std::abs(stixel->aspectError), 1e-8);
+
+  stixel = geometry::closest_stixel_size(4294967291u, 4294967279u, 0, 0);
+  REQUIRE(stixel.has_value());
+  CHECK_LT(std::abs(stixel->aspectError), 1e-17);
+
+  // ratios beyond the size limit get as close as they can
+  stixel = geometry::closest_stixel_size(1, 1000, 10, 0);
+  REQUIRE(stixel.has_value());
+  CHECK_EQ(stixel->width, 1);
+  CHECK_EQ(stixel->height, 10);
+  CHECK_LT(stixel->aspectError, 0.);
+  stixel = geometry::closest_stixel_size(1000, 1, 10, 0);
+  REQUIRE(stixel.has_value());
+  CHECK_EQ(stixel->width, 10);
+  CHECK_EQ(stixel->height, 1);
+  CHECK_GT(stixel->aspectError, 0.);
+}
+
+TEST_CASE("test stixel sizes match a search") {
+  for (unsigned rows = 1; rows <= 40; ++rows)
+  {
+    for (unsigned stitches = 1; stitches <= 40; ++stitches)
+    {
+      for (auto [maxSize, maxArea] : { std::pair<unsigned, unsigned long long>{ 8, 0 }, { 20, 60 }, { 13, 7 } })
+      {
+        CAPTURE(rows);
+        CAPTURE(stitches);
+        CAPTURE(maxSize);
+        const auto stixel{ geometry::closest_stixel_size(rows, stitches, maxSize, maxArea) };
+        const auto expected{ search_stixel_size(rows, stitches, maxSize, maxArea > 0 ? maxArea : std::numeric_limits<unsigned long long>::max()) };
+        REQUIRE(stixel.has_value());
+        CHECK_EQ(std::abs(stixel->aspectError), doctest::Approx(std::abs(expected.aspectError)));
+        CHECK_EQ(stixel->width * stixel->height, expected.width * expected.height);
+        CHECK_LE(stixel->width, maxSize);
+        CHECK_LE(stixel->height, maxSize);
+      }
+    }
+  }
+}
+
+TEST_CASE("test chart geometry") {
+  auto chart = geometry::chart_geometry(20, 20, 30, 22, geometry::Limits{ 64, 0 });
+  REQUIRE(chart.has_value());
+  CHECK_EQ(chart->stitchCount, 44);
+  CHECK_EQ(chart->rowCount, 60);
+  CHECK_EQ(chart->stixel.width, 15);
+  CHECK_EQ(chart->stixel.height, 11);
+  CHECK_EQ(chart->pixelWidth(), 660u);
+  CHECK_EQ(chart->pixelHeight(), 660u);
+
+  // rounded up exactly, 23 cm at 10 stitches are 23 stitches
+  chart = geometry::chart_geometry(23, 7, 3, 10, geometry::Limits{ 0, 0 });
+  REQUIRE(chart.has_value());
+  CHECK_EQ(chart->stitchCount, 23);
+  CHECK_EQ(chart->rowCount, 3);
+
+  // square stitches stay 1 x 1 no matter how much of the budget is left
+  chart = geometry::chart_geometry(20, 20, 30, 30, geometry::Limits{ 0, 25000 });
+  REQUIRE(chart.has_value());
+  CHECK_EQ(chart->stixel.width, 1);
+  CHECK_EQ(chart->stixel.height, 1);
+  chart = geometry::chart_geometry(20, 20, 31, 23, geometry::Limits{ 0, 46 * 62 * 12 });
+  REQUIRE(chart.has_value());
+  CHECK_EQ(chart->stixel.width, 4);
+  CHECK_EQ(chart->stixel.height, 3);
+  CHECK_LE(chart->pixelWidth() * chart->pixelHeight(), 46u * 62u * 12u);
+
+  CHECK_FALSE(geometry::chart_geometry(20, 20, 30, 30, geometry::Limits{ 0, 3599 }).has_value());
+  CHECK_FALSE(geometry::chart_geometry(0, 20, 30, 30, geometry::Limits{ 0, 0 }).has_value());
+  CHECK_FALSE(geometry::chart_geometry(20, 20, 0, 30, geometry::Limits{ 0, 0 }).has_value());
+  // more stitches than an unsigned holds
+  CHECK_FALSE(geometry::chart_geometry(4294967295u, 20, 30, 30, geometry::Limits{ 0, 0 }).has_value());
+}
+#endif
\ No newline at end of file
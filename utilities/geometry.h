@@ -0,0 +1,40 @@
+#pragma once
+#include <optional>
+
+namespace geometry
+{
+  // upper bounds for a chart's result image, 0 leaves a bound open
+  struct Limits
+  {
+    unsigned maxStixelSize;
+    unsigned long long maxPixels;
+  };
+
+  // a stixel of width x height pixels standing in for one stitch
+  struct StixelSize
+  {
+    unsigned width;
+    unsigned height;
+    // relative deviation of height / width from the stitch's aspect ratio, positive if the stixel is too tall
+    double aspectError;
+  };
+
+  struct ChartGeometry
+  {
+    unsigned stitchCount;
+    unsigned rowCount;
+    StixelSize stixel;
+
+    unsigned long long pixelWidth() const;
+    unsigned long long pixelHeight() const;
+  };
+
+  // stitches and rows of a piece measuring widthCm x heightCm, knitted at a gauge of stitchesPerGauge x rowsPerGauge per 10 cm.
+  // Its stixels approximate the stitch's aspect ratio as closely as the limits allow. Empty if no stixel fits the limits,
+  // or if any of the inputs is 0.
+  std::optional<ChartGeometry> chart_geometry(unsigned widthCm, unsigned heightCm, unsigned rowsPerGauge, unsigned stitchesPerGauge, const Limits& limits);
+
+  // stixel whose height / width comes closest to stitchesPerGauge / rowsPerGauge, with neither side above maxSize and
+  // at most maxArea pixels (0 leaves either open). Exact ratios are always reduced to the smallest stixel.
+  std::optional<StixelSize> closest_stixel_size(unsigned rowsPerGauge, unsigned stitchesPerGauge, unsigned maxSize, unsigned long long maxArea);
+}
\ No newline at end of file
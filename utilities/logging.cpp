@@ -1,8 +1,84 @@
 #include "logging.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 
 namespace
 {
   bool isActive(logging::Level current, logging::Level min);
+
+  // records a thread can queue before it has to wait for the writer
+  constexpr std::size_t RING_SLOTS{ 256 };
+  // how long the writer sleeps when no producer woke it up, producers don't take the lock to notify it
+  constexpr std::chrono::milliseconds WRITER_POLL{ 20 };
+  std::atomic<unsigned> nextSinkId{ 0 };
+}
+
+namespace logging
+{
+  struct AsyncSink::Line
+  {
+    unsigned long long sequence;
+    std::string text;
+  };
+
+  // single producer, single consumer: only the owning thread pushes, only the writer pops
+  struct AsyncSink::Ring
+  {
+    struct Slot
+    {
+      unsigned long long sequence;
+      std::size_t length;
+      char text[Record::CAPACITY];
+    };
+
+    bool push(unsigned long long in_sequence, const char* in_text, std::size_t in_length)
+    {
+      const std::size_t position{ head.load(std::memory_order_relaxed) };
+      if (position - tail.load(std::memory_order_acquire) == RING_SLOTS) return false;
+      Slot& slot{ slots[position % RING_SLOTS] };
+      slot.sequence = in_sequence;
+      slot.length = std::min(in_length, Record::CAPACITY);
+      std::memcpy(slot.text, in_text, slot.length);
+      head.store(position + 1, std::memory_order_release);
+      return true;
+    }
+
+    void drainInto(std::vector<Line>& io_lines)
+    {
+      const std::size_t end{ head.load(std::memory_order_acquire) };
+      std::size_t position{ tail.load(std::memory_order_relaxed) };
+      for (; position != end; ++position)
+      {
+        const Slot& slot{ slots[position % RING_SLOTS] };
+        io_lines.push_back(Line{ slot.sequence, std::string(slot.text, slot.length) });
+      }
+      tail.store(position, std::memory_order_release);
+    }
+
+    bool empty() const
+    {
+      return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    std::atomic<std::size_t> head{ 0 };
+    std::atomic<std::size_t> tail{ 0 };
+    // set when the owning thread ends, the writer drops the ring once it's empty
+    std::atomic<bool> abandoned{ false };
+    Slot slots[RING_SLOTS];
+  };
+
+  struct AsyncSink::ThreadRings
+  {
+    ~ThreadRings()
+    {
+      for (auto& ring : rings) ring.second->abandoned = true;
+    }
+    std::vector<std::pair<unsigned, std::shared_ptr<Ring>>> rings;
+  };
+
+  thread_local AsyncSink::ThreadRings AsyncSink::threadRings;
 }
 
 namespace logging
@@ -13,12 +89,25 @@ namespace logging
     static LogStream instance;
     return instance;
   }
-  LogStream::LogStream() : m_outStream{ std::cout }, m_minLogLevel{ Level::ERR }, m_currentLogLevel{ Level::OFF }{}
+  LogStream::LogStream() : m_outStream{ std::cout }, m_minLogLevel{ Level::ERR }, m_currentLogLevel{ Level::OFF }, m_sinkStarted{}, m_sink{} {}
+
+  LogStream::~LogStream() = default;
 
   void LogStream::setLogLevel(Level logLevel) { 
     m_minLogLevel = logLevel; 
   }
 
+  bool LogStream::enabled(Level logLevel) const
+  {
+    return isActive(logLevel, m_minLogLevel.load(std::memory_order_relaxed));
+  }
+
+  AsyncSink& LogStream::sink()
+  {
+    std::call_once(m_sinkStarted, [this]() { m_sink = std::make_unique<AsyncSink>(getOutStream()); });
+    return *m_sink;
+  }
+
  std::ostream& LogStream::getOutStream()
   {
     return m_outStream;
@@ -48,7 +137,7 @@ namespace logging
   {
     if (isActive(m_currentLogLevel, m_minLogLevel) && (Level::OFF == lvl))
     {
-      getOutStream() << std::endl;
+      getOutStream() << '\n';
     }
     if (lvl >= m_minLogLevel) // if OFF wasn't the highest value in the enum, this would need further handling!
     {
@@ -70,6 +159,150 @@ namespace logging
 #undef STIXELATOR_LOG_TEMPLATE_SPECIALIZATION
 
   LogStream& logger() { return LogStream::instance(); }
+
+  AsyncSink::AsyncSink(std::ostream& io_stream)
+    : id{ nextSinkId++ }
+    , stream{ io_stream }
+    , mutex{}
+    , wakeUp{}
+    , caughtUp{}
+    , rings{}
+    , submitted{ 0 }
+    , written{ 0 }
+    , stopping{ false }
+    , writer{}
+  {
+    writer = std::thread(&AsyncSink::writerLoop, this);
+  }
+
+  AsyncSink::~AsyncSink()
+  {
+    {
+      std::lock_guard<std::mutex> lock{ mutex };
+      stopping = true;
+    }
+    wakeUp.notify_one();
+    writer.join();
+  }
+
+  void AsyncSink::submit(const char* in_text, std::size_t in_length)
+  {
+    Ring& ring{ ringOfThisThread() };
+    const unsigned long long sequence{ submitted++ };
+    while (!ring.push(sequence, in_text, in_length))
+    {
+      wakeUp.notify_one();
+      std::this_thread::yield();
+    }
+    wakeUp.notify_one();
+  }
+
+  void AsyncSink::flush()
+  {
+    const unsigned long long target{ submitted };
+    std::unique_lock<std::mutex> lock{ mutex };
+    wakeUp.notify_one();
+    caughtUp.wait(lock, [&]() { return written >= target; });
+  }
+
+  AsyncSink::Ring& AsyncSink::ringOfThisThread()
+  {
+    for (auto& ring : threadRings.rings)
+    {
+      if (ring.first == id) return *ring.second;
+    }
+    auto ring{ std::make_shared<Ring>() };
+    {
+      std::lock_guard<std::mutex> lock{ mutex };
+      rings.push_back(ring);
+    }
+    threadRings.rings.emplace_back(id, ring);
+    return *ring;
+  }
+
+  void AsyncSink::writerLoop()
+  {
+    std::vector<std::shared_ptr<Ring>> current;
+    std::vector<Line> lines;
+    std::unique_lock<std::mutex> lock{ mutex };
+    while (true)
+    {
+      const bool stop{ stopping };
+      current = rings;
+      lock.unlock();
+      lines.clear();
+      for (auto& ring : current)
+      {
+        ring->drainInto(lines);
+      }
+      if (!lines.empty())
+      {
+        // several threads' lines in submission order, one flush per batch instead of one per line
+        std::sort(lines.begin(), lines.end(), [](const Line& a, const Line& b) { return a.sequence < b.sequence; });
+        for (const auto& line : lines)
+        {
+          stream.write(line.text.data(), line.text.size()).put('\n');
+        }
+        stream.flush();
+      }
+      lock.lock();
+      written += lines.size();
+      rings.erase(std::remove_if(rings.begin(), rings.end(), [](const auto& ring) { return ring->abandoned && ring->empty(); }), rings.end());
+      caughtUp.notify_all();
+      if (!lines.empty()) continue;
+      if (stop) return;
+      wakeUp.wait_for(lock, WRITER_POLL);
+    }
+  }
+
+  // the text buffer stays uninitialized, only the first length characters ever get read
+  Record::Record(AsyncSink& io_sink) : sink{ io_sink }, length{ 0 } {}
+
+  Record::~Record()
+  {
+    sink.submit(text, length);
+  }
+
+  Record& Record::operator<<(const char* in_text)
+  {
+    append(in_text, std::strlen(in_text));
+    return *this;
+  }
+
+  Record& Record::operator<<(const std::string& in_text)
+  {
+    append(in_text.data(), in_text.size());
+    return *this;
+  }
+
+  Record& Record::operator<<(int in_value)
+  {
+    char digits[16];
+    append(digits, std::snprintf(digits, sizeof(digits), "%d", in_value));
+    return *this;
+  }
+
+  Record& Record::operator<<(unsigned in_value)
+  {
+    char digits[16];
+    append(digits, std::snprintf(digits, sizeof(digits), "%u", in_value));
+    return *this;
+  }
+
+  Record& Record::operator<<(double in_value)
+  {
+    // same as the default formatting of a std::ostream
+    char digits[32];
+    append(digits, std::snprintf(digits, sizeof(digits), "%g", in_value));
+    return *this;
+  }
+
+  void Record::append(const char* in_text, std::size_t in_length)
+  {
+    const std::size_t copied{ std::min(in_length, CAPACITY - length) };
+    std::memcpy(text + length, in_text, copied);
+    length += copied;
+  }
   
 }
 #include <vector>
@@ -85,6 +318,7 @@ namespace
 
 #ifdef DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest.h>
+#include <sstream>
 
 TEST_CASE("Test is-active check") {
   // everything prints to DEBUG
@@ -248,7 +482,6 @@ void test_log_level_logging(logging::Level level_to_test, const std::vector<logg
   verify_log_for_level(testStream, level_to_test, testInputDouble, testInputString, supported, unsupported);
 }
 
-#include <sstream>
 TEST_CASE("test level logic")
 {
   test_log_level_logging(logging::Level::OFF, 
@@ -277,4 +510,72 @@ TEST_CASE("test level logic")
   );
 }
 
+TEST_CASE("test records format like a stream")
+{
+  std::stringstream expected;
+  std::stringstream output;
+  {
+    logging::AsyncSink sink(output);
+    logging::Record{ sink } << "text " << std::string("string ") << -15 << " " << 15u << " " << 15.5 << " " << 0.1;
+    expected << "text " << std::string("string ") << -15 << " " << 15u << " " << 15.5 << " " << 0.1 << "\n";
+    sink.flush();
+    CHECK_EQ(output.str(), expected.str());
+
+    // long messages get cut off instead of overflowing the record
+    logging::Record{ sink } << std::string(logging::Record::CAPACITY + 10, 'x');
+    expected << std::string(logging::Record::CAPACITY, 'x') << "\n";
+  }
+  // destroying the sink writes what's left
+  CHECK_EQ(output.str(), expected.str());
+}
+
+TEST_CASE("test sink keeps each thread's lines in order")
+{
+  const unsigned threadCount{ 4 };
+  // more lines than a ring holds, so producers have to wait for the writer
+  const unsigned lineCount{ 1000 };
+  std::stringstream output;
+  {
+    logging::AsyncSink sink(output);
+    std::vector<std::thread> threads;
+    for (unsigned thread = 0; thread < threadCount; ++thread)
+    {
+      threads.emplace_back([&sink, thread]() {
+        for (unsigned line = 0; line < lineCount; ++line)
+        {
+          logging::Record{ sink } << thread << " " << line;
+        }
+      });
+    }
+    for (auto& thread : threads) thread.join();
+  }
+  std::vector<unsigned> nextLine(threadCount, 0);
+  unsigned thread, line, total{ 0 };
+  while (output >> thread >> line)
+  {
+    REQUIRE_LT(thread, threadCount);
+    CHECK_EQ(line, nextLine[thread]++);
+    ++total;
+  }
+  CHECK_EQ(total, threadCount * lineCount);
+}
+
+int counted_calls{ 0 };
+int count_call()
+{
+  return ++counted_calls;
+}
+
+TEST_CASE("test disabled messages don't get evaluated")
+{
+  logging::logger().setLogLevel(logging::Level::SELF_DESTRUCT);
+  STIXELATOR_LOG(DEBUG, "not shown " << count_call());
+  STIXELATOR_LOG(ERR, "not shown " << count_call());
+  CHECK_EQ(counted_calls, 0);
+  CHECK_FALSE(logging::logger().enabled(logging::Level::ERR));
+  CHECK(logging::logger().enabled(logging::Level::SELF_DESTRUCT));
+  CHECK_FALSE(logging::logger().enabled(logging::Level::OFF));
+  logging::logger().setLogLevel(logging::Level::ERR);
+}
+
 #endif
\ No newline at end of file
@@ -2,6 +2,29 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <cstddef>
+
+// messages below this level are compiled out of STIXELATOR_LOG, the value is a logging::Level
+#ifndef STIXELATOR_LOG_LEVEL
+#define STIXELATOR_LOG_LEVEL 0
+#endif
+
+// logs a message built with <<, e.g. STIXELATOR_LOG(DEBUG, "Set " << count << " colors").
+// Levels below STIXELATOR_LOG_LEVEL leave no code behind, and the message only gets evaluated if its level is enabled.
+#define STIXELATOR_LOG(level, message) \
+  do \
+  { \
+    if constexpr (logging::Level::level >= logging::compiled_level && logging::Level::level != logging::Level::OFF) \
+    { \
+      if (logging::logger().enabled(logging::Level::level)) logging::Record{ logging::logger().sink() } << message; \
+    } \
+  } while (false)
 
 namespace logging
 {
@@ -15,11 +38,51 @@ namespace logging
     OFF,
   };
 
+  constexpr Level compiled_level{ static_cast<Level>(STIXELATOR_LOG_LEVEL) };
+
+  // writes lines to a stream on a background thread. Each thread that submits gets its own lock-free ring of
+  // fixed size records, so logging threads never wait for each other or for the stream unless their ring is full.
+  // Lines of one thread keep their order.
+  class AsyncSink
+  {
+  public:
+    explicit AsyncSink(std::ostream& io_stream);
+    // writes whatever is still queued
+    ~AsyncSink();
+    void submit(const char* in_text, std::size_t in_length);
+    // returns once the lines submitted before the call are written
+    void flush();
+
+  private:
+    struct Ring;
+    struct Line;
+    // the rings a thread owns, one per sink it has logged to
+    struct ThreadRings;
+    static thread_local ThreadRings threadRings;
+    Ring& ringOfThisThread();
+    void writerLoop();
+
+    const unsigned id;
+    std::ostream& stream;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::condition_variable caughtUp;
+    std::vector<std::shared_ptr<Ring>> rings;
+    std::atomic<unsigned long long> submitted;
+    unsigned long long written;
+    bool stopping;
+    std::thread writer;
+  };
+
   class LogStream
   {
   public:
     static LogStream& instance();
+    virtual ~LogStream();
     void setLogLevel(Level logLevel);
+    bool enabled(Level logLevel) const;
+    // background writer for the output stream, started on first use
+    AsyncSink& sink();
     template<typename T>
     LogStream& operator<<(T arg);
   protected:
@@ -29,9 +92,32 @@ namespace logging
     Level getLogLevel() const;
   private:
     std::ostream& m_outStream;
-    Level m_minLogLevel;
+    std::atomic<Level> m_minLogLevel;
     Level m_currentLogLevel;
+    std::once_flag m_sinkStarted;
+    std::unique_ptr<AsyncSink> m_sink;
   };
 
   LogStream& logger();
+
+  // one STIXELATOR_LOG message, formatted into a fixed buffer and submitted once it goes out of scope.
+  // Longer messages get truncated.
+  class Record
+  {
+  public:
+    static constexpr std::size_t CAPACITY{ 240 };
+    explicit Record(AsyncSink& io_sink);
+    ~Record();
+    Record& operator<<(const char* in_text);
+    Record& operator<<(const std::string& in_text);
+    Record& operator<<(int in_value);
+    Record& operator<<(unsigned in_value);
+    Record& operator<<(double in_value);
+
+  private:
+    void append(const char* in_text, std::size_t in_length);
+    AsyncSink& sink;
+    std::size_t length;
+    char text[CAPACITY];
+  };
 }
\ No newline at end of file
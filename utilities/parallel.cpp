@@ -0,0 +1,292 @@
+#include "parallel.h"
+#include "tracing.h"
+#include <thread>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+
+namespace
+{
+  // one for_each_band call: bands get claimed one by one by whichever thread is free
+  class Batch
+  {
+  public:
+    Batch(unsigned in_count, unsigned in_bands, const std::function<void(unsigned, unsigned)>& in_work);
+    // runs claimed bands until none are left, returns false if there was nothing left to claim
+    bool work();
+    bool exhausted() const;
+    void wait();
+
+  private:
+    const unsigned count;
+    const unsigned bands;
+    const std::function<void(unsigned, unsigned)>& work_;
+    std::atomic<unsigned> nextBand;
+    std::mutex mutex;
+    std::condition_variable done;
+    unsigned finishedBands;
+    std::exception_ptr failure;
+  };
+
+  class ThreadPool
+  {
+  public:
+    static ThreadPool& instance();
+    ~ThreadPool();
+    unsigned size();
+    void resize(unsigned in_threads);
+    void run(const std::shared_ptr<Batch>& in_batch);
+
+  private:
+    ThreadPool();
+    void startHelpers(unsigned in_threads);
+    void stopHelpers();
+    void helperLoop();
+
+    std::mutex resizeMutex;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::deque<std::shared_ptr<Batch>> queue;
+    std::vector<std::thread> helpers;
+    bool stopping;
+  };
+
+  unsigned hardwareThreads();
+}
+
+namespace parallel
+{
+  unsigned worker_count()
+  {
+    return ThreadPool::instance().size();
+  }
+
+  void set_worker_count(unsigned count)
+  {
+    ThreadPool::instance().resize(count == 0 ? hardwareThreads() : count);
+  }
+
+  void for_each_band(unsigned count, const std::function<void(unsigned, unsigned)>& in_work)
+  {
+    const unsigned workers{ worker_count() };
+    if (workers <= 1 || count <= 1)
+    {
+      if (count > 0) in_work(0, count);
+      return;
+    }
+    // a few bands per worker so uneven bands don't leave threads idle
+    const unsigned bands{ std::min(count, 4 * workers) };
+    auto batch{ std::make_shared<Batch>(count, bands, in_work) };
+    ThreadPool::instance().run(batch);
+  }
+}
+
+namespace
+{
+  Batch::Batch(unsigned in_count, unsigned in_bands, const std::function<void(unsigned, unsigned)>& in_work)
+    : count{ in_count }
+    , bands{ in_bands }
+    , work_{ in_work }
+    , nextBand{ 0 }
+    , mutex{}
+    , done{}
+    , finishedBands{ 0 }
+    , failure{}
+  {}
+
+  bool Batch::work()
+  {
+    bool claimedAny{ false };
+    for (unsigned band = nextBand++; band < bands; band = nextBand++)
+    {
+      claimedAny = true;
+      std::exception_ptr bandFailure;
+      try
+      {
+        tracing::Span span{ "band" };
+        work_((unsigned)((unsigned long long)band * count / bands), (unsigned)((unsigned long long)(band + 1) * count / bands));
+      }
+      catch (...)
+      {
+        bandFailure = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock{ mutex };
+      if (bandFailure && !failure) failure = bandFailure;
+      if (++finishedBands == bands) done.notify_all();
+    }
+    return claimedAny;
+  }
+
+  bool Batch::exhausted() const
+  {
+    return nextBand.load() >= bands;
+  }
+
+  void Batch::wait()
+  {
+    std::unique_lock<std::mutex> lock{ mutex };
+    done.wait(lock, [this]() { return finishedBands == bands; });
+    if (failure) std::rethrow_exception(failure);
+  }
+
+  ThreadPool& ThreadPool::instance()
+  {
+    static ThreadPool instance;
+    return instance;
+  }
+
+  ThreadPool::ThreadPool()
+    : resizeMutex{}
+    , mutex{}
+    , wakeUp{}
+    , queue{}
+    , helpers{}
+    , stopping{ false }
+  {
+    startHelpers(hardwareThreads());
+  }
+
+  ThreadPool::~ThreadPool()
+  {
+    stopHelpers();
+  }
+
+  unsigned ThreadPool::size()
+  {
+    std::lock_guard<std::mutex> lock{ mutex };
+    return (unsigned)helpers.size() + 1;
+  }
+
+  void ThreadPool::resize(unsigned in_threads)
+  {
+    std::lock_guard<std::mutex> resizeLock{ resizeMutex };
+    stopHelpers();
+    startHelpers(in_threads);
+  }
+
+  void ThreadPool::run(const std::shared_ptr<Batch>& in_batch)
+  {
+    {
+      std::lock_guard<std::mutex> lock{ mutex };
+      queue.push_back(in_batch);
+    }
+    wakeUp.notify_all();
+    // the caller helps out, so its batch finishes even if all helpers are busy elsewhere
+    in_batch->work();
+    in_batch->wait();
+  }
+
+  void ThreadPool::startHelpers(unsigned in_threads)
+  {
+    std::lock_guard<std::mutex> lock{ mutex };
+    stopping = false;
+    for (unsigned helper = 1; helper < std::max(1u, in_threads); ++helper)
+    {
+      helpers.emplace_back(&ThreadPool::helperLoop, this);
+    }
+  }
+
+  void ThreadPool::stopHelpers()
+  {
+    std::vector<std::thread> stopped;
+    {
+      std::lock_guard<std::mutex> lock{ mutex };
+      stopping = true;
+      stopped.swap(helpers);
+    }
+    wakeUp.notify_all();
+    for (auto& helper : stopped)
+    {
+      helper.join();
+    }
+  }
+
+  void ThreadPool::helperLoop()
+  {
+    tracing::name_thread("pool helper");
+    std::unique_lock<std::mutex> lock{ mutex };
+    while (true)
+    {
+      wakeUp.wait(lock, [this]() { return stopping || !queue.empty(); });
+      if (stopping) return;
+      auto batch{ queue.front() };
+      lock.unlock();
+      batch->work();
+      lock.lock();
+      // whoever notices first removes the batch, the callers wait for their own batch anyway
+      auto position{ std::find(queue.begin(), queue.end(), batch) };
+      if (position != queue.end() && batch->exhausted()) queue.erase(position);
+    }
+  }
+
+  unsigned hardwareThreads()
+  {
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
+}
+
+#ifdef DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest.h>
+#include <stdexcept>
+
+void check_each_index_once(unsigned count)
+{
+  std::vector<std::atomic<unsigned>> visits(count);
+  parallel::for_each_band(count, [&](unsigned begin, unsigned end) {
+    CHECK_LE(begin, end);
+    for (unsigned index = begin; index < end; ++index) ++visits[index];
+  });
+  for (auto& visit : visits)
+  {
+    CHECK_EQ(visit.load(), 1u);
+  }
+}
+
+TEST_CASE("test for_each_band covers every index once") {
+  for (unsigned workers : { 1u, 2u, 5u, 0u })
+  {
+    parallel::set_worker_count(workers);
+    for (unsigned count : { 0u, 1u, 2u, 7u, 1000u })
+    {
+      check_each_index_once(count);
+    }
+  }
+}
+
+TEST_CASE("test nested for_each_band") {
+  parallel::set_worker_count(3);
+  std::atomic<unsigned> visits{ 0 };
+  parallel::for_each_band(8, [&](unsigned begin, unsigned end) {
+    for (unsigned outer = begin; outer < end; ++outer)
+    {
+      parallel::for_each_band(8, [&](unsigned innerBegin, unsigned innerEnd) { visits += innerEnd - innerBegin; });
+    }
+  });
+  CHECK_EQ(visits.load(), 64u);
+  parallel::set_worker_count(0);
+}
+
+TEST_CASE("test for_each_band passes on exceptions") {
+  parallel::set_worker_count(4);
+  CHECK_THROWS(parallel::for_each_band(100, [](unsigned begin, unsigned end) {
+    if (begin <= 50 && 50 < end) throw std::runtime_error("band failed");
+  }));
+  // the pool keeps working afterwards
+  check_each_index_once(100);
+  parallel::set_worker_count(0);
+}
+
+TEST_CASE("test worker_count") {
+  parallel::set_worker_count(3);
+  CHECK_EQ(parallel::worker_count(), 3u);
+  parallel::set_worker_count(1);
+  CHECK_EQ(parallel::worker_count(), 1u);
+  parallel::set_worker_count(0);
+  CHECK_GE(parallel::worker_count(), 1u);
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,15 @@
+#pragma once
+#include <functional>
+
+namespace parallel
+{
+  // number of threads working on bands, including the calling thread
+  unsigned worker_count();
+  // resizes the shared thread pool, 0 selects one thread per hardware thread
+  void set_worker_count(unsigned count);
+
+  // splits [0, count) into contiguous bands and runs in_work(begin, end) on each of them, spread over the
+  // shared thread pool and the calling thread. Band boundaries only depend on count and the worker count.
+  // Returns when all bands are done, rethrowing the first exception thrown by any band.
+  void for_each_band(unsigned count, const std::function<void(unsigned, unsigned)>& in_work);
+}
\ No newline at end of file
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 
 namespace one_bit
 {
@@ -25,4 +26,12 @@ namespace one_bit
     BOTTOM, 
     BOTTOM_RIGHT,
   };
+
+  enum class DitherMode : uint32_t
+  {
+    NONE = 0,
+    FLOYD_STEINBERG,
+    ATKINSON,
+    BAYER,
+  };
 }
\ No newline at end of file
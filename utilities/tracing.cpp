@@ -0,0 +1,251 @@
+#include "tracing.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+
+namespace
+{
+  struct Event
+  {
+    const char* name;
+    unsigned long long bytes;
+    std::chrono::steady_clock::time_point begin;
+    std::chrono::steady_clock::time_point end;
+  };
+
+  // events of one thread, the lock is only ever contended while a trace gets written
+  struct ThreadTrace
+  {
+    unsigned id;
+    std::string name;
+    std::mutex mutex;
+    std::vector<Event> events;
+  };
+
+  class Registry
+  {
+  public:
+    static Registry& instance();
+    ThreadTrace& threadTrace();
+    void clear();
+    void writeJson(std::ostream& io_stream);
+
+    std::atomic<bool> enabled{ false };
+    const std::chrono::steady_clock::time_point epoch{ std::chrono::steady_clock::now() };
+
+  private:
+    std::mutex mutex;
+    // kept after their threads end, their spans still belong into the trace
+    std::vector<std::shared_ptr<ThreadTrace>> threads;
+  };
+
+  void write_escaped(std::ostream& io_stream, const std::string& in_text);
+  double microseconds(std::chrono::steady_clock::duration in_duration);
+}
+
+namespace tracing
+{
+  void set_enabled(bool in_enabled)
+  {
+    Registry::instance().enabled = in_enabled;
+  }
+
+  bool enabled()
+  {
+    return Registry::instance().enabled.load(std::memory_order_relaxed);
+  }
+
+  void name_thread(const std::string& in_name)
+  {
+    ThreadTrace& trace{ Registry::instance().threadTrace() };
+    std::lock_guard<std::mutex> lock{ trace.mutex };
+    trace.name = in_name;
+  }
+
+  void clear()
+  {
+    Registry::instance().clear();
+  }
+
+  void write_json(std::ostream& io_stream)
+  {
+    Registry::instance().writeJson(io_stream);
+  }
+
+  bool write_file(const std::string& in_path)
+  {
+    std::ofstream file(in_path);
+    if (!file) return false;
+    write_json(file);
+    return (bool)file;
+  }
+
+  Span::Span(const char* in_name, unsigned long long in_bytes)
+    : name{ in_name }
+    , bytes{ in_bytes }
+    , active{ enabled() }
+    , begin{ active ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{} }
+  {}
+
+  Span::~Span()
+  {
+    if (!active) return;
+    const auto end{ std::chrono::steady_clock::now() };
+    ThreadTrace& trace{ Registry::instance().threadTrace() };
+    std::lock_guard<std::mutex> lock{ trace.mutex };
+    trace.events.push_back(Event{ name, bytes, begin, end });
+  }
+
+  void Span::setBytes(unsigned long long in_bytes)
+  {
+    bytes = in_bytes;
+  }
+}
+
+namespace
+{
+  Registry& Registry::instance()
+  {
+    static Registry instance;
+    return instance;
+  }
+
+  ThreadTrace& Registry::threadTrace()
+  {
+    thread_local std::shared_ptr<ThreadTrace> trace;
+    if (!trace)
+    {
+      trace = std::make_shared<ThreadTrace>();
+      std::lock_guard<std::mutex> lock{ mutex };
+      trace->id = (unsigned)threads.size() + 1;
+      threads.push_back(trace);
+    }
+    return *trace;
+  }
+
+  void Registry::clear()
+  {
+    std::lock_guard<std::mutex> lock{ mutex };
+    for (auto& thread : threads)
+    {
+      std::lock_guard<std::mutex> threadLock{ thread->mutex };
+      thread->events.clear();
+    }
+  }
+
+  void Registry::writeJson(std::ostream& io_stream)
+  {
+    std::lock_guard<std::mutex> lock{ mutex };
+    // timestamps count microseconds since the first span, the default precision would round them off after a second
+    const auto flags{ io_stream.flags() };
+    const auto precision{ io_stream.precision() };
+    io_stream << std::fixed << std::setprecision(3);
+    io_stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first{ true };
+    auto separate = [&]() {
+      if (!first) io_stream << ",";
+      first = false;
+      io_stream << "\n";
+    };
+    for (auto& thread : threads)
+    {
+      std::lock_guard<std::mutex> threadLock{ thread->mutex };
+      if (!thread->name.empty())
+      {
+        separate();
+        io_stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->id << ",\"args\":{\"name\":\"";
+        write_escaped(io_stream, thread->name);
+        io_stream << "\"}}";
+      }
+      for (const auto& event : thread->events)
+      {
+        separate();
+        io_stream << "{\"name\":\"";
+        write_escaped(io_stream, event.name);
+        io_stream << "\",\"cat\":\"stixelator\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->id
+          << ",\"ts\":" << microseconds(event.begin - epoch) << ",\"dur\":" << microseconds(event.end - event.begin)
+          << ",\"args\":{\"bytes\":" << event.bytes << "}}";
+      }
+    }
+    io_stream << "\n]}\n";
+    io_stream.flags(flags);
+    io_stream.precision(precision);
+  }
+
+  void write_escaped(std::ostream& io_stream, const std::string& in_text)
+  {
+    for (const char character : in_text)
+    {
+      if (character == '"' || character == '\\') io_stream << '\\';
+      if ((unsigned char)character < 0x20) continue;
+      io_stream << character;
+    }
+  }
+
+  double microseconds(std::chrono::steady_clock::duration in_duration)
+  {
+    return std::chrono::duration<double, std::micro>(in_duration).count();
+  }
+}
+
+#ifdef DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest.h>
+#include <sstream>
+#include <thread>
+
+unsigned count_occurrences(const std::string& in_text, const std::string& in_pattern)
+{
+  unsigned result{ 0 };
+  for (auto position = in_text.find(in_pattern); position != std::string::npos; position = in_text.find(in_pattern, position + 1)) ++result;
+  return result;
+}
+
+TEST_CASE("test disabled spans record nothing")
+{
+  tracing::clear();
+  tracing::set_enabled(false);
+  {
+    tracing::Span span{ "hidden" };
+  }
+  std::stringstream json;
+  tracing::write_json(json);
+  CHECK_EQ(count_occurrences(json.str(), "hidden"), 0u);
+}
+
+TEST_CASE("test spans of several threads")
+{
+  tracing::clear();
+  tracing::set_enabled(true);
+  tracing::name_thread("main \"thread\"");
+  {
+    tracing::Span outer{ "outer", 100 };
+    std::thread other([]() {
+      tracing::name_thread("other");
+      tracing::Span inner{ "inner" };
+      inner.setBytes(42);
+    });
+    other.join();
+  }
+  tracing::set_enabled(false);
+  std::stringstream json;
+  tracing::write_json(json);
+  const std::string text{ json.str() };
+  CHECK_EQ(count_occurrences(text, "\"ph\":\"X\""), 2u);
+  CHECK_EQ(count_occurrences(text, "\"name\":\"outer\""), 1u);
+  CHECK_EQ(count_occurrences(text, "\"bytes\":100}"), 1u);
+  CHECK_EQ(count_occurrences(text, "\"bytes\":42}"), 1u);
+  CHECK_EQ(count_occurrences(text, "\"name\":\"main \\\"thread\\\"\""), 1u);
+  CHECK_EQ(count_occurrences(text, "\"name\":\"other\""), 1u);
+  // the spans land on different tracks
+  CHECK_NE(text.find("\"tid\":1,"), std::string::npos);
+  CHECK_NE(text.find("\"tid\":2,"), std::string::npos);
+
+  tracing::clear();
+  std::stringstream cleared;
+  tracing::write_json(cleared);
+  CHECK_EQ(count_occurrences(cleared.str(), "\"ph\":\"X\""), 0u);
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <ostream>
+#include <chrono>
+
+// Scoped timing spans, collected per thread and exported in the Chrome trace event format that Perfetto and
+// chrome://tracing load. Collection is off by default, a disabled span costs one atomic load.
+namespace tracing
+{
+  void set_enabled(bool in_enabled);
+  bool enabled();
+  // shows up as the name of the calling thread's track
+  void name_thread(const std::string& in_name);
+  // drops everything recorded so far
+  void clear();
+  // all spans finished so far as trace event JSON
+  void write_json(std::ostream& io_stream);
+  bool write_file(const std::string& in_path);
+
+  // records the time from construction to destruction on the calling thread.
+  // in_name must stay valid until the trace is written, e.g. a string literal.
+  class Span
+  {
+  public:
+    explicit Span(const char* in_name, unsigned long long in_bytes = 0);
+    ~Span();
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+    // amount of data the span handled, for spans that only know it once they're done
+    void setBytes(unsigned long long in_bytes);
+
+  private:
+    const char* name;
+    unsigned long long bytes;
+    bool active;
+    std::chrono::steady_clock::time_point begin;
+  };
+}
\ No newline at end of file